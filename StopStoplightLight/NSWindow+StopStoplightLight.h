@@ -36,6 +36,9 @@ NS_ASSUME_NONNULL_BEGIN
 
 + (instancetype)sharedInstance;
 
+// How long the plugin held up the main thread until its features were in place
++ (uint64_t)launchCostMicroseconds;
+
 @property (strong, nonatomic, readonly) BordersController *bordersController;
 
 @end
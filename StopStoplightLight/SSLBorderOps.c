@@ -0,0 +1,38 @@
+//
+//  SSLBorderOps.c
+//  StopStoplightLight
+//
+//  What a config change has to do to the border of a window that already has one.
+//
+
+#include "SSLBorderOps.h"
+#include "SSLConfig.h"
+
+uint32_t SSLBorderOpsForChanges(uint32_t changes, SSLBorderKind kind, bool key) {
+    if (kind == SSLBorderKindNone || !(changes & SSLConfigChangeBorders))
+        return 0;
+
+    uint32_t ops = 0;
+    // A new radius may call for a different way of clipping
+    if (changes & SSLConfigChangeCornerRadius)
+        ops |= SSLBorderOpClip;
+    if (changes & SSLConfigChangeBorderStyle)
+        return ops | SSLBorderOpRebuild;
+
+    uint32_t shownColor = key ? SSLConfigChangeActiveColor : SSLConfigChangeInactiveColor;
+    if (kind == SSLBorderKindNineSlice) {
+        if (changes & (shownColor | SSLConfigChangeBorderWidth | SSLConfigChangeCornerRadius))
+            ops |= SSLBorderOpSliceImage;
+        return ops;
+    }
+
+    if (changes & SSLConfigChangeCornerRadius)
+        ops |= SSLBorderOpPath;
+    if (changes & SSLConfigChangeBorderWidth)
+        ops |= SSLBorderOpLineWidth;
+    if (changes & SSLConfigChangeActiveColor)
+        ops |= SSLBorderOpBorderColor;
+    if (changes & shownColor)
+        ops |= SSLBorderOpOutlineColor;
+    return ops;
+}
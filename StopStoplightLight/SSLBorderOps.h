@@ -0,0 +1,47 @@
+//
+//  SSLBorderOps.h
+//  StopStoplightLight
+//
+//  What a config change has to do to the border of a window that already has one.
+//
+
+#ifndef SSLBorderOps_h
+#define SSLBorderOps_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum SSLBorderKind {
+    SSLBorderKindNone,
+    // an outline and a border CAShapeLayer
+    SSLBorderKindStroked,
+    // one layer showing a stretched nine-slice image
+    SSLBorderKindNineSlice,
+} SSLBorderKind;
+
+typedef enum SSLBorderOp {
+    SSLBorderOpClip         = 1 << 0,
+    // remove the border layers and add them again, nothing else is needed then
+    SSLBorderOpRebuild      = 1 << 1,
+    SSLBorderOpSliceImage   = 1 << 2,
+    SSLBorderOpPath         = 1 << 3,
+    SSLBorderOpLineWidth    = 1 << 4,
+    // the border layer is always in the active color
+    SSLBorderOpBorderColor  = 1 << 5,
+    // the outline is in the color for whether the window is key
+    SSLBorderOpOutlineColor = 1 << 6,
+} SSLBorderOp;
+
+// The SSLBorderOp bits for SSLConfigChange changes to a window's border of kind. Colors the window
+// doesn't show while it is or isn't key are left alone
+uint32_t SSLBorderOpsForChanges(uint32_t changes, SSLBorderKind kind, bool key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLBorderOps_h */
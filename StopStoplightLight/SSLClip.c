@@ -0,0 +1,48 @@
+//
+//  SSLClip.c
+//  StopStoplightLight
+//
+//  Picks the cheapest way to round the corners of a window's content.
+//
+
+#include "SSLClip.h"
+
+SSLClipMode SSLClipChoose(const SSLClipWindow *window, const SSLClipTree *tree, const void *contentLayer) {
+    if (window->cornerRadius <= 0 || window->fullScreen)
+        return SSLClipModeNone;
+
+    const void *stack[SSL_CLIP_MAX_LAYERS];
+    size_t depth = 0, visited = 0;
+    stack[depth++] = contentLayer;
+
+    while (depth > 0) {
+        const void *layer = stack[--depth];
+        if (++visited > SSL_CLIP_MAX_LAYERS)
+            return SSLClipModeShapeMask;
+
+        SSLClipLayerInfo info = { 0, false };
+        tree->info(layer, &info);
+        if (info.hostsRemoteContent)
+            return SSLClipModeShapeMask;
+        // The app rounds the content itself, taking over its cornerRadius would change its look
+        if (layer == contentLayer && info.cornerRadius != 0 && info.cornerRadius != window->cornerRadius)
+            return SSLClipModeShapeMask;
+
+        size_t count = tree->sublayerCount(layer);
+        if (count > SSL_CLIP_MAX_LAYERS - depth)
+            return SSLClipModeShapeMask;
+        for (size_t i = 0; i < count; i++)
+            stack[depth++] = tree->sublayer(layer, i);
+    }
+
+    return SSLClipModeCornerRadius;
+}
+
+const char *SSLClipModeName(SSLClipMode mode) {
+    switch (mode) {
+        case SSLClipModeNone:         return "none";
+        case SSLClipModeCornerRadius: return "cornerRadius";
+        case SSLClipModeShapeMask:    return "shapeMask";
+    }
+    return "unknown";
+}
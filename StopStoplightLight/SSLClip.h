@@ -0,0 +1,58 @@
+//
+//  SSLClip.h
+//  StopStoplightLight
+//
+//  Picks the cheapest way to round the corners of a window's content.
+//
+
+#ifndef SSLClip_h
+#define SSLClip_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Layers past this many aren't looked at, the shape mask is used instead
+#define SSL_CLIP_MAX_LAYERS 256
+
+typedef enum SSLClipMode {
+    // nothing to round
+    SSLClipModeNone         = 0,
+    // cornerRadius and masksToBounds on the content layer, composited without an offscreen pass
+    SSLClipModeCornerRadius = 1,
+    // a CAShapeLayer mask, renders the whole content offscreen
+    SSLClipModeShapeMask    = 2,
+} SSLClipMode;
+
+typedef struct SSLClipWindow {
+    double cornerRadius;
+    bool fullScreen;
+} SSLClipWindow;
+
+typedef struct SSLClipLayerInfo {
+    // what the layer already rounds itself by
+    double cornerRadius;
+    // drawn by another process, e.g. a CALayerHost, which masksToBounds doesn't reliably round
+    bool hostsRemoteContent;
+} SSLClipLayerInfo;
+
+// How to look at a layer tree, layers are whatever the callbacks make of them
+typedef struct SSLClipTree {
+    void (*info)(const void *layer, SSLClipLayerInfo *info);
+    size_t (*sublayerCount)(const void *layer);
+    const void *(*sublayer)(const void *layer, size_t index);
+} SSLClipTree;
+
+// contentLayer must not be rounded by an earlier choice anymore
+SSLClipMode SSLClipChoose(const SSLClipWindow *window, const SSLClipTree *tree, const void *contentLayer);
+
+const char *SSLClipModeName(SSLClipMode mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLClip_h */
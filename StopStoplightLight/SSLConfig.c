@@ -0,0 +1,482 @@
+//
+//  SSLConfig.c
+//  StopStoplightLight
+//
+//  The macwmfx config, decoded straight from JSON into plain values.
+//
+
+#include "SSLConfig.h"
+#include <math.h>
+#include <string.h>
+
+/*
+
+ A single pass over the text. Members the schema knows are decoded in place, anything else is
+ checked for being valid JSON, skipped and copied into the config as it was written. Nothing else
+ is copied, keys are compared as they were written, so a key spelled with escapes counts as unknown.
+
+ */
+#define SSL_MAX_DEPTH 64
+
+typedef struct SSLParser {
+    const char *cursor;
+    const char *end;
+    int depth;
+    SSLConfig *config;
+} SSLParser;
+
+// What a member parser did with the value
+typedef enum {
+    SSLMemberError = -1,
+    SSLMemberUnknown = 0,
+    SSLMemberParsed = 1,
+} SSLMemberResult;
+
+typedef SSLMemberResult (*SSLMemberParser)(SSLParser *parser, const char *key, size_t keyLength);
+
+static bool skipValue(SSLParser *parser);
+
+static void skipWhitespace(SSLParser *parser) {
+    while (parser->cursor < parser->end) {
+        char c = *parser->cursor;
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            return;
+        parser->cursor++;
+    }
+}
+
+static bool consume(SSLParser *parser, char c) {
+    skipWhitespace(parser);
+    if (parser->cursor >= parser->end || *parser->cursor != c)
+        return false;
+    parser->cursor++;
+    return true;
+}
+
+static bool peek(SSLParser *parser, char c) {
+    skipWhitespace(parser);
+    return parser->cursor < parser->end && *parser->cursor == c;
+}
+
+// One more than the value of every hex digit, zero for everything else
+static const uint8_t hexDigits[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+static int hexValue(char c) {
+    return hexDigits[(unsigned char)c] - 1;
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Hands back the contents between the quotes as written, escaped is set if there are any escapes in there
+static bool parseString(SSLParser *parser, const char **chars, size_t *length, bool *escaped) {
+    if (!consume(parser, '"'))
+        return false;
+
+    const char *begin = parser->cursor;
+    *escaped = false;
+    while (parser->cursor < parser->end) {
+        unsigned char c = (unsigned char)*parser->cursor++;
+        if (c == '"') {
+            *chars  = begin;
+            *length = (size_t)(parser->cursor - 1 - begin);
+            return true;
+        }
+        if (c < 0x20)
+            return false;
+        if (c != '\\')
+            continue;
+
+        *escaped = true;
+        if (parser->cursor >= parser->end)
+            return false;
+
+        char escape = *parser->cursor++;
+        if (escape == 'u') {
+            if (parser->end - parser->cursor < 4)
+                return false;
+            for (int i = 0; i < 4; i++) {
+                if (hexValue(*parser->cursor++) < 0)
+                    return false;
+            }
+        } else if (strchr("\"\\/bfnrt", escape) == NULL || escape == '\0') {
+            return false;
+        }
+    }
+    return false;
+}
+
+static bool parseNumber(SSLParser *parser, double *value) {
+    skipWhitespace(parser);
+    const char *c = parser->cursor;
+    const char *end = parser->end;
+
+    double sign = 1.0;
+    if (c < end && *c == '-') {
+        sign = -1.0;
+        c++;
+    }
+    if (c >= end || !isDigit(*c))
+        return false;
+
+    double number = 0.0;
+    if (*c == '0') {
+        c++;
+    } else {
+        while (c < end && isDigit(*c))
+            number = number * 10.0 + (*c++ - '0');
+    }
+
+    if (c < end && *c == '.') {
+        c++;
+        if (c >= end || !isDigit(*c))
+            return false;
+        double scale = 0.1;
+        while (c < end && isDigit(*c)) {
+            number += (*c++ - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        c++;
+        int exponentSign = 1;
+        if (c < end && (*c == '+' || *c == '-'))
+            exponentSign = *c++ == '-' ? -1 : 1;
+        if (c >= end || !isDigit(*c))
+            return false;
+        int exponent = 0;
+        while (c < end && isDigit(*c)) {
+            if (exponent < 1000)
+                exponent = exponent * 10 + (*c - '0');
+            c++;
+        }
+        number *= pow(10.0, exponentSign * exponent);
+    }
+
+    parser->cursor = c;
+    *value = sign * number;
+    return true;
+}
+
+static bool parseLiteral(SSLParser *parser, const char *word) {
+    skipWhitespace(parser);
+    size_t length = strlen(word);
+    if ((size_t)(parser->end - parser->cursor) < length || memcmp(parser->cursor, word, length) != 0)
+        return false;
+    parser->cursor += length;
+    return true;
+}
+
+// Appended behind the text of the unknown members before it
+static void rememberUnknown(SSLConfig *config, const char *member, size_t length) {
+    uint32_t used = 0;
+    if (config->unknownCount > 0) {
+        SSLConfigSpan last = config->unknown[config->unknownCount - 1];
+        used = last.offset + last.length;
+    }
+
+    if (config->unknownCount == SSL_CONFIG_MAX_UNKNOWN || length > SSL_CONFIG_UNKNOWN_BYTES - used) {
+        config->unknownOverflow = true;
+        return;
+    }
+
+    memcpy(config->unknownText + used, member, length);
+    config->unknown[config->unknownCount++] = (SSLConfigSpan){ used, (uint32_t)length };
+}
+
+static bool parseObject(SSLParser *parser, SSLMemberParser member) {
+    if (!consume(parser, '{') || ++parser->depth > SSL_MAX_DEPTH)
+        return false;
+
+    if (consume(parser, '}')) {
+        parser->depth--;
+        return true;
+    }
+
+    do {
+        skipWhitespace(parser);
+        const char *memberStart = parser->cursor;
+
+        const char *key;
+        size_t keyLength;
+        bool escaped;
+        if (!parseString(parser, &key, &keyLength, &escaped) || !consume(parser, ':'))
+            return false;
+
+        SSLMemberResult result = member == NULL || escaped ? SSLMemberUnknown : member(parser, key, keyLength);
+        if (result == SSLMemberError)
+            return false;
+        if (result == SSLMemberParsed)
+            continue;
+
+        if (!skipValue(parser))
+            return false;
+
+        rememberUnknown(parser->config, memberStart, (size_t)(parser->cursor - memberStart));
+    } while (consume(parser, ','));
+
+    parser->depth--;
+    return consume(parser, '}');
+}
+
+static bool skipArray(SSLParser *parser) {
+    if (!consume(parser, '[') || ++parser->depth > SSL_MAX_DEPTH)
+        return false;
+
+    if (!consume(parser, ']')) {
+        do {
+            if (!skipValue(parser))
+                return false;
+        } while (consume(parser, ','));
+
+        if (!consume(parser, ']'))
+            return false;
+    }
+
+    parser->depth--;
+    return true;
+}
+
+// Members inside values that are skipped aren't remembered on their own, only the outermost unknown member is
+static SSLMemberResult skipMember(SSLParser *parser, const char *key, size_t keyLength) {
+    (void)key;
+    (void)keyLength;
+    return skipValue(parser) ? SSLMemberParsed : SSLMemberError;
+}
+
+static bool skipValue(SSLParser *parser) {
+    skipWhitespace(parser);
+    if (parser->cursor >= parser->end)
+        return false;
+
+    const char *chars;
+    size_t length;
+    bool escaped;
+    double number;
+    switch (*parser->cursor) {
+        case '{':
+            return parseObject(parser, skipMember);
+        case '[':
+            return skipArray(parser);
+        case '"':
+            return parseString(parser, &chars, &length, &escaped);
+        case 't':
+            return parseLiteral(parser, "true");
+        case 'f':
+            return parseLiteral(parser, "false");
+        case 'n':
+            return parseLiteral(parser, "null");
+        default:
+            return parseNumber(parser, &number);
+    }
+}
+
+// Like -[NSNumber boolValue], numbers other than zero are true
+static bool parseBool(SSLParser *parser, bool *value) {
+    double number;
+    if (peek(parser, 't')) {
+        *value = true;
+        return parseLiteral(parser, "true");
+    }
+    if (peek(parser, 'f')) {
+        *value = false;
+        return parseLiteral(parser, "false");
+    }
+    if (peek(parser, '-') || (parser->cursor < parser->end && isDigit(*parser->cursor))) {
+        if (!parseNumber(parser, &number))
+            return false;
+        *value = number != 0.0;
+        return true;
+    }
+    return skipValue(parser);
+}
+
+static bool parseFloat(SSLParser *parser, float *value) {
+    double number;
+    if (peek(parser, '-') || (parser->cursor < parser->end && isDigit(*parser->cursor))) {
+        if (!parseNumber(parser, &number))
+            return false;
+        *value = (float)number;
+        return true;
+    }
+    return skipValue(parser);
+}
+
+// A color that doesn't parse keeps the default
+static bool parseColor(SSLParser *parser, uint32_t *value) {
+    if (!peek(parser, '"'))
+        return skipValue(parser);
+
+    const char *chars;
+    size_t length;
+    bool escaped;
+    if (!parseString(parser, &chars, &length, &escaped))
+        return false;
+
+    uint32_t color;
+    if (!escaped && SSLParseHexColor(chars, length, &color))
+        *value = color;
+    return true;
+}
+
+static bool keyEquals(const char *key, size_t keyLength, const char *name) {
+    return strlen(name) == keyLength && memcmp(key, name, keyLength) == 0;
+}
+
+// A style that isn't known keeps the default
+static bool parseBorderStyle(SSLParser *parser, uint32_t *value) {
+    if (!peek(parser, '"'))
+        return skipValue(parser);
+
+    const char *chars;
+    size_t length;
+    bool escaped;
+    if (!parseString(parser, &chars, &length, &escaped))
+        return false;
+
+    if (escaped)
+        return true;
+    if (keyEquals(chars, length, "stroked"))
+        *value = SSLBorderStyleStroked;
+    else if (keyEquals(chars, length, "nineSlice"))
+        *value = SSLBorderStyleNineSlice;
+    return true;
+}
+
+static SSLMemberResult outlineMember(SSLParser *parser, const char *key, size_t keyLength) {
+    SSLOutlineConfig *outline = &parser->config->outlineWindow;
+    bool parsed;
+    if (keyEquals(key, keyLength, "enabled"))
+        parsed = parseBool(parser, &outline->enabled);
+    else if (keyEquals(key, keyLength, "cornerRadius"))
+        parsed = parseFloat(parser, &outline->cornerRadius);
+    else if (keyEquals(key, keyLength, "width"))
+        parsed = parseFloat(parser, &outline->width);
+    else if (keyEquals(key, keyLength, "activeColor"))
+        parsed = parseColor(parser, &outline->activeColor);
+    else if (keyEquals(key, keyLength, "inactiveColor"))
+        parsed = parseColor(parser, &outline->inactiveColor);
+    else if (keyEquals(key, keyLength, "style"))
+        parsed = parseBorderStyle(parser, &outline->style);
+    else
+        return SSLMemberUnknown;
+
+    return parsed ? SSLMemberParsed : SSLMemberError;
+}
+
+static SSLMemberResult rootMember(SSLParser *parser, const char *key, size_t keyLength) {
+    SSLConfig *config = parser->config;
+    bool parsed;
+    if (keyEquals(key, keyLength, "disableTrafficLights"))
+        parsed = parseBool(parser, &config->disableTrafficLights);
+    else if (keyEquals(key, keyLength, "disableTitlebar"))
+        parsed = parseBool(parser, &config->disableTitlebar);
+    else if (keyEquals(key, keyLength, "disableWindowSizeConstraints"))
+        parsed = parseBool(parser, &config->disableWindowSizeConstraints);
+    else if (keyEquals(key, keyLength, "outlineWindow"))
+        parsed = peek(parser, '{') ? parseObject(parser, outlineMember) : skipValue(parser);
+    else
+        return SSLMemberUnknown;
+
+    return parsed ? SSLMemberParsed : SSLMemberError;
+}
+
+void SSLConfigInitDefaults(SSLConfig *config) {
+    // Cleared as a whole, the compiled config is written out with its padding and unused text
+    memset(config, 0, sizeof(SSLConfig));
+    config->outlineWindow.width         = 2.0f;
+    config->outlineWindow.activeColor   = 0xFFFFFFFF;
+    // +[NSColor darkGrayColor]
+    config->outlineWindow.inactiveColor = 0x555555FF;
+}
+
+uint32_t SSLConfigDiff(const SSLConfig *old, const SSLConfig *current) {
+    uint32_t changes = SSLConfigChangeNone;
+    if (old->disableTrafficLights != current->disableTrafficLights ||
+        old->disableTitlebar != current->disableTitlebar ||
+        old->disableWindowSizeConstraints != current->disableWindowSizeConstraints ||
+        old->outlineWindow.enabled != current->outlineWindow.enabled)
+        changes |= SSLConfigChangeFeatures;
+    if (old->outlineWindow.activeColor != current->outlineWindow.activeColor)
+        changes |= SSLConfigChangeActiveColor;
+    if (old->outlineWindow.inactiveColor != current->outlineWindow.inactiveColor)
+        changes |= SSLConfigChangeInactiveColor;
+    if (old->outlineWindow.width != current->outlineWindow.width)
+        changes |= SSLConfigChangeBorderWidth;
+    if (old->outlineWindow.cornerRadius != current->outlineWindow.cornerRadius)
+        changes |= SSLConfigChangeCornerRadius;
+    if (old->outlineWindow.style != current->outlineWindow.style)
+        changes |= SSLConfigChangeBorderStyle;
+    return changes;
+}
+
+bool SSLConfigParse(const char *json, size_t length, SSLConfig *config) {
+    if (json == NULL || length > UINT32_MAX)
+        return false;
+
+    SSLConfig parsed = *config;
+    SSLParser parser = { json, json + length, 0, &parsed };
+    if (!parseObject(&parser, rootMember))
+        return false;
+
+    skipWhitespace(&parser);
+    if (parser.cursor != parser.end)
+        return false;
+
+    *config = parsed;
+    return true;
+}
+
+// The color notations we understand, told apart by how many digits they have
+typedef struct SSLHexFormat {
+    size_t digits;
+    // digits per channel, a single digit is repeated: #F80 is #FF8800
+    unsigned int channelDigits;
+    bool alpha;
+} SSLHexFormat;
+
+static const SSLHexFormat hexFormats[] = {
+    { 3, 1, false },
+    { 6, 2, false },
+    { 8, 2, true },
+};
+
+bool SSLParseHexColor(const char *string, size_t length, uint32_t *rgba) {
+    if (length > 0 && string[0] == '#') {
+        string++;
+        length--;
+    } else if (length > 1 && string[0] == '0' && (string[1] == 'x' || string[1] == 'X')) {
+        string += 2;
+        length -= 2;
+    }
+
+    const SSLHexFormat *format = NULL;
+    for (size_t i = 0; i < sizeof(hexFormats) / sizeof(hexFormats[0]); i++) {
+        if (hexFormats[i].digits == length)
+            format = &hexFormats[i];
+    }
+    if (format == NULL)
+        return false;
+
+    uint32_t color = 0;
+    unsigned int channels = format->alpha ? 4 : 3;
+    for (unsigned int channel = 0; channel < channels; channel++) {
+        uint32_t value = 0;
+        for (unsigned int i = 0; i < 2; i++) {
+            int digit = hexValue(string[channel * format->channelDigits + (format->channelDigits == 1 ? 0 : i)]);
+            if (digit < 0)
+                return false;
+            value = value << 4 | (uint32_t)digit;
+        }
+        color = color << 8 | value;
+    }
+
+    *rgba = format->alpha ? color : color << 8 | 0xFF;
+    return true;
+}
@@ -0,0 +1,101 @@
+//
+//  SSLConfig.h
+//  StopStoplightLight
+//
+//  The macwmfx config, decoded straight from JSON into plain values.
+//
+
+#ifndef SSLConfig_h
+#define SSLConfig_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Members the schema doesn't know about beyond this many, or this much text, are dropped and
+// unknownOverflow is set
+#define SSL_CONFIG_MAX_UNKNOWN 32
+#define SSL_CONFIG_UNKNOWN_BYTES 2048
+
+// A range of bytes in SSLConfig.unknownText
+typedef struct SSLConfigSpan {
+    uint32_t offset;
+    uint32_t length;
+} SSLConfigSpan;
+
+// How the outline is drawn, "style" in the config
+typedef enum SSLBorderStyle {
+    // stroked as a path, redrawn whenever the window changes size
+    SSLBorderStyleStroked   = 0,
+    // rendered once into a small image that is stretched, see SSLNineSlice.h
+    SSLBorderStyleNineSlice = 1,
+} SSLBorderStyle;
+
+typedef struct SSLOutlineConfig {
+    bool enabled;
+    uint32_t style;
+    float cornerRadius;
+    float width;
+    // 0xRRGGBBAA
+    uint32_t activeColor;
+    uint32_t inactiveColor;
+} SSLOutlineConfig;
+
+typedef struct SSLConfig {
+    bool disableTrafficLights;
+    bool disableTitlebar;
+    bool disableWindowSizeConstraints;
+    SSLOutlineConfig outlineWindow;
+
+    // Members the schema doesn't know about, at any depth, as "key": value exactly as they were
+    // written. Kept so the config can be written back without losing settings of newer versions.
+    // The text is copied, it outlives the JSON and goes into the compiled config as it is
+    uint32_t unknownCount;
+    bool unknownOverflow;
+    SSLConfigSpan unknown[SSL_CONFIG_MAX_UNKNOWN];
+    char unknownText[SSL_CONFIG_UNKNOWN_BYTES];
+} SSLConfig;
+
+// What differs between two configs, see SSLConfigDiff
+typedef enum SSLConfigChange {
+    SSLConfigChangeNone          = 0,
+    SSLConfigChangeActiveColor   = 1 << 0,
+    SSLConfigChangeInactiveColor = 1 << 1,
+    SSLConfigChangeBorderWidth   = 1 << 2,
+    SSLConfigChangeCornerRadius  = 1 << 3,
+    // one of the features was turned on or off
+    SSLConfigChangeFeatures      = 1 << 4,
+    SSLConfigChangeBorderStyle   = 1 << 5,
+} SSLConfigChange;
+
+// Everything that can be applied to a window that already has borders
+#define SSLConfigChangeBorders (SSLConfigChangeActiveColor | SSLConfigChangeInactiveColor | SSLConfigChangeBorderWidth | SSLConfigChangeCornerRadius | SSLConfigChangeBorderStyle)
+
+// Fills config with what applies when the file doesn't say otherwise
+void SSLConfigInitDefaults(SSLConfig *config);
+
+// Decodes json over the defaults without allocating anything. Values of the wrong type are ignored.
+// Returns false and leaves config alone if json isn't a valid JSON object
+bool SSLConfigParse(const char *json, size_t length, SSLConfig *config);
+
+// Returns the SSLConfigChange flags for everything that went from old to current
+uint32_t SSLConfigDiff(const SSLConfig *old, const SSLConfig *current);
+
+// The text of unknown member index, not NUL terminated
+static inline const char *SSLConfigUnknownMember(const SSLConfig *config, uint32_t index, size_t *length) {
+    *length = config->unknown[index].length;
+    return config->unknownText + config->unknown[index].offset;
+}
+
+// Reads "RGB", "RRGGBB" or "RRGGBBAA" with an optional "#" or "0x" in front
+bool SSLParseHexColor(const char *string, size_t length, uint32_t *rgba);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLConfig_h */
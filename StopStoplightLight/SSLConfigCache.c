@@ -0,0 +1,233 @@
+//
+//  SSLConfigCache.c
+//  StopStoplightLight
+//
+//  A compiled copy of the config that every process maps instead of parsing the JSON itself.
+//
+
+#include "SSLConfigCache.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SSL_CONFIG_CACHE_SIZE (sizeof(SSLConfigCacheHeader) + sizeof(SSLConfig))
+
+static bool usableHeader(const SSLConfigCacheHeader *header) {
+    return header->magic == SSL_CONFIG_CACHE_MAGIC && header->format == SSL_CONFIG_CACHE_FORMAT && header->configSize == sizeof(SSLConfig);
+}
+
+static void unmapCache(SSLConfigCache *cache) {
+    if (cache->header != NULL)
+        munmap(cache->header, SSL_CONFIG_CACHE_SIZE);
+    cache->header = NULL;
+}
+
+static bool mapCache(SSLConfigCache *cache) {
+    int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size == (off_t)SSL_CONFIG_CACHE_SIZE)
+        mapping = mmap(NULL, SSL_CONFIG_CACHE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    if (!usableHeader(mapping)) {
+        munmap(mapping, SSL_CONFIG_CACHE_SIZE);
+        return false;
+    }
+
+    cache->header = mapping;
+    cache->epoch  = 0;
+    return true;
+}
+
+bool SSLConfigCacheOpen(SSLConfigCache *cache, const char *path) {
+    memset(cache, 0, sizeof(SSLConfigCache));
+    if (strlen(path) >= sizeof(cache->path))
+        return false;
+
+    strcpy(cache->path, path);
+    mapCache(cache);
+    return true;
+}
+
+void SSLConfigCacheClose(SSLConfigCache *cache) {
+    unmapCache(cache);
+}
+
+bool SSLConfigCacheChanged(const SSLConfigCache *cache) {
+    return cache->header != NULL && __atomic_load_n(&cache->header->epoch, __ATOMIC_ACQUIRE) != cache->epoch;
+}
+
+bool SSLConfigCacheRead(SSLConfigCache *cache, SSLConfig *config, int64_t *sourceModified, int64_t *sourceSize) {
+    if (cache->header == NULL && !mapCache(cache))
+        return false;
+
+    // A writer only holds epoch odd for as long as a memcpy takes
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        SSLConfigCacheHeader *header = cache->header;
+        uint32_t before = __atomic_load_n(&header->epoch, __ATOMIC_ACQUIRE);
+        if (before == SSL_CONFIG_CACHE_RETIRED) {
+            unmapCache(cache);
+            if (!mapCache(cache))
+                return false;
+            continue;
+        }
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(config, header + 1, sizeof(SSLConfig));
+        int64_t modified = header->sourceModified;
+        int64_t size     = header->sourceSize;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&header->epoch, __ATOMIC_RELAXED) == before) {
+            *sourceModified = modified;
+            *sourceSize     = size;
+            cache->epoch    = before;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Must be called with the writer lock held
+static bool writeInPlace(int fd, const SSLConfig *config, int64_t sourceModified, int64_t sourceSize, uint32_t *written) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)(2 * sizeof(uint32_t)))
+        return false;
+
+    size_t size = info.st_size < (off_t)SSL_CONFIG_CACHE_SIZE ? (size_t)info.st_size : SSL_CONFIG_CACHE_SIZE;
+    SSLConfigCacheHeader *header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED)
+        return false;
+
+    bool success = false;
+    uint32_t epoch = __atomic_load_n(&header->epoch, __ATOMIC_RELAXED);
+    if (size == SSL_CONFIG_CACHE_SIZE && info.st_size == (off_t)SSL_CONFIG_CACHE_SIZE && usableHeader(header) && epoch != SSL_CONFIG_CACHE_RETIRED) {
+        // Skip the retired marker when wrapping around
+        uint32_t next = epoch + 2 == SSL_CONFIG_CACHE_RETIRED - 1 ? 2 : epoch + 2;
+        __atomic_store_n(&header->epoch, epoch + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(header + 1, config, sizeof(SSLConfig));
+        header->sourceModified = sourceModified;
+        header->sourceSize     = sourceSize;
+        __atomic_store_n(&header->epoch, next, __ATOMIC_RELEASE);
+        *written = next;
+        success  = true;
+    } else if (header->magic == SSL_CONFIG_CACHE_MAGIC) {
+        // Left by another version, whoever maps it has to look again once it's replaced
+        __atomic_store_n(&header->epoch, SSL_CONFIG_CACHE_RETIRED, __ATOMIC_RELEASE);
+    }
+
+    munmap(header, size);
+    return success;
+}
+
+static bool writeAll(int fd, const void *bytes, size_t length) {
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t written = write(fd, cursor, length);
+        if (written < 0)
+            return false;
+        cursor += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+// Readers never see a partial file, it's only renamed into place once complete
+static bool replaceFile(const char *path, const SSLConfig *config, int64_t sourceModified, int64_t sourceSize) {
+    char temporary[sizeof(((SSLConfigCache *)NULL)->path) + 8];
+    snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path);
+
+    int fd = mkstemp(temporary);
+    if (fd < 0)
+        return false;
+
+    SSLConfigCacheHeader header = {
+        .magic          = SSL_CONFIG_CACHE_MAGIC,
+        .epoch          = 2,
+        .format         = SSL_CONFIG_CACHE_FORMAT,
+        .configSize     = sizeof(SSLConfig),
+        .sourceModified = sourceModified,
+        .sourceSize     = sourceSize,
+    };
+
+    bool success = fchmod(fd, 0644) == 0 && writeAll(fd, &header, sizeof(header)) && writeAll(fd, config, sizeof(SSLConfig));
+    close(fd);
+
+    if (success)
+        success = rename(temporary, path) == 0;
+    if (!success)
+        unlink(temporary);
+    return success;
+}
+
+/*
+
+ Every writer takes an exclusive flock on a lock file next to the cache first. Locking the cache
+ file itself can't cover creating or replacing it: two processes that both find no usable file
+ would each rename their own into place, and the one that lost would keep mapping an inode that
+ nobody ever retires.
+
+ */
+static int lockWriters(const char *path) {
+    char lockPath[sizeof(((SSLConfigCache *)NULL)->path) + 8];
+    snprintf(lockPath, sizeof(lockPath), "%s.lock", path);
+
+    int fd = open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool SSLConfigCacheWrite(SSLConfigCache *cache, const SSLConfig *config, int64_t sourceModified, int64_t sourceSize) {
+    int lock = lockWriters(cache->path);
+    if (lock < 0)
+        return false;
+
+    uint32_t written = 0;
+    bool replaced    = false;
+    int fd           = open(cache->path, O_RDWR | O_CLOEXEC);
+    bool success     = fd >= 0 && writeInPlace(fd, config, sourceModified, sourceSize, &written);
+    if (fd >= 0)
+        close(fd);
+
+    if (!success) {
+        success  = replaceFile(cache->path, config, sourceModified, sourceSize);
+        replaced = success;
+        written  = 2;
+    }
+
+    if (success) {
+        if (replaced)
+            unmapCache(cache);
+        if (cache->header == NULL)
+            mapCache(cache);
+
+        // This process already has the config it wrote, so its own write isn't a change to reload
+        if (cache->header != NULL && __atomic_load_n(&cache->header->epoch, __ATOMIC_ACQUIRE) == written)
+            cache->epoch = written;
+    }
+
+    flock(lock, LOCK_UN);
+    close(lock);
+    return success;
+}
@@ -0,0 +1,71 @@
+//
+//  SSLConfigCache.h
+//  StopStoplightLight
+//
+//  A compiled copy of the config that every process maps instead of parsing the JSON itself.
+//
+
+#ifndef SSLConfigCache_h
+#define SSLConfigCache_h
+
+#include "SSLConfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SSL_CONFIG_CACHE_MAGIC 0x434C5353 // "SSLC"
+// Bump whenever SSLConfig or the header changes
+#define SSL_CONFIG_CACHE_FORMAT 3
+// Set on a file that was replaced, mappings of it have to be made again
+#define SSL_CONFIG_CACHE_RETIRED UINT32_MAX
+
+/*
+
+ The file is this header followed by an SSLConfig, which has no pointers and is written as it is
+ in memory. A writer makes epoch odd, changes the config and makes it even again, readers copy the
+ config and retry if epoch changed meanwhile. Writers of all processes take an exclusive flock on
+ a lock file next to it (path with ".lock" appended) for the whole write. A file is only replaced as a whole if it has no usable layout, then the old one is
+ retired so processes that still map it know to look again.
+
+ magic and epoch come first in every format.
+
+ */
+typedef struct SSLConfigCacheHeader {
+    uint32_t magic;
+    uint32_t epoch;
+    uint32_t format;
+    uint32_t configSize;
+    // of the JSON the config was compiled from
+    int64_t sourceModified;
+    int64_t sourceSize;
+} SSLConfigCacheHeader;
+
+// Not thread safe, callers keep one per process and serialize access to it
+typedef struct SSLConfigCache {
+    char path[1024];
+    // read only mapping, NULL until a usable file was found
+    SSLConfigCacheHeader *header;
+    // the epoch of the config read last
+    uint32_t epoch;
+} SSLConfigCache;
+
+// Maps the file at path if there is one. Returns false if path is too long
+bool SSLConfigCacheOpen(SSLConfigCache *cache, const char *path);
+void SSLConfigCacheClose(SSLConfigCache *cache);
+
+// One load, true if the file was written since the last read
+bool SSLConfigCacheChanged(const SSLConfigCache *cache);
+
+// Copies out a consistent config along with the size and modification date (in nanoseconds) of the JSON it came from
+bool SSLConfigCacheRead(SSLConfigCache *cache, SSLConfig *config, int64_t *sourceModified, int64_t *sourceSize);
+
+// Stores config for every process, creating or replacing the file if needed. The write doesn't count as a
+// change for this cache, so SSLConfigCacheChanged stays false until another process writes
+bool SSLConfigCacheWrite(SSLConfigCache *cache, const SSLConfig *config, int64_t sourceModified, int64_t sourceSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLConfigCache_h */
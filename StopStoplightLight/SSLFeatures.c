@@ -0,0 +1,68 @@
+//
+//  SSLFeatures.c
+//  StopStoplightLight
+//
+//  Which hooks the enabled features need and what they do to a window once it is shown.
+//
+
+#include "SSLFeatures.h"
+
+const SSLFeatureModule SSLFeatureModules[] = {
+    { SSLFeatureTitlebar, NULL, "modifyTitlebarAppearance" },
+    { SSLFeatureTrafficLights, NULL, "hideTrafficLights" },
+    { SSLFeatureResizability, NULL, "makeResizableToAnySize" },
+    { SSLFeatureWindowBorders, "SSLWindowBordersGroup", "addWindowBorders" },
+};
+
+const size_t SSLFeatureModuleCount = sizeof(SSLFeatureModules) / sizeof(SSLFeatureModules[0]);
+
+uint32_t SSLFeaturesFromConfig(const SSLConfig *config) {
+    uint32_t features = 0;
+    if (config->disableTitlebar)
+        features |= SSLFeatureTitlebar;
+    if (config->disableTrafficLights)
+        features |= SSLFeatureTrafficLights;
+    if (config->disableWindowSizeConstraints)
+        features |= SSLFeatureResizability;
+    if (config->outlineWindow.enabled)
+        features |= SSLFeatureWindowBorders;
+    return features;
+}
+
+bool SSLFeaturesInstall(uint32_t features, bool (*install)(const char *group, void *context), void *context) {
+    return SSLFeaturesSwitch(0, features, install, NULL, context);
+}
+
+bool SSLFeaturesSwitch(uint32_t previous, uint32_t features, bool (*install)(const char *group, void *context),
+                       void (*uninstall)(const char *group, void *context), void *context) {
+    uint32_t removed = previous & ~features;
+    uint32_t added   = features & ~previous;
+
+    for (size_t i = 0; i < SSLFeatureModuleCount; i++) {
+        const SSLFeatureModule *module = &SSLFeatureModules[i];
+        if ((removed & module->feature) && module->group != NULL)
+            uninstall(module->group, context);
+    }
+    // The decoration group stays for as long as any feature is on
+    if (previous != 0 && features == 0)
+        uninstall(SSL_FEATURE_DECORATION_GROUP, context);
+
+    if (previous == 0 && features != 0 && !install(SSL_FEATURE_DECORATION_GROUP, context))
+        return false;
+
+    for (size_t i = 0; i < SSLFeatureModuleCount; i++) {
+        const SSLFeatureModule *module = &SSLFeatureModules[i];
+        if ((added & module->feature) && module->group != NULL && !install(module->group, context))
+            return false;
+    }
+    return true;
+}
+
+size_t SSLFeatureDecorators(uint32_t features, const char **decorators, size_t capacity) {
+    size_t count = 0;
+    for (size_t i = 0; i < SSLFeatureModuleCount && count < capacity; i++) {
+        if (features & SSLFeatureModules[i].feature)
+            decorators[count++] = SSLFeatureModules[i].decorator;
+    }
+    return count;
+}
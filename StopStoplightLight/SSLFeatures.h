@@ -0,0 +1,66 @@
+//
+//  SSLFeatures.h
+//  StopStoplightLight
+//
+//  Which hooks the enabled features need and what they do to a window once it is shown.
+//
+
+#ifndef SSLFeatures_h
+#define SSLFeatures_h
+
+#include "SSLConfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum SSLFeature {
+    SSLFeatureTitlebar      = 1 << 0,
+    SSLFeatureTrafficLights = 1 << 1,
+    SSLFeatureResizability  = 1 << 2,
+    SSLFeatureWindowBorders = 1 << 3,
+} SSLFeature;
+
+#define SSL_FEATURE_COUNT 4
+
+/*
+
+ All features decorate a window from the same makeKeyAndOrderFront: hook, which lives in
+ SSL_FEATURE_DECORATION_GROUP and is installed once any feature is on. A feature that needs to hook
+ anything else brings its own group.
+
+ */
+#define SSL_FEATURE_DECORATION_GROUP "SSLWindowDecorationGroup"
+
+typedef struct SSLFeatureModule {
+    SSLFeature feature;
+    // NULL if the feature only decorates
+    const char *group;
+    // name of the NSWindow selector doing the decorating
+    const char *decorator;
+} SSLFeatureModule;
+
+// In the order a window is decorated
+extern const SSLFeatureModule SSLFeatureModules[];
+extern const size_t SSLFeatureModuleCount;
+
+// SSLFeature bits of everything config turns on
+uint32_t SSLFeaturesFromConfig(const SSLConfig *config);
+
+// Calls install with every group features need, stops and returns false once install does
+bool SSLFeaturesInstall(uint32_t features, bool (*install)(const char *group, void *context), void *context);
+
+// Goes from the groups previous needs to those features need: calls uninstall with every group only
+// previous needs, then install with every group only features need. Stops and returns false once
+// install does, the groups uninstalled stay out
+bool SSLFeaturesSwitch(uint32_t previous, uint32_t features, bool (*install)(const char *group, void *context),
+                       void (*uninstall)(const char *group, void *context), void *context);
+
+// Stores the decorators of features in the order they run and returns how many there are
+size_t SSLFeatureDecorators(uint32_t features, const char **decorators, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLFeatures_h */
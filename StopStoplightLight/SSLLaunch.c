@@ -0,0 +1,46 @@
+//
+//  SSLLaunch.c
+//  StopStoplightLight
+//
+//  Deciding which features are on once the config arrives, and what that costs the app's launch.
+//
+
+#include "SSLLaunch.h"
+#include <time.h>
+
+uint64_t SSLLaunchNanoseconds(void) {
+    struct timespec now;
+#ifdef CLOCK_UPTIME_RAW
+    clock_gettime(CLOCK_UPTIME_RAW, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void SSLLaunchAddCost(SSLLaunch *launch, uint64_t start) {
+    launch->costNanoseconds += SSLLaunchNanoseconds() - start;
+}
+
+uint32_t SSLLaunchDecide(SSLLaunch *launch, const SSLConfig *config, const SSLLaunchSteps *steps, void *context) {
+    uint32_t previous = launch->features;
+    uint32_t features = SSLFeaturesFromConfig(config);
+    if (launch->decided && features == previous)
+        return previous;
+
+    uint64_t start = SSLLaunchNanoseconds();
+    bool launching = !launch->decided;
+
+    // Whatever was turned off is out even if turning the rest on fails
+    if (features != previous && !steps->install(previous, features, context))
+        features &= previous;
+
+    launch->features       = features;
+    launch->decoratorCount = SSLFeatureDecorators(features, launch->decorators, SSL_FEATURE_COUNT);
+    launch->decided        = true;
+    steps->start(launch, previous, context);
+
+    if (launching)
+        SSLLaunchAddCost(launch, start);
+    return features;
+}
@@ -0,0 +1,67 @@
+//
+//  SSLLaunch.h
+//  StopStoplightLight
+//
+//  Deciding which features are on once the config arrives, and what that costs the app's launch.
+//
+
+#ifndef SSLLaunch_h
+#define SSLLaunch_h
+
+#include "SSLFeatures.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+
+ The plugin is loaded before main() in every app, so +load only starts reading the config on
+ another queue. Until it's there the features are undecided, which is the same as all of them being
+ off: nothing is hooked and windows have no decorators. Deciding installs the hooks of the enabled
+ features first and only then starts them, which includes decorating the windows that were shown
+ in the meantime and so missed the hook.
+
+ A later config that turns features on or off decides again: the hooks of the features turned off
+ are taken out, those of the features turned on are put in, and only the latter are started.
+
+ */
+typedef struct SSLLaunch {
+    bool decided;
+    // SSLFeature bits of what's in place
+    uint32_t features;
+    // what makeKeyAndOrderFront: does to a window, in order
+    const char *decorators[SSL_FEATURE_COUNT];
+    size_t decoratorCount;
+    // main thread time the plugin took until its features were in place
+    uint64_t costNanoseconds;
+} SSLLaunch;
+
+typedef struct SSLLaunchSteps {
+    // takes out the hooks of the features only previous has, then installs those of the features
+    // only features has, all of them or none. Returns false for none
+    bool (*install)(uint32_t previous, uint32_t features, void *context);
+    // puts the decided features in place, stops those previous had that are gone and decorates the
+    // windows already shown with the new ones
+    void (*start)(const SSLLaunch *launch, uint32_t previous, void *context);
+} SSLLaunchSteps;
+
+// A monotonic clock for measuring the launch cost
+uint64_t SSLLaunchNanoseconds(void);
+
+// Counts the time since start, taken with SSLLaunchNanoseconds, as main thread time
+void SSLLaunchAddCost(SSLLaunch *launch, uint64_t start);
+
+// Decides the features of config, on the main thread. The time the first decision takes counts toward
+// the cost. Returns the features that are in place
+uint32_t SSLLaunchDecide(SSLLaunch *launch, const SSLConfig *config, const SSLLaunchSteps *steps, void *context);
+
+static inline uint64_t SSLLaunchCostMicroseconds(const SSLLaunch *launch) {
+    return launch->costNanoseconds / 1000;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLLaunch_h */
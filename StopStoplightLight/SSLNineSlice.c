@@ -0,0 +1,63 @@
+//
+//  SSLNineSlice.c
+//  StopStoplightLight
+//
+//  Renders a rounded border once into a small image that is stretched to fit any window.
+//
+
+#include "SSLNineSlice.h"
+#include <math.h>
+
+SSLNineSlice SSLNineSliceLayout(double radius, double width, double scale) {
+    if (scale <= 0)
+        scale = 1;
+
+    double reach = fmax(fmax(radius, 0), fmax(width, 0) / 2);
+    SSLNineSlice slice;
+    slice.inset = (uint32_t)ceil(reach * scale) + 1;
+    slice.size  = slice.inset * 2 + 1;
+    return slice;
+}
+
+static double clampUnit(double value) {
+    return value < 0 ? 0 : value > 1 ? 1 : value;
+}
+
+// Signed distance from (x, y) to the edge of a size x size square with rounded corners, negative inside
+static double roundedSquareDistance(double x, double y, double size, double radius) {
+    double half = size / 2;
+    double qx = fabs(x - half) - (half - radius);
+    double qy = fabs(y - half) - (half - radius);
+    double outside = hypot(fmax(qx, 0), fmax(qy, 0));
+    double inside  = fmin(fmax(qx, qy), 0);
+    return outside + inside - radius;
+}
+
+void SSLNineSliceRender(SSLNineSlice slice, double radius, double width, double scale, uint32_t rgba, uint8_t *pixels) {
+    if (scale <= 0)
+        scale = 1;
+
+    double size   = slice.size;
+    double r      = fmin(fmax(radius, 0) * scale, size / 2);
+    double stroke = fmax(width, 0) * scale / 2;
+
+    double red   = (rgba >> 24) & 0xFF;
+    double green = (rgba >> 16) & 0xFF;
+    double blue  = (rgba >> 8) & 0xFF;
+    double alpha = (rgba & 0xFF) / 255.0;
+
+    for (uint32_t y = 0; y < slice.size; y++) {
+        for (uint32_t x = 0; x < slice.size; x++) {
+            double distance = roundedSquareDistance(x + 0.5, y + 0.5, size, r);
+            // What's inside the outer edge minus what's inside the inner edge of the stroke
+            double coverage = clampUnit(0.5 - distance) - clampUnit(0.5 - (distance + stroke));
+            double a = coverage * alpha;
+
+            uint8_t *pixel = &pixels[(y * slice.size + x) * 4];
+            pixel[0] = (uint8_t)lround(red * a);
+            pixel[1] = (uint8_t)lround(green * a);
+            pixel[2] = (uint8_t)lround(blue * a);
+            pixel[3] = (uint8_t)lround(255 * a);
+        }
+    }
+}
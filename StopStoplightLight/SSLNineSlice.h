@@ -0,0 +1,39 @@
+//
+//  SSLNineSlice.h
+//  StopStoplightLight
+//
+//  Renders a rounded border once into a small image that is stretched to fit any window.
+//
+
+#ifndef SSLNineSlice_h
+#define SSLNineSlice_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+
+ The image is size x size pixels. The inset pixels along every side hold the corners, the single row
+ and column in the middle hold the edges and are what gets stretched, the rest is transparent.
+ Only the part of the stroke inside the window is drawn, the half outside is cut off by the mask
+ anyway.
+
+ */
+typedef struct SSLNineSlice {
+    uint32_t size;
+    uint32_t inset;
+} SSLNineSlice;
+
+SSLNineSlice SSLNineSliceLayout(double radius, double width, double scale);
+
+// Fills pixels, which must hold size * size * 4 bytes, with premultiplied RGBA rows top to bottom
+void SSLNineSliceRender(SSLNineSlice slice, double radius, double width, double scale, uint32_t rgba, uint8_t *pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLNineSlice_h */
@@ -0,0 +1,29 @@
+//
+//  SSLPalette.c
+//  StopStoplightLight
+//
+//  Interns colors so each one is turned into a platform color handle only once.
+//
+
+#include "SSLPalette.h"
+
+int SSLPaletteFind(const SSLPalette *palette, uint32_t rgba) {
+    // Entries below count are complete, see SSLPaletteAdd
+    uint32_t count = __atomic_load_n(&palette->count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        if (palette->colors[i] == rgba)
+            return (int)i;
+    }
+    return -1;
+}
+
+int SSLPaletteAdd(SSLPalette *palette, uint32_t rgba, void *handle) {
+    uint32_t count = palette->count;
+    if (count == SSL_PALETTE_CAPACITY)
+        return -1;
+
+    palette->colors[count]  = rgba;
+    palette->handles[count] = handle;
+    __atomic_store_n(&palette->count, count + 1, __ATOMIC_RELEASE);
+    return (int)count;
+}
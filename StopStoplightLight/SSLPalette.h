@@ -0,0 +1,47 @@
+//
+//  SSLPalette.h
+//  StopStoplightLight
+//
+//  Interns colors so each one is turned into a platform color handle only once.
+//
+
+#ifndef SSLPalette_h
+#define SSLPalette_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SSL_PALETTE_CAPACITY 64
+
+/*
+
+ Colors are only ever added, an index stays valid for the life of the palette. Lookups take no lock,
+ adding has to be serialized by the caller. A palette must be zero initialized (i.e. static)
+
+ */
+typedef struct SSLPalette {
+    uint32_t count;
+    // 0xRRGGBBAA
+    uint32_t colors[SSL_PALETTE_CAPACITY];
+    // whatever the platform made for each color, owned by the palette
+    void *handles[SSL_PALETTE_CAPACITY];
+} SSLPalette;
+
+// Returns the index of rgba, or -1 if it hasn't been added
+int SSLPaletteFind(const SSLPalette *palette, uint32_t rgba);
+
+// Returns the index handle was stored at, or -1 if the palette is full
+int SSLPaletteAdd(SSLPalette *palette, uint32_t rgba, void *handle);
+
+static inline void *SSLPaletteHandle(const SSLPalette *palette, int index) {
+    return palette->handles[index];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLPalette_h */
@@ -0,0 +1,86 @@
+//
+//  SSLPathCache.c
+//  StopStoplightLight
+//
+//  Rounded rectangle outlines and a small cache of the paths made from them.
+//
+
+#include "SSLPathCache.h"
+#include <math.h>
+
+static SSLPathElement pathElement(SSLPathElementType type, double x1, double y1, double x2, double y2, double radius) {
+    SSLPathElement element = { type, x1, y1, x2, y2, radius };
+    return element;
+}
+
+size_t SSLRoundedRectElements(double width, double height, double radius, SSLPathElement elements[SSL_ROUNDED_RECT_ELEMENTS]) {
+    double r = radius > 0 ? radius : 0;
+    size_t count = 0;
+    elements[count++] = pathElement(SSLPathElementMove, r, 0, 0, 0, 0);
+    elements[count++] = pathElement(SSLPathElementLine, width - r, 0, 0, 0, 0);
+    elements[count++] = pathElement(SSLPathElementArc, width, 0, width, r, r);
+    elements[count++] = pathElement(SSLPathElementLine, width, height - r, 0, 0, 0);
+    elements[count++] = pathElement(SSLPathElementArc, width, height, width - r, height, r);
+    elements[count++] = pathElement(SSLPathElementLine, r, height, 0, 0, 0);
+    elements[count++] = pathElement(SSLPathElementArc, 0, height, 0, height - r, r);
+    elements[count++] = pathElement(SSLPathElementLine, 0, r, 0, 0, 0);
+    elements[count++] = pathElement(SSLPathElementArc, 0, 0, r, 0, r);
+    elements[count++] = pathElement(SSLPathElementClose, 0, 0, 0, 0, 0);
+    return count;
+}
+
+SSLPathKey SSLPathKeyMake(double width, double height, double radius, double scale) {
+    if (scale <= 0)
+        scale = 1;
+
+    SSLPathKey key;
+    key.width  = (int32_t)lround(width * scale);
+    key.height = (int32_t)lround(height * scale);
+    key.radius = (int32_t)lround(radius * scale);
+    key.scale  = (int32_t)lround(scale * 64);
+    return key;
+}
+
+void SSLPathKeyGetSize(SSLPathKey key, double *width, double *height, double *radius) {
+    double scale = key.scale / 64.0;
+    *width  = key.width / scale;
+    *height = key.height / scale;
+    *radius = key.radius / scale;
+}
+
+static int keyEquals(SSLPathKey a, SSLPathKey b) {
+    return a.width == b.width && a.height == b.height && a.radius == b.radius && a.scale == b.scale;
+}
+
+void *SSLPathCacheLookup(SSLPathCache *cache, SSLPathKey key) {
+    for (uint32_t i = 0; i < cache->count; i++) {
+        if (keyEquals(cache->entries[i].key, key)) {
+            cache->entries[i].lastUse = ++cache->clock;
+            cache->hits++;
+            return cache->entries[i].path;
+        }
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+void SSLPathCacheInsert(SSLPathCache *cache, SSLPathKey key, void *path) {
+    SSLPathCacheEntry *entry = NULL;
+    if (cache->count < SSL_PATH_CACHE_CAPACITY) {
+        entry = &cache->entries[cache->count++];
+    } else {
+        entry = &cache->entries[0];
+        for (uint32_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].lastUse < entry->lastUse)
+                entry = &cache->entries[i];
+        }
+
+        if (cache->release != NULL)
+            cache->release(entry->path);
+    }
+
+    entry->key     = key;
+    entry->path    = path;
+    entry->lastUse = ++cache->clock;
+}
@@ -0,0 +1,81 @@
+//
+//  SSLPathCache.h
+//  StopStoplightLight
+//
+//  Rounded rectangle outlines and a small cache of the paths made from them.
+//
+
+#ifndef SSLPathCache_h
+#define SSLPathCache_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum SSLPathElementType {
+    SSLPathElementMove,
+    SSLPathElementLine,
+    // a tangent arc like CGPathAddArcToPoint, through (x1, y1) towards (x2, y2)
+    SSLPathElementArc,
+    SSLPathElementClose,
+} SSLPathElementType;
+
+typedef struct SSLPathElement {
+    SSLPathElementType type;
+    double x1, y1;
+    double x2, y2;
+    double radius;
+} SSLPathElement;
+
+#define SSL_ROUNDED_RECT_ELEMENTS 10
+
+// The outline of a width x height rectangle at the origin with rounded corners, going clockwise from
+// the top left. Returns how many elements were written
+size_t SSLRoundedRectElements(double width, double height, double radius, SSLPathElement elements[SSL_ROUNDED_RECT_ELEMENTS]);
+
+// Sizes in device pixels, scale in 1/64ths so 1x, 1.5x, 2x and 3x displays all map exactly
+typedef struct SSLPathKey {
+    int32_t width;
+    int32_t height;
+    int32_t radius;
+    int32_t scale;
+} SSLPathKey;
+
+SSLPathKey SSLPathKeyMake(double width, double height, double radius, double scale);
+
+// The size in points the key stands for
+void SSLPathKeyGetSize(SSLPathKey key, double *width, double *height, double *radius);
+
+#define SSL_PATH_CACHE_CAPACITY 32
+
+typedef struct SSLPathCacheEntry {
+    SSLPathKey key;
+    void *path;
+    uint64_t lastUse;
+} SSLPathCacheEntry;
+
+// Least recently used paths are evicted once the cache is full. Not thread safe
+typedef struct SSLPathCache {
+    // called for every path the cache lets go of
+    void (*release)(void *path);
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t count;
+    SSLPathCacheEntry entries[SSL_PATH_CACHE_CAPACITY];
+} SSLPathCache;
+
+// Returns the path stored for key, the cache keeps owning it
+void *SSLPathCacheLookup(SSLPathCache *cache, SSLPathKey key);
+
+// The cache takes over path
+void SSLPathCacheInsert(SSLPathCache *cache, SSLPathKey key, void *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLPathCache_h */
@@ -0,0 +1,87 @@
+//
+//  SSLUpdateQueue.c
+//  StopStoplightLight
+//
+//  Collects what has to be redone for each window and does it all at once later.
+//
+
+#include "SSLUpdateQueue.h"
+#include <stdlib.h>
+
+bool SSLUpdateQueueMark(SSLUpdateQueue *queue, SSLUpdate *update, uint32_t reasons) {
+    if (reasons == 0)
+        return true;
+
+    // Still queued, the pending flush picks the new reasons up too
+    if (update->reasons != 0) {
+        update->reasons |= reasons;
+        return true;
+    }
+
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity == 0 ? 16 : queue->capacity * 2;
+        SSLUpdate **pending = realloc(queue->pending, capacity * sizeof(SSLUpdate *));
+        if (pending == NULL)
+            return false;
+
+        queue->pending  = pending;
+        queue->capacity = capacity;
+    }
+
+    update->reasons = reasons;
+    queue->pending[queue->count++] = update;
+    return true;
+}
+
+// The last pass takes everything left, apply may have changed whether an update is urgent since the first
+static void applyAll(SSLUpdateQueue *queue, bool urgentOnly, SSLUpdateApply apply, void *context) {
+    for (size_t i = 0; i < queue->flushingCount; i++) {
+        SSLUpdate *update = queue->flushing[i];
+        // Removed while flushing, or not its turn yet
+        if (update == NULL || (urgentOnly && !update->urgent))
+            continue;
+
+        uint32_t reasons = update->reasons;
+        update->reasons = 0;
+        queue->flushing[i] = NULL;
+        apply(update, reasons, context);
+    }
+}
+
+void SSLUpdateQueueFlush(SSLUpdateQueue *queue, SSLUpdateApply apply, void *context) {
+    // A flush from inside apply has nothing of its own to do
+    if (queue->count == 0 || queue->flushingCount != 0)
+        return;
+
+    SSLUpdate **flushing     = queue->flushing;
+    size_t flushingCapacity  = queue->flushingCapacity;
+    queue->flushing          = queue->pending;
+    queue->flushingCount     = queue->count;
+    queue->flushingCapacity  = queue->capacity;
+    queue->pending           = flushing;
+    queue->capacity          = flushingCapacity;
+    queue->count             = 0;
+
+    applyAll(queue, true, apply, context);
+    applyAll(queue, false, apply, context);
+    queue->flushingCount = 0;
+}
+
+void SSLUpdateQueueRemove(SSLUpdateQueue *queue, SSLUpdate *update) {
+    if (update->reasons == 0)
+        return;
+
+    update->reasons = 0;
+    for (size_t i = 0; i < queue->count; i++) {
+        if (queue->pending[i] == update) {
+            queue->pending[i] = queue->pending[--queue->count];
+            return;
+        }
+    }
+    for (size_t i = 0; i < queue->flushingCount; i++) {
+        if (queue->flushing[i] == update) {
+            queue->flushing[i] = NULL;
+            return;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+//
+//  SSLUpdateQueue.h
+//  StopStoplightLight
+//
+//  Collects what has to be redone for each window and does it all at once later.
+//
+
+#ifndef SSLUpdateQueue_h
+#define SSLUpdateQueue_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Why an update is needed, updates marked more than once before a flush run once with all reasons
+typedef enum SSLUpdateReason {
+    SSLUpdateGeometry = 1 << 0,
+    SSLUpdateColor    = 1 << 1,
+    SSLUpdateTitlebar = 1 << 2,
+} SSLUpdateReason;
+
+// Lives with whatever it updates, zero initialized
+typedef struct SSLUpdate {
+    void *target;
+    uint32_t reasons;
+    // flushed before the others, e.g. for the key window
+    bool urgent;
+} SSLUpdate;
+
+typedef struct SSLUpdateQueue {
+    SSLUpdate **pending;
+    size_t count;
+    size_t capacity;
+    // what the running flush goes through, pending takes the updates marked meanwhile
+    SSLUpdate **flushing;
+    size_t flushingCount;
+    size_t flushingCapacity;
+} SSLUpdateQueue;
+
+typedef void (*SSLUpdateApply)(SSLUpdate *update, uint32_t reasons, void *context);
+
+// Adds reasons to update and queues it if it wasn't already. Returns false if there was no memory
+bool SSLUpdateQueueMark(SSLUpdateQueue *queue, SSLUpdate *update, uint32_t reasons);
+
+// Calls apply once for every queued update, urgent ones first, each with its reasons cleared beforehand.
+// Updates marked from apply wait for the next flush
+void SSLUpdateQueueFlush(SSLUpdateQueue *queue, SSLUpdateApply apply, void *context);
+
+// Must be called before a queued update goes away
+void SSLUpdateQueueRemove(SSLUpdateQueue *queue, SSLUpdate *update);
+
+static inline bool SSLUpdateQueueIsEmpty(const SSLUpdateQueue *queue) {
+    return queue->count == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLUpdateQueue_h */
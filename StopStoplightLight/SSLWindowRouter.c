@@ -0,0 +1,150 @@
+//
+//  SSLWindowRouter.c
+//  StopStoplightLight
+//
+//  Finds the border of the window a notification is about and marks what it needs.
+//
+
+#include "SSLWindowRouter.h"
+#include <stdlib.h>
+
+// Marks a slot whose route was removed, lookups go on past it
+static SSLWindowRoute removedRoute;
+#define REMOVED (&removedRoute)
+
+static size_t slotIndex(const void *window, size_t capacity) {
+    uint64_t hash = ((uint64_t)(uintptr_t)window >> 4) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(hash >> 32) & (capacity - 1);
+}
+
+// The slot holding window, or the empty one it would go in
+static SSLWindowRoute **findSlot(SSLWindowRoute **slots, size_t capacity, const void *window) {
+    SSLWindowRoute **reusable = NULL;
+    for (size_t i = slotIndex(window, capacity);; i = (i + 1) & (capacity - 1)) {
+        SSLWindowRoute *route = slots[i];
+        if (route == NULL)
+            return reusable ? reusable : &slots[i];
+        if (route == REMOVED) {
+            if (!reusable)
+                reusable = &slots[i];
+        } else if (route->window == window) {
+            return &slots[i];
+        }
+    }
+}
+
+// Grows once three quarters are used, dropping the removed slots on the way
+static bool reserveSlot(SSLWindowRouter *router) {
+    if ((router->used + 1) * 4 <= router->capacity * 3)
+        return true;
+
+    size_t capacity = router->capacity == 0 ? 16 : router->count * 2 >= router->capacity ? router->capacity * 2 : router->capacity;
+    SSLWindowRoute **slots = calloc(capacity, sizeof(SSLWindowRoute *));
+    if (slots == NULL)
+        return false;
+
+    for (size_t i = 0; i < router->capacity; i++) {
+        SSLWindowRoute *route = router->slots[i];
+        if (route != NULL && route != REMOVED)
+            *findSlot(slots, capacity, route->window) = route;
+    }
+
+    free(router->slots);
+    router->slots    = slots;
+    router->capacity = capacity;
+    router->used     = router->count;
+    return true;
+}
+
+SSLWindowRoute *SSLWindowRouterAdd(SSLWindowRouter *router, const void *window) {
+    SSLWindowRoute *route = SSLWindowRouterFind(router, window);
+    if (route != NULL)
+        return route;
+
+    if (!reserveSlot(router))
+        return NULL;
+
+    route = calloc(1, sizeof(SSLWindowRoute));
+    if (route == NULL)
+        return NULL;
+    route->window        = window;
+    route->update.target = (void *)window;
+
+    SSLWindowRoute **slot = findSlot(router->slots, router->capacity, window);
+    if (*slot == NULL)
+        router->used++;
+    *slot = route;
+    router->count++;
+    return route;
+}
+
+SSLWindowRoute *SSLWindowRouterFind(const SSLWindowRouter *router, const void *window) {
+    if (router->count == 0 || window == NULL)
+        return NULL;
+
+    SSLWindowRoute *route = *findSlot(router->slots, router->capacity, window);
+    return route != REMOVED ? route : NULL;
+}
+
+void SSLWindowRouterRemove(SSLWindowRouter *router, const void *window) {
+    if (router->count == 0 || window == NULL)
+        return;
+
+    SSLWindowRoute **slot = findSlot(router->slots, router->capacity, window);
+    SSLWindowRoute *route = *slot;
+    if (route == NULL || route == REMOVED)
+        return;
+
+    if (router->queue != NULL)
+        SSLUpdateQueueRemove(router->queue, &route->update);
+    *slot = REMOVED;
+    router->count--;
+    free(route);
+}
+
+SSLWindowRoute *SSLWindowRouterNext(const SSLWindowRouter *router, size_t *cursor) {
+    while (*cursor < router->capacity) {
+        SSLWindowRoute *route = router->slots[(*cursor)++];
+        if (route != NULL && route != REMOVED)
+            return route;
+    }
+    return NULL;
+}
+
+uint32_t SSLWindowRouteHandle(SSLWindowRoute *route, SSLWindowEvent event) {
+    switch (event) {
+        case SSLWindowEventResignKey:
+        case SSLWindowEventBecomeKey:
+            return SSLUpdateColor;
+        case SSLWindowEventWillStartLiveResize:
+            route->liveResizing = true;
+            return SSLUpdateGeometry;
+        // Keeps the border up during a live resize
+        case SSLWindowEventResize:
+            return SSLUpdateGeometry;
+        case SSLWindowEventEndLiveResize:
+            route->liveResizing = false;
+            return SSLUpdateGeometry | SSLUpdateColor | SSLUpdateTitlebar;
+        case SSLWindowEventSetFrame:
+            return route->liveResizing ? 0 : SSLUpdateGeometry | SSLUpdateColor | SSLUpdateTitlebar;
+        case SSLWindowEventRedraw:
+            return SSLUpdateGeometry | SSLUpdateColor;
+    }
+    return 0;
+}
+
+bool SSLWindowRouterDispatch(SSLWindowRouter *router, const void *window, SSLWindowEvent event, bool key, uint32_t *unqueued) {
+    *unqueued = 0;
+    SSLWindowRoute *route = SSLWindowRouterFind(router, window);
+    if (route == NULL)
+        return false;
+
+    uint32_t reasons = SSLWindowRouteHandle(route, event);
+    if (reasons == 0)
+        return true;
+
+    route->update.urgent = key;
+    if (!SSLUpdateQueueMark(router->queue, &route->update, reasons))
+        *unqueued = reasons;
+    return true;
+}
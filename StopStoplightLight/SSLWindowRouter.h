@@ -0,0 +1,70 @@
+//
+//  SSLWindowRouter.h
+//  StopStoplightLight
+//
+//  Finds the border of the window a notification is about and marks what it needs.
+//
+
+#ifndef SSLWindowRouter_h
+#define SSLWindowRouter_h
+
+#include "SSLUpdateQueue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum SSLWindowEvent {
+    SSLWindowEventResignKey,
+    SSLWindowEventBecomeKey,
+    SSLWindowEventWillStartLiveResize,
+    SSLWindowEventResize,
+    SSLWindowEventEndLiveResize,
+    // setFrame:display:, during a live resize the rest waits for its end
+    SSLWindowEventSetFrame,
+    // everything about the border may have changed
+    SSLWindowEventRedraw,
+} SSLWindowEvent;
+
+// One per window with borders, stays at the same address for as long as the window has it
+typedef struct SSLWindowRoute {
+    const void *window;
+    // the target is the window
+    SSLUpdate update;
+    bool liveResizing;
+} SSLWindowRoute;
+
+// Windows by address, found in constant time however often they were decorated. Not thread safe
+typedef struct SSLWindowRouter {
+    // where the updates of dispatched events go
+    SSLUpdateQueue *queue;
+    SSLWindowRoute **slots;
+    size_t capacity;
+    size_t count;
+    // routes and removed slots, which lookups still have to step over
+    size_t used;
+} SSLWindowRouter;
+
+// Returns the route of window, added the first time. NULL if there was no memory
+SSLWindowRoute *SSLWindowRouterAdd(SSLWindowRouter *router, const void *window);
+
+SSLWindowRoute *SSLWindowRouterFind(const SSLWindowRouter *router, const void *window);
+
+// Must be called before the window goes away, takes its update off the queue as well
+void SSLWindowRouterRemove(SSLWindowRouter *router, const void *window);
+
+// Steps through all routes, start with *cursor at 0. Returns NULL after the last one
+SSLWindowRoute *SSLWindowRouterNext(const SSLWindowRouter *router, size_t *cursor);
+
+// The SSLUpdateReason bits of what the border needs after event, keeps track of live resizes
+uint32_t SSLWindowRouteHandle(SSLWindowRoute *route, SSLWindowEvent event);
+
+// Queues what window's border needs after event, key windows first. Returns false if it has no
+// route. Reasons that couldn't be queued for lack of memory are stored in unqueued, else 0
+bool SSLWindowRouterDispatch(SSLWindowRouter *router, const void *window, SSLWindowEvent event, bool key, uint32_t *unqueued);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSLWindowRouter_h */
@@ -11,8 +11,24 @@
 @import AppKit;
 @import QuartzCore;
 #import "NSWindow+StopStoplightLight.h"
+#import "SSLBorderOps.h"
+#import "SSLClip.h"
+#import "SSLConfig.h"
+#import "SSLConfigCache.h"
+#import "SSLFeatures.h"
+#import "SSLLaunch.h"
+#import "SSLNineSlice.h"
+#import "SSLPalette.h"
+#import "SSLPathCache.h"
+#import "SSLUpdateQueue.h"
+#import "SSLWindowRouter.h"
 #import "ZKSwizzle.h"
+#import <objc/message.h>
 #import <objc/runtime.h>
+#import <fcntl.h>
+#import <os/lock.h>
+#import <sys/stat.h>
+#import <unistd.h>
 
 #include <os/log.h>
 #define DLog(N, ...)                                                           \
@@ -26,19 +42,141 @@ static NSString *const preferencesSuiteName =
     @"com.shishkabibal.StopStoplightLight";
 
 // Feature flags
-static BOOL enableTrafficLightsDisabler;
-static BOOL enableTitlebarDisabler;
-static BOOL enableResizability;
 static BOOL enableWindowBorders;
 
+// What makeKeyAndOrderFront: does to a window for the enabled features, in order. One per SSLFeature
+static SEL windowDecorators[SSL_FEATURE_COUNT];
+static size_t windowDecoratorCount;
+
+// Undecided until the config has been read, main thread only
+static SSLLaunch pluginLaunch;
+
+// Rounded paths by size in device pixels, shared by all windows and layers. Main thread only
+static void releaseRoundedPath(void *path) {
+    CGPathRelease(path);
+}
+static SSLPathCache roundedPathCache = { .release = releaseRoundedPath };
+
+// Windows whose borders have to be redone at the end of the run loop turn. Main thread only
+static SSLUpdateQueue borderUpdates;
+
+// Every window with borders, the notifications about it are handed on from here. Main thread only
+static SSLWindowRouter windowRouter = { .queue = &borderUpdates };
+
+// Nine-slice border images by radius, width, color and scale, the oldest goes once all are taken.
+// There are two per config and display, active and inactive. Main thread only
+typedef struct NineSliceImage {
+    double radius;
+    double width;
+    double scale;
+    uint32_t rgba;
+    CGImageRef image;
+} NineSliceImage;
+
+#define NINE_SLICE_IMAGE_CAPACITY 8
+static NineSliceImage nineSliceImages[NINE_SLICE_IMAGE_CAPACITY];
+static size_t nineSliceImageCount;
+static size_t nineSliceImageOldest;
+
+// The parsed config. Replaced as a whole when the file changes, readers only take
+// the lock long enough to copy it
+static SSLConfig configSnapshot;
+static BOOL configLoaded;
+static NSUInteger configVersion;
+static os_unfair_lock configLock = OS_UNFAIR_LOCK_INIT;
+
+// The config compiled by whichever process saw the JSON change first, shared by all of them
+static SSLConfigCache configCache;
+static BOOL configCacheOpened;
+static os_unfair_lock configCacheLock = OS_UNFAIR_LOCK_INIT;
+static BOOL cachedConfigReloadQueued;
+
+// Touched on the config queue only
+static dispatch_source_t configWatcher;
+static NSUInteger pendingConfigReloads;
+static BOOL configWatcherNeedsRearm;
+
+// Editors tend to write a file several times per save, wait for them to finish
+static const int64_t configReloadDelay = 200 * NSEC_PER_MSEC;
+
+// Every config color gets one CGColor for the life of the process, handed out by index
+static SSLPalette colorPalette;
+static os_unfair_lock colorPaletteLock = OS_UNFAIR_LOCK_INIT;
+
 #pragma mark - Main Implementation
 
+// Added to NSWindow by the window borders hooks
+@interface NSWindow (SSLWindowBorders)
+- (void)addWindowBorders;
+- (void)updateMaskAndOutlineForWindow:(NSWindow *)window;
+- (void)updateBorderColorForWindow:(NSWindow *)window;
+@end
+
+// Window border helpers, plain functions so NSWindow doesn't get any more methods than the above
+static void removeWindowBorders(NSWindow *window);
+static void applyBorderChanges(NSWindow *window, uint32_t changes, const SSLConfig *config);
+static CGColorRef paletteColor(uint32_t rgba);
+
+// Associated with a window that has a route, takes the route out when the window goes away
+@interface SSLWindowRouteOwner : NSObject
+- (instancetype)initWithWindow:(NSWindow *)window;
+@end
+
+@interface BordersController ()
+
+- (void)registerWindow:(NSWindow *)window;
+
+// Redoes what the event calls for (see SSLWindowRouteHandle) once the run loop turn is over.
+// Returns NO if the window has no borders
+- (BOOL)dispatchEvent:(SSLWindowEvent)event forWindow:(NSWindow *)window;
+
+@end
+
 @interface StopStoplightLight ()
 
-+ (NSDictionary *)loadConfig;
+- (void)startFeatures:(const SSLLaunch *)launch previous:(uint32_t)previous;
++ (SSLConfig)loadConfig;
++ (NSUInteger)configVersion;
++ (dispatch_queue_t)configQueue;
 
 @end
 
+static bool installFeatureGroup(const char *group, void *context) {
+    return _ZKSwizzleGroup(group);
+}
+
+static void uninstallFeatureGroup(const char *group, void *context) {
+    if (!_ZKUnswizzleGroup(group)) {
+        DLog("Failed to take out all hooks of %{public}s", group);
+    }
+}
+
+// Take out the hooks of the features turned off, then install those of the features turned on
+// together or none of them
+static bool installFeatures(uint32_t previous, uint32_t features, void *context) {
+    ZKSwizzleBegin();
+    SSLFeaturesSwitch(previous, features, installFeatureGroup, uninstallFeatureGroup, NULL);
+    if (!ZKSwizzleCommit()) {
+        DLog("Failed to install the hooks of the enabled features");
+        return false;
+    }
+    return true;
+}
+
+static void startFeatures(const SSLLaunch *launch, uint32_t previous, void *context) {
+    [(__bridge StopStoplightLight *)context startFeatures:launch previous:previous];
+}
+
+static void decorateWindowWith(NSWindow *window, const SEL *decorators, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        ((void (*)(id, SEL))objc_msgSend)(window, decorators[i]);
+    }
+}
+
+static void decorateWindow(NSWindow *window) {
+    decorateWindowWith(window, windowDecorators, windowDecoratorCount);
+}
+
 @implementation StopStoplightLight
 
 + (instancetype)sharedInstance {
@@ -52,275 +190,885 @@ static BOOL enableWindowBorders;
 }
 
 + (void)load {
+  uint64_t start = SSLLaunchNanoseconds();
   [self sharedInstance];
+  SSLLaunchAddCost(&pluginLaunch, start);
+}
+
++ (uint64_t)launchCostMicroseconds {
+  return SSLLaunchCostMicroseconds(&pluginLaunch);
 }
 
+// The config is read off the main thread. Until it's there nothing is hooked, which is
+// the same as every feature being off
 - (void)initializeFeatureFlags {
-    NSDictionary *config = [[self class] loadConfig];
-    enableTrafficLightsDisabler = [config[@"disableTrafficLights"] boolValue];
-    enableTitlebarDisabler = [config[@"disableTitlebar"] boolValue];
-    enableResizability = [config[@"disableWindowSizeConstraints"] boolValue];
-    enableWindowBorders = [config[@"outlineWindow"][@"enabled"] boolValue];
-}
-
-+ (NSDictionary *)loadConfig {
-    NSString *configPath = [NSString stringWithFormat:@"%@/.config/macwmfx/config", NSHomeDirectory()];
-    NSData *configData = [NSData dataWithContentsOfFile:configPath];
-    if (configData) {
-        NSError *error;
-        NSDictionary *config = [NSJSONSerialization JSONObjectWithData:configData options:0 error:&error];
-        if (error) {
-            DLog("Error parsing config file: %@", error);
-            return @{};
+    dispatch_async([[self class] configQueue], ^{
+        SSLConfig config = [[self class] loadConfig];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self applyFeatureFlags:config];
+        });
+    });
+}
+
+// Decides again whenever the config turns features on or off
+- (void)applyFeatureFlags:(SSLConfig)config {
+    static const SSLLaunchSteps steps = { installFeatures, startFeatures };
+    BOOL launching = !pluginLaunch.decided;
+    SSLLaunchDecide(&pluginLaunch, &config, &steps, (__bridge void *)self);
+    if (launching) {
+        DLog("StopStoplightLight added %llu us to launch", (unsigned long long)[[self class] launchCostMicroseconds]);
+    }
+}
+
+- (void)startFeatures:(const SSLLaunch *)launch previous:(uint32_t)previous {
+    static BOOL watchingConfig;
+    uint32_t added = launch->features & ~previous;
+    uint32_t removed = previous & ~launch->features;
+
+    enableWindowBorders = (launch->features & SSLFeatureWindowBorders) != 0;
+
+    for (size_t i = 0; i < launch->decoratorCount; i++) {
+        windowDecorators[i] = sel_getUid(launch->decorators[i]);
+    }
+    windowDecoratorCount = launch->decoratorCount;
+
+    if ((added & SSLFeatureWindowBorders) && !_bordersController) {
+        _bordersController = [[BordersController alloc] init];
+    }
+    if (removed & SSLFeatureWindowBorders) {
+        size_t cursor = 0;
+        for (SSLWindowRoute *route; (route = SSLWindowRouterNext(&windowRouter, &cursor));) {
+            [_bordersController removeBorderFromWindow:(__bridge NSWindow *)route->window];
         }
-        return config;
     }
-    return @{};
+
+    // Features can be turned on and off for as long as the app runs
+    if (!watchingConfig) {
+        watchingConfig = YES;
+        [[self class] watchConfig];
+    }
+
+    // Windows shown before a feature was turned on missed its part of the makeKeyAndOrderFront: hook.
+    // The other features turned off leave the windows they decorated as they are
+    const char *names[SSL_FEATURE_COUNT];
+    SEL decorators[SSL_FEATURE_COUNT];
+    size_t count = SSLFeatureDecorators(added, names, SSL_FEATURE_COUNT);
+    for (size_t i = 0; i < count; i++) {
+        decorators[i] = sel_getUid(names[i]);
+    }
+    if (count == 0) {
+        return;
+    }
+    for (NSWindow *window in [NSApp windows]) {
+        if (window.isVisible) {
+            decorateWindowWith(window, decorators, count);
+        }
+    }
+}
+
+#pragma mark - Config
+
++ (NSString *)configPath {
+    return [NSString stringWithFormat:@"%@/.config/macwmfx/config", NSHomeDirectory()];
+}
+
++ (NSString *)configCachePath {
+    return [[self configPath] stringByAppendingString:@".sslcache"];
+}
+
++ (dispatch_queue_t)configQueue {
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.shishkabibal.StopStoplightLight.config", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+// Returns the current snapshot. The disk is only touched the first time, which happens on the
+// config queue. A config another process compiled meanwhile is read there too, callers keep
+// getting the current one until it's swapped in
++ (SSLConfig)loadConfig {
+    os_unfair_lock_lock(&configLock);
+    SSLConfig config = configSnapshot;
+    BOOL loaded = configLoaded;
+    os_unfair_lock_unlock(&configLock);
+
+    if (!loaded) {
+        [self reloadConfig];
+        os_unfair_lock_lock(&configLock);
+        config = configSnapshot;
+        os_unfair_lock_unlock(&configLock);
+    } else if ([self configCacheChanged]) {
+        [self scheduleCachedConfigReload];
+    }
+    return config;
+}
+
+// Several readers may notice the same change before the reload gets to run
++ (void)scheduleCachedConfigReload {
+    if (__atomic_exchange_n(&cachedConfigReloadQueued, YES, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    dispatch_async([self configQueue], ^{
+        __atomic_store_n(&cachedConfigReloadQueued, NO, __ATOMIC_RELEASE);
+        [self reloadConfig];
+    });
+}
+
+// Bumped every time a changed config is swapped in
++ (NSUInteger)configVersion {
+    os_unfair_lock_lock(&configLock);
+    NSUInteger version = configVersion;
+    os_unfair_lock_unlock(&configLock);
+    return version;
+}
+
++ (BOOL)configCacheChanged {
+    os_unfair_lock_lock(&configCacheLock);
+    BOOL changed = SSLConfigCacheChanged(&configCache);
+    os_unfair_lock_unlock(&configCacheLock);
+    return changed;
+}
+
+// Returns NO if the file can't be parsed, the defaults if there is none
++ (BOOL)readConfig:(SSLConfig *)config {
+    SSLConfigInitDefaults(config);
+
+    struct stat source;
+    if (stat([self configPath].fileSystemRepresentation, &source) != 0) {
+        return YES;
+    }
+    int64_t modified = (int64_t)source.st_mtimespec.tv_sec * NSEC_PER_SEC + source.st_mtimespec.tv_nsec;
+    int64_t size = source.st_size;
+
+    // Another process may have compiled this version of the file already
+    os_unfair_lock_lock(&configCacheLock);
+    if (!configCacheOpened) {
+        configCacheOpened = SSLConfigCacheOpen(&configCache, [self configCachePath].fileSystemRepresentation);
+    }
+    SSLConfig cached;
+    int64_t cachedModified, cachedSize;
+    BOOL cacheHit = configCacheOpened && SSLConfigCacheRead(&configCache, &cached, &cachedModified, &cachedSize) &&
+                    cachedModified == modified && cachedSize == size;
+    os_unfair_lock_unlock(&configCacheLock);
+
+    if (cacheHit) {
+        *config = cached;
+        return YES;
+    }
+
+    NSData *configData = [NSData dataWithContentsOfFile:[self configPath]];
+    if (!configData) {
+        return YES;
+    }
+
+    if (!SSLConfigParse(configData.bytes, configData.length, config)) {
+        DLog("Error parsing config file");
+        return NO;
+    }
+
+    os_unfair_lock_lock(&configCacheLock);
+    if (configCacheOpened && !SSLConfigCacheWrite(&configCache, config, modified, size)) {
+        DLog("Failed to write the compiled config");
+    }
+    os_unfair_lock_unlock(&configCacheLock);
+    return YES;
+}
+
++ (void)reloadConfig {
+    SSLConfig config;
+    BOOL parsed = [self readConfig:&config];
+
+    os_unfair_lock_lock(&configLock);
+    BOOL hadConfig = configLoaded;
+    uint32_t changes = SSLConfigChangeNone;
+    BOOL changed = NO;
+    // Keep the last config that parsed, unknown members and all, but only what is applied counts as a change
+    if (parsed || !configLoaded) {
+        changes = SSLConfigDiff(&configSnapshot, &config);
+        changed = !configLoaded || changes != SSLConfigChangeNone;
+        configSnapshot = config;
+        if (changed)
+            configVersion++;
+        configLoaded = YES;
+    }
+    os_unfair_lock_unlock(&configLock);
+
+    if (changed && hadConfig) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self applyConfigChanges:changes config:config];
+        });
+    }
+}
+
+// Only what changed is touched, all windows in one transaction
++ (void)applyConfigChanges:(uint32_t)changes config:(SSLConfig)config {
+    if (changes & SSLConfigChangeFeatures) {
+        // Windows that just got their borders were made with this config already
+        BOOL hadBorders = enableWindowBorders;
+        [[self sharedInstance] applyFeatureFlags:config];
+        if (!hadBorders) {
+            return;
+        }
+    }
+    if (!(changes & SSLConfigChangeBorders) || !enableWindowBorders) {
+        return;
+    }
+
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    size_t cursor = 0;
+    for (SSLWindowRoute *route; (route = SSLWindowRouterNext(&windowRouter, &cursor));) {
+        applyBorderChanges((__bridge NSWindow *)route->window, changes, &config);
+    }
+    [CATransaction commit];
+}
+
++ (void)watchConfig {
+    dispatch_async([self configQueue], ^{
+        [self armConfigWatcher];
+    });
+}
+
+// Runs on the config queue. Watches the file, or its directory until the file shows up
++ (void)armConfigWatcher {
+    if (configWatcher) {
+        dispatch_source_cancel(configWatcher);
+        configWatcher = nil;
+    }
+
+    NSString *path = [self configPath];
+    int fd = open(path.fileSystemRepresentation, O_EVTONLY);
+    BOOL watchingFile = fd >= 0;
+    if (!watchingFile) {
+        fd = open(path.stringByDeletingLastPathComponent.fileSystemRepresentation, O_EVTONLY);
+    }
+    if (fd < 0) {
+        DLog("Not watching the config, %s doesn't exist", path.stringByDeletingLastPathComponent.fileSystemRepresentation);
+        return;
+    }
+
+    unsigned long mask = DISPATCH_VNODE_WRITE | DISPATCH_VNODE_EXTEND | DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME;
+    configWatcher = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, fd, mask, [self configQueue]);
+    dispatch_source_set_event_handler(configWatcher, ^{
+        // Saving by replacing the file leaves us watching the old one
+        unsigned long events = dispatch_source_get_data(configWatcher);
+        BOOL replaced = !watchingFile || (events & (DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME));
+        [self scheduleConfigReloadRearming:replaced];
+    });
+    dispatch_source_set_cancel_handler(configWatcher, ^{
+        close(fd);
+    });
+    dispatch_resume(configWatcher);
+}
+
+// Runs on the config queue, only the last event of a burst reloads
++ (void)scheduleConfigReloadRearming:(BOOL)rearm {
+    NSUInteger reload = ++pendingConfigReloads;
+    configWatcherNeedsRearm |= rearm;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, configReloadDelay), [self configQueue], ^{
+        if (reload != pendingConfigReloads) {
+            return;
+        }
+        if (configWatcherNeedsRearm) {
+            configWatcherNeedsRearm = NO;
+            [self armConfigWatcher];
+        }
+        [self reloadConfig];
+    });
 }
 
 @end
 
 #pragma mark - NSWindow Swizzling
 
-ZKSwizzleInterface(BS_NSWindow, NSWindow, NSWindow)
+/*
 
-@implementation BS_NSWindow
+ One makeKeyAndOrderFront: hook for all features, whatever is enabled runs in a single pass in the
+ order titlebar, traffic lights, resizability, borders. A hook per feature would put a ZKOrig call
+ and a message send on every window shown for each of them.
 
-#pragma mark - Overridden Methods
+ */
+ZKSwizzleInterfaceGroup(SSL_DecoratedWindow, NSWindow, NSWindow, SSLWindowDecorationGroup)
 
-- (nullable NSButton *)standardWindowButton:(NSWindowButton)b {
-  return ZKOrig(NSButton *, b);
-}
+@implementation SSL_DecoratedWindow
 
 - (void)makeKeyAndOrderFront:(id)sender {
   ZKOrig(void, sender);
+  decorateWindow((NSWindow *)self);
+}
 
-  if (enableTitlebarDisabler) {
-    [self modifyTitlebarAppearance];
-  }
+@end
 
-  if (enableTrafficLightsDisabler) {
-    [self hideTrafficLights];
-  }
+#pragma mark - Borders Controller
 
-  if (enableResizability) {
-    [self makeResizableToAnySize];
-  }
+static const void *windowRouteOwnerKey = &windowRouteOwnerKey;
 
-  if (enableWindowBorders) {
-    [self addWindowBorders];
-  }
+@implementation SSLWindowRouteOwner {
+    // Not retained, it's only used as the key after the window is gone
+    const void *_window;
 }
 
-- (void)orderOut:(id)sender {
-  ZKOrig(void, sender);
+- (instancetype)initWithWindow:(NSWindow *)window {
+    self = [super init];
+    if (self) {
+        _window = (__bridge const void *)window;
+    }
+    return self;
 }
 
-- (void)becomeKeyWindow {
-  ZKOrig(void);
+- (void)dealloc {
+    SSLWindowRouterRemove(&windowRouter, _window);
 }
 
-- (void)resignKeyWindow {
-  ZKOrig(void);
+@end
+
+// The route is gone before the window is, so the target is always alive
+static void applyBorderUpdate(SSLUpdate *update, uint32_t reasons, void *context) {
+    NSWindow *window = (__bridge NSWindow *)update->target;
+
+    if (reasons & SSLUpdateGeometry) {
+        [window updateMaskAndOutlineForWindow:window];
+    }
+    if (reasons & SSLUpdateColor) {
+        [window updateBorderColorForWindow:window];
+    }
+    if (reasons & SSLUpdateTitlebar) {
+        [window modifyTitlebarAppearance];
+    }
 }
 
-- (void)setFrame:(NSRect)frameRect display:(BOOL)flag {
-  ZKOrig(void, frameRect, flag);
-  if (!enableWindowBorders) {
-    return;
-  }
+/*
+
+ The only observer of the window notifications the borders follow. It observes every window of the
+ app once and looks the window a notification is about up in windowRouter, which has one route per
+ window with borders however often it was shown or decorated. A route goes away with its window.
+
+ Frame and key changes only mark what a window's border needs, the work is done once right before
+ the run loop goes to sleep, which is also right before Core Animation commits. All windows are
+ updated in one transaction, the key window first.
+
+ */
+@implementation BordersController
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+        [center addObserver:self selector:@selector(windowDidResignKey:) name:NSWindowDidResignKeyNotification object:nil];
+        [center addObserver:self selector:@selector(windowDidBecomeKey:) name:NSWindowDidBecomeKeyNotification object:nil];
+        [center addObserver:self selector:@selector(windowDidResize:) name:NSWindowDidResizeNotification object:nil];
+        [center addObserver:self selector:@selector(windowWillStartLiveResize:) name:NSWindowWillStartLiveResizeNotification object:nil];
+        [center addObserver:self selector:@selector(windowDidEndLiveResize:) name:NSWindowDidEndLiveResizeNotification object:nil];
+
+        // The common modes include the one live resizing runs the run loop in
+        __weak BordersController *weakSelf = self;
+        CFRunLoopObserverRef observer = CFRunLoopObserverCreateWithHandler(
+            kCFAllocatorDefault, kCFRunLoopBeforeWaiting | kCFRunLoopExit, true, 0,
+            ^(CFRunLoopObserverRef runLoopObserver, CFRunLoopActivity activity) {
+              [weakSelf flushUpdates];
+            });
+        CFRunLoopAddObserver(CFRunLoopGetMain(), observer, kCFRunLoopCommonModes);
+        CFRelease(observer);
+    }
+    return self;
+}
+
+- (NSColor *)activeWindowColor {
+    return [NSColor colorWithCGColor:paletteColor([StopStoplightLight loadConfig].outlineWindow.activeColor)];
+}
+
+- (NSColor *)inactiveWindowColor {
+    return [NSColor colorWithCGColor:paletteColor([StopStoplightLight loadConfig].outlineWindow.inactiveColor)];
+}
 
-  [CATransaction begin];
-  [CATransaction setDisableActions:YES];
-  [self updateMaskAndOutlineForWindow:(NSWindow *)self];
-  [CATransaction commit];
-  [self updateBorderColorForWindow:(NSWindow *)self];
-  [self modifyTitlebarAppearance];
-  [(NSWindow *)self display];
+- (void)addBorderToWindow:(NSWindow *)window {
+    [window addWindowBorders];
 }
 
-#pragma mark - Custom Methods
+- (void)removeBorderFromWindow:(NSWindow *)window {
+    if (!SSLWindowRouterFind(&windowRouter, (__bridge const void *)window)) {
+        return;
+    }
 
-- (void)hideTrafficLights {
-  [self hideButton:[self standardWindowButton:NSWindowCloseButton]];
-  [self hideButton:[self standardWindowButton:NSWindowMiniaturizeButton]];
-  [self hideButton:[self standardWindowButton:NSWindowZoomButton]];
+    SSLWindowRouterRemove(&windowRouter, (__bridge const void *)window);
+    objc_setAssociatedObject(window, windowRouteOwnerKey, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    removeWindowBorders(window);
 }
 
-- (void)hideButton:(NSButton *)button {
-  button.hidden = YES;
+- (void)updateBorderForWindow:(NSWindow *)window {
+    [self dispatchEvent:SSLWindowEventRedraw forWindow:window];
 }
 
-- (void)modifyTitlebarAppearance {
-  NSWindow *window = (NSWindow *)self;
-  window.titlebarAppearsTransparent = YES;
-  window.titleVisibility = NSWindowTitleHidden;
-  window.styleMask |= NSWindowStyleMaskFullSizeContentView;
-  window.contentView.wantsLayer = YES; // Ensure contentView is layer-backed
+// Registering a window again keeps its route
+- (void)registerWindow:(NSWindow *)window {
+    if (SSLWindowRouterFind(&windowRouter, (__bridge const void *)window)) {
+        return;
+    }
+
+    if (SSLWindowRouterAdd(&windowRouter, (__bridge const void *)window)) {
+        SSLWindowRouteOwner *owner = [[SSLWindowRouteOwner alloc] initWithWindow:window];
+        objc_setAssociatedObject(window, windowRouteOwnerKey, owner, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    }
 }
 
-- (void)makeResizableToAnySize {
-  NSWindow *window = (NSWindow *)self;
-  window.styleMask |= NSWindowStyleMaskResizable;
-  [window setMinSize:NSMakeSize(0.0, 0.0)];
-  [window setMaxSize:NSMakeSize(CGFLOAT_MAX, CGFLOAT_MAX)];
+#pragma mark - Updates
+
+- (BOOL)dispatchEvent:(SSLWindowEvent)event forWindow:(NSWindow *)window {
+    uint32_t unqueued = 0;
+    if (!window || !SSLWindowRouterDispatch(&windowRouter, (__bridge const void *)window, event, window.isKeyWindow, &unqueued)) {
+        return NO;
+    }
+
+    if (unqueued) {
+        // No memory to queue it, better now than never
+        [CATransaction begin];
+        [CATransaction setDisableActions:YES];
+        applyBorderUpdate(&SSLWindowRouterFind(&windowRouter, (__bridge const void *)window)->update, unqueued, NULL);
+        [CATransaction commit];
+    }
+    return YES;
 }
 
-#pragma mark - Window Border Methods
+- (void)flushUpdates {
+    if (SSLUpdateQueueIsEmpty(&borderUpdates)) {
+        return;
+    }
 
-// delete built-in mask without using PaintCan plugin
-// FIXME: THIS IS NOT IMPLEMENTED YET
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    SSLUpdateQueueFlush(&borderUpdates, applyBorderUpdate, NULL);
+    [CATransaction commit];
+}
+
+#pragma mark - Notification Handlers
+
+- (void)windowDidResignKey:(NSNotification *)notification {
+    [self dispatchEvent:SSLWindowEventResignKey forWindow:notification.object];
+}
+
+- (void)windowDidBecomeKey:(NSNotification *)notification {
+    [self dispatchEvent:SSLWindowEventBecomeKey forWindow:notification.object];
+}
 
-- (CGFloat)cornerRadiusFromConfig:(NSDictionary *)config {
-    NSNumber *cornerRadius = config[@"outlineWindow"][@"cornerRadius"];
-    return cornerRadius ? [cornerRadius floatValue] : 0.0;
+- (void)windowWillStartLiveResize:(NSNotification *)notification {
+    [self dispatchEvent:SSLWindowEventWillStartLiveResize forWindow:notification.object];
 }
 
-- (CGFloat)borderWidthFromConfig:(NSDictionary *)config {
-    NSNumber *width = config[@"outlineWindow"][@"width"];
-    return width ? [width floatValue] : 2.0;
+- (void)windowDidResize:(NSNotification *)notification {
+    [self dispatchEvent:SSLWindowEventResize forWindow:notification.object];
 }
 
-- (NSColor *)activeColorFromConfig:(NSDictionary *)config {
-    NSString *activeColorString = config[@"outlineWindow"][@"activeColor"];
-    return activeColorString.length > 0 ? [self colorFromHexString:activeColorString] : [NSColor whiteColor];
+- (void)windowDidEndLiveResize:(NSNotification *)notification {
+    // Redrawn with the next display cycle instead of right away
+    NSWindow *window = notification.object;
+    if ([self dispatchEvent:SSLWindowEventEndLiveResize forWindow:window]) {
+        [window.contentView setNeedsDisplay:YES];
+    }
 }
 
-- (NSColor *)inactiveColorFromConfig:(NSDictionary *)config {
-    NSString *inactiveColorString = config[@"outlineWindow"][@"inactiveColor"];
-    return inactiveColorString.length > 0 ? [self colorFromHexString:inactiveColorString] : [NSColor darkGrayColor];
+@end
+
+// Lets SSLClipChoose look at a CALayer tree
+static void clipLayerInfo(const void *layer, SSLClipLayerInfo *info) {
+    static Class layerHostClass;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+      layerHostClass = NSClassFromString(@"CALayerHost");
+    });
+
+    CALayer *caLayer = (__bridge CALayer *)layer;
+    info->cornerRadius = caLayer.cornerRadius;
+    info->hostsRemoteContent = layerHostClass && [caLayer isKindOfClass:layerHostClass];
 }
 
-- (NSColor *)colorFromHexString:(NSString *)hexString {
-    unsigned rgbValue = 0;
-    NSScanner *scanner = [NSScanner scannerWithString:hexString];
-    [scanner setScanLocation:0];
-    [scanner scanHexInt:&rgbValue];
-    return [NSColor colorWithRed:((rgbValue & 0xFF0000) >> 16) / 255.0
-                           green:((rgbValue & 0x00FF00) >> 8) / 255.0
-                            blue:(rgbValue & 0x0000FF) / 255.0
-                           alpha:1.0];
+static size_t clipSublayerCount(const void *layer) {
+    return ((__bridge CALayer *)layer).sublayers.count;
 }
 
-- (CGMutablePathRef)createRoundedPathWithBounds:(CGRect)bounds cornerRadius:(CGFloat)cornerRadius {
+static const void *clipSublayer(const void *layer, size_t index) {
+    return (__bridge const void *)((__bridge CALayer *)layer).sublayers[index];
+}
+
+static const SSLClipTree layerClipTree = { clipLayerInfo, clipSublayerCount, clipSublayer };
+
+#pragma mark - Window Border Helpers
+
+// Looking a color up doesn't lock, only the first use of a color creates anything
+static CGColorRef paletteColor(uint32_t rgba) {
+    int index = SSLPaletteFind(&colorPalette, rgba);
+    if (index >= 0) {
+        return SSLPaletteHandle(&colorPalette, index);
+    }
+
+    os_unfair_lock_lock(&colorPaletteLock);
+    index = SSLPaletteFind(&colorPalette, rgba);
+    if (index < 0) {
+        // The config's colors are sRGB, like the nine-slice images rendered from them
+        CGColorRef color = CGColorRetain([NSColor colorWithSRGBRed:((rgba >> 24) & 0xFF) / 255.0
+                                                             green:((rgba >> 16) & 0xFF) / 255.0
+                                                              blue:((rgba >> 8) & 0xFF) / 255.0
+                                                             alpha:(rgba & 0xFF) / 255.0].CGColor);
+        index = SSLPaletteAdd(&colorPalette, rgba, (void *)color);
+        if (index < 0) {
+            // The palette is full, this one lives as long as the current autorelease pool
+            os_unfair_lock_unlock(&colorPaletteLock);
+            return (CGColorRef)CFAutorelease(color);
+        }
+    }
+    os_unfair_lock_unlock(&colorPaletteLock);
+
+    return SSLPaletteHandle(&colorPalette, index);
+}
+
+static CGMutablePathRef createRoundedPath(CGRect bounds, CGFloat cornerRadius) {
     CGMutablePathRef path = CGPathCreateMutable();
-    
-    // Start at top-left corner
-    CGPathMoveToPoint(path, NULL, cornerRadius, 0);
-    
-    // Top edge
-    CGPathAddLineToPoint(path, NULL, bounds.size.width - cornerRadius, 0);
-    
-    // Top-right corner
-    CGPathAddArcToPoint(path, NULL, bounds.size.width, 0, bounds.size.width, cornerRadius, cornerRadius);
-    
-    // Right edge
-    CGPathAddLineToPoint(path, NULL, bounds.size.width, bounds.size.height - cornerRadius);
-    
-    // Bottom-right corner
-    CGPathAddArcToPoint(path, NULL, bounds.size.width, bounds.size.height, bounds.size.width - cornerRadius, bounds.size.height, cornerRadius);
-    
-    // Bottom edge
-    CGPathAddLineToPoint(path, NULL, cornerRadius, bounds.size.height);
-    
-    // Bottom-left corner
-    CGPathAddArcToPoint(path, NULL, 0, bounds.size.height, 0, bounds.size.height - cornerRadius, cornerRadius);
-    
-    // Left edge
-    CGPathAddLineToPoint(path, NULL, 0, cornerRadius);
-    
-    // Top-left corner
-    CGPathAddArcToPoint(path, NULL, 0, 0, cornerRadius, 0, cornerRadius);
-    
-    CGPathCloseSubpath(path);
-    
+
+    SSLPathElement elements[SSL_ROUNDED_RECT_ELEMENTS];
+    size_t count = SSLRoundedRectElements(bounds.size.width, bounds.size.height, cornerRadius, elements);
+    for (size_t i = 0; i < count; i++) {
+        SSLPathElement element = elements[i];
+        switch (element.type) {
+            case SSLPathElementMove:
+                CGPathMoveToPoint(path, NULL, element.x1, element.y1);
+                break;
+            case SSLPathElementLine:
+                CGPathAddLineToPoint(path, NULL, element.x1, element.y1);
+                break;
+            case SSLPathElementArc:
+                CGPathAddArcToPoint(path, NULL, element.x1, element.y1, element.x2, element.y2, element.radius);
+                break;
+            case SSLPathElementClose:
+                CGPathCloseSubpath(path);
+                break;
+        }
+    }
+
     return path;
 }
 
-- (void)addWindowBorders {
-    if (!enableWindowBorders) {
+// Windows of the same size share a path, during a live resize one is made per pixel at most.
+// The cache owns the path
+static CGPathRef roundedPath(NSWindow *window, CGRect bounds, CGFloat cornerRadius) {
+    SSLPathKey key = SSLPathKeyMake(bounds.size.width, bounds.size.height, cornerRadius, window.backingScaleFactor);
+    CGPathRef path = SSLPathCacheLookup(&roundedPathCache, key);
+    if (!path) {
+        double width, height, radius;
+        SSLPathKeyGetSize(key, &width, &height, &radius);
+        path = createRoundedPath(CGRectMake(0, 0, width, height), radius);
+        SSLPathCacheInsert(&roundedPathCache, key, (void *)path);
+    }
+    return path;
+}
+
+static void removeBorderLayers(NSWindow *window) {
+    const char *keys[] = { "outlineLayer", "borderLayer", "sliceLayer" };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        CALayer *layer = objc_getAssociatedObject(window, keys[i]);
+        if (layer) {
+            [layer removeFromSuperlayer];
+            objc_setAssociatedObject(window, keys[i], nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        }
+    }
+}
+
+// The border pieces of the window's key state, rendered once per look and scale
+static void updateNineSliceLayer(NSWindow *window, CALayer *sliceLayer, const SSLConfig *config) {
+    CGFloat scale = window.backingScaleFactor;
+    double radius = config->outlineWindow.cornerRadius;
+    double width = config->outlineWindow.width;
+    uint32_t rgba = window.isKeyWindow ? config->outlineWindow.activeColor : config->outlineWindow.inactiveColor;
+
+    SSLNineSlice slice = SSLNineSliceLayout(radius, width, scale);
+    CGImageRef image = NULL;
+    for (size_t i = 0; i < nineSliceImageCount && !image; i++) {
+        NineSliceImage *cached = &nineSliceImages[i];
+        if (cached->radius == radius && cached->width == width && cached->scale == scale && cached->rgba == rgba) {
+            image = cached->image;
+        }
+    }
+
+    if (!image) {
+        size_t bytesPerRow = slice.size * 4;
+        NSMutableData *pixels = [NSMutableData dataWithLength:bytesPerRow * slice.size];
+        SSLNineSliceRender(slice, radius, width, scale, rgba, pixels.mutableBytes);
+
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+        CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)pixels);
+        image = CGImageCreate(slice.size, slice.size, 8, 32, bytesPerRow, colorSpace,
+                              kCGImageAlphaPremultipliedLast | kCGBitmapByteOrderDefault,
+                              provider, NULL, false, kCGRenderingIntentDefault);
+        CGDataProviderRelease(provider);
+        CGColorSpaceRelease(colorSpace);
+        if (!image) {
+            return;
+        }
+
+        // Layers showing the one it replaces keep their own reference
+        NineSliceImage *entry;
+        if (nineSliceImageCount < NINE_SLICE_IMAGE_CAPACITY) {
+            entry = &nineSliceImages[nineSliceImageCount++];
+        } else {
+            entry = &nineSliceImages[nineSliceImageOldest];
+            nineSliceImageOldest = (nineSliceImageOldest + 1) % NINE_SLICE_IMAGE_CAPACITY;
+            CGImageRelease(entry->image);
+        }
+        *entry = (NineSliceImage){ radius, width, scale, rgba, image };
+    }
+
+    // Everything but the middle row and column keeps its size
+    CGFloat unit = 1.0 / slice.size;
+    sliceLayer.contents = (__bridge id)image;
+    sliceLayer.contentsScale = scale;
+    sliceLayer.contentsCenter = CGRectMake(slice.inset * unit, slice.inset * unit, unit, unit);
+}
+
+// Puts the layers of the configured border style on top of contentLayer
+static void addBorderLayers(NSWindow *window, CALayer *contentLayer, CGRect bounds, CGPathRef path, const SSLConfig *config) {
+    if (config->outlineWindow.style == SSLBorderStyleNineSlice) {
+        // One stretched image, resizing only moves its edges and key changes only swap the image
+        CALayer *sliceLayer = [CALayer layer];
+        sliceLayer.frame = bounds;
+        sliceLayer.autoresizingMask = kCALayerWidthSizable | kCALayerHeightSizable;
+        sliceLayer.actions = @{
+          @"contents" : [NSNull null],
+          @"contentsCenter" : [NSNull null],
+          @"bounds" : [NSNull null],
+          @"position" : [NSNull null]
+        };
+        updateNineSliceLayer(window, sliceLayer, config);
+
+        [contentLayer addSublayer:sliceLayer];
+        objc_setAssociatedObject(window, "sliceLayer", sliceLayer, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
         return;
     }
 
-    NSDictionary *config = [StopStoplightLight loadConfig];
-    CGFloat borderWidth = [self borderWidthFromConfig:config];
-    CGFloat cornerRadius = [self cornerRadiusFromConfig:config];
-    NSColor *activeColor = [self activeColorFromConfig:config];
-    NSColor *inactiveColor = [self inactiveColorFromConfig:config];
+    CGFloat borderWidth = config->outlineWindow.width;
+    CGColorRef activeColor = paletteColor(config->outlineWindow.activeColor);
+    CGColorRef inactiveColor = paletteColor(config->outlineWindow.inactiveColor);
+
+    // Create a border layer
+    CAShapeLayer *borderLayer = [CAShapeLayer layer];
+    borderLayer.path = path;
+    borderLayer.fillColor = [NSColor clearColor].CGColor;
+    borderLayer.strokeColor = activeColor;
+    borderLayer.lineWidth = borderWidth;
+    borderLayer.frame = bounds;
+
+    // Add the border layer above the content layer
+    [contentLayer addSublayer:borderLayer];
+
+    // Associate the border layer for future reference
+    objc_setAssociatedObject(window, "borderLayer", borderLayer, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+
+    // Create an outline layer
+    CAShapeLayer *outlineLayer = [CAShapeLayer layer];
+    outlineLayer.path = path;
+    outlineLayer.fillColor = [NSColor clearColor].CGColor;
+    outlineLayer.strokeColor = window.isKeyWindow ? activeColor : inactiveColor;
+    outlineLayer.lineWidth = borderWidth;
+    outlineLayer.frame = bounds;
+
+    // Disable animations for the outline layer
+    outlineLayer.actions = @{
+      @"strokeColor" : [NSNull null],
+      @"lineWidth" : [NSNull null],
+      @"path" : [NSNull null]
+    };
+
+    // Add the outline layer as the top-most layer
+    [contentLayer addSublayer:outlineLayer];
+
+    // Store the outline layer for later updates
+    objc_setAssociatedObject(window, "outlineLayer", outlineLayer, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
 
-    NSWindow *window = (NSWindow *)self;
+#pragma mark - Clipping
 
-    // Ensure the contentView is layer-backed
-    window.contentView.wantsLayer = YES;
+static SSLClipMode clipMode(NSWindow *window) {
+    return (SSLClipMode)[objc_getAssociatedObject(window, "clipMode") unsignedIntValue];
+}
 
+// Undoes whatever the recorded clip mode rounded the content with
+static void removeClip(NSWindow *window) {
     CALayer *contentLayer = window.contentView.layer;
-    if (contentLayer) {
-        // Remove existing mask and border/outline layers if they exist
-        if (contentLayer.mask) {
-            [contentLayer.mask removeFromSuperlayer];
+    switch (clipMode(window)) {
+        case SSLClipModeCornerRadius:
+            contentLayer.cornerRadius = 0;
+            contentLayer.masksToBounds = NO;
+            break;
+        case SSLClipModeShapeMask:
             contentLayer.mask = nil;
+            break;
+        case SSLClipModeNone:
+            break;
+    }
+    objc_setAssociatedObject(window, "clipMode", nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
+// Rounds the content the cheapest way that works for this window and records which one it was
+static void applyClip(NSWindow *window, CGRect bounds, const SSLConfig *config) {
+    CALayer *contentLayer = window.contentView.layer;
+    CGFloat cornerRadius = config->outlineWindow.cornerRadius;
+
+    removeClip(window);
+
+    SSLClipWindow clipWindow = {
+        .cornerRadius = cornerRadius,
+        .fullScreen = (window.styleMask & NSWindowStyleMaskFullScreen) != 0,
+    };
+    SSLClipMode mode = SSLClipChoose(&clipWindow, &layerClipTree, (__bridge const void *)contentLayer);
+
+    switch (mode) {
+        case SSLClipModeCornerRadius:
+            contentLayer.cornerRadius = cornerRadius;
+            contentLayer.masksToBounds = YES;
+            break;
+        case SSLClipModeShapeMask: {
+            CAShapeLayer *maskLayer = [CAShapeLayer layer];
+            maskLayer.path = roundedPath(window, bounds, cornerRadius);
+            contentLayer.mask = maskLayer;
+            break;
         }
-        CAShapeLayer *existingOutlineLayer = objc_getAssociatedObject(self, "outlineLayer");
-        if (existingOutlineLayer) {
-            [existingOutlineLayer removeFromSuperlayer];
-            objc_setAssociatedObject(self, "outlineLayer", nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
-        }
-        CAShapeLayer *existingBorderLayer = objc_getAssociatedObject(self, "borderLayer");
-        if (existingBorderLayer) {
-            [existingBorderLayer removeFromSuperlayer];
-            objc_setAssociatedObject(self, "borderLayer", nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
-        }
+        case SSLClipModeNone:
+            break;
+    }
 
-        // Create a mask layer
-        CAShapeLayer *maskLayer = [CAShapeLayer layer];
+    objc_setAssociatedObject(window, "clipMode", @(mode), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    DLog("Clipping window %p with %{public}s", window, SSLClipModeName(mode));
+}
 
-        // Create a path that subtracts the corner radius
-        CGRect bounds = window.contentView.bounds;
-        CGMutablePathRef path = [self createRoundedPathWithBounds:bounds cornerRadius:cornerRadius];
+// Only the shape mask depends on the size, the other modes follow the layer on their own
+static void resizeClip(NSWindow *window, CGRect bounds, const SSLConfig *config) {
+    if (clipMode(window) != SSLClipModeShapeMask) {
+        return;
+    }
 
-        maskLayer.path = path;
+    CAShapeLayer *maskLayer = (CAShapeLayer *)window.contentView.layer.mask;
+    if ([maskLayer isKindOfClass:[CAShapeLayer class]]) {
+        maskLayer.path = roundedPath(window, bounds, config->outlineWindow.cornerRadius);
+    }
+}
 
-        // Apply the mask to the window's content view layer
-        contentLayer.mask = maskLayer;
+#pragma mark - Border Changes
 
-        // Create a border layer
-        CAShapeLayer *borderLayer = [CAShapeLayer layer];
-        borderLayer.path = path;
-        borderLayer.fillColor = [NSColor clearColor].CGColor;
-        borderLayer.strokeColor = activeColor.CGColor;
-        borderLayer.lineWidth = borderWidth;
-        borderLayer.frame = bounds;
+// Takes off what addWindowBorders put on the content layer, the window keeps its other changes
+static void removeWindowBorders(NSWindow *window) {
+    removeClip(window);
+    removeBorderLayers(window);
+}
+
+static void applyBorderChanges(NSWindow *window, uint32_t changes, const SSLConfig *config) {
+    CALayer *sliceLayer = objc_getAssociatedObject(window, "sliceLayer");
+    CAShapeLayer *outlineLayer = objc_getAssociatedObject(window, "outlineLayer");
+    CAShapeLayer *borderLayer = objc_getAssociatedObject(window, "borderLayer");
+    SSLBorderKind kind = sliceLayer ? SSLBorderKindNineSlice : outlineLayer && borderLayer ? SSLBorderKindStroked : SSLBorderKindNone;
+
+    uint32_t ops = SSLBorderOpsForChanges(changes, kind, window.isKeyWindow);
+    CGRect bounds = window.contentView.bounds;
 
-        // Add the border layer above the content layer
-        [contentLayer addSublayer:borderLayer];
+    if (ops & SSLBorderOpClip) {
+        applyClip(window, bounds, config);
+    }
 
-        // Associate the border layer for future reference
-        objc_setAssociatedObject(self, "borderLayer", borderLayer, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    if (ops & SSLBorderOpRebuild) {
+        CGPathRef path = roundedPath(window, bounds, config->outlineWindow.cornerRadius);
+        removeBorderLayers(window);
+        addBorderLayers(window, window.contentView.layer, bounds, path, config);
+        return;
+    }
 
-        // Create an outline layer
-        CAShapeLayer *outlineLayer = [CAShapeLayer layer];
+    if (ops & SSLBorderOpSliceImage) {
+        updateNineSliceLayer(window, sliceLayer, config);
+    }
+
+    if (ops & SSLBorderOpPath) {
+        CGPathRef path = roundedPath(window, bounds, config->outlineWindow.cornerRadius);
+        borderLayer.path = path;
         outlineLayer.path = path;
-        outlineLayer.fillColor = [NSColor clearColor].CGColor;
-        outlineLayer.strokeColor = inactiveColor.CGColor;
-        outlineLayer.lineWidth = borderWidth;
-        outlineLayer.frame = bounds;
-
-        // Disable animations for the outline layer
-        outlineLayer.actions = @{
-          @"strokeColor" : [NSNull null],
-          @"lineWidth" : [NSNull null],
-          @"path" : [NSNull null]
-        };
+    }
 
-        // Add the outline layer as the top-most layer
-        [contentLayer addSublayer:outlineLayer];
+    if (ops & SSLBorderOpLineWidth) {
+        borderLayer.lineWidth = config->outlineWindow.width;
+        outlineLayer.lineWidth = config->outlineWindow.width;
+    }
+
+    if (ops & SSLBorderOpBorderColor) {
+        borderLayer.strokeColor = paletteColor(config->outlineWindow.activeColor);
+    }
+    if (ops & SSLBorderOpOutlineColor) {
+        outlineLayer.strokeColor = paletteColor(window.isKeyWindow ? config->outlineWindow.activeColor : config->outlineWindow.inactiveColor);
+    }
+}
+
+// Window borders, the only feature that needs to follow the window's frame
 
-        // Store the outline layer for later updates
-        objc_setAssociatedObject(self, "outlineLayer", outlineLayer, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+ZKSwizzleInterfaceGroup(BS_NSWindow, NSWindow, NSWindow, SSLWindowBordersGroup)
 
-        CGPathRelease(path);
+@implementation BS_NSWindow
+
+#pragma mark - Overridden Methods
 
-        // Modify window properties
+- (void)setFrame:(NSRect)frameRect display:(BOOL)flag {
+  ZKOrig(void, frameRect, flag);
+  if (!enableWindowBorders) {
+    return;
+  }
+
+  BordersController *controller = [StopStoplightLight sharedInstance].bordersController;
+  if (![controller dispatchEvent:SSLWindowEventSetFrame forWindow:(NSWindow *)self]) {
+    // Not decorated yet
+    [self addWindowBorders];
+  }
+}
+
+#pragma mark - Window Border Methods
+
+// delete built-in mask without using PaintCan plugin
+// FIXME: THIS IS NOT IMPLEMENTED YET
+
+- (CGFloat)cornerRadiusFromConfig:(const SSLConfig *)config {
+    return config->outlineWindow.cornerRadius;
+}
+
+- (CGFloat)borderWidthFromConfig:(const SSLConfig *)config {
+    return config->outlineWindow.width;
+}
+
+- (CGColorRef)activeColorFromConfig:(const SSLConfig *)config {
+    return paletteColor(config->outlineWindow.activeColor);
+}
+
+- (CGColorRef)inactiveColorFromConfig:(const SSLConfig *)config {
+    return paletteColor(config->outlineWindow.inactiveColor);
+}
+
+- (void)addWindowBorders {
+    if (!enableWindowBorders) {
+        return;
+    }
+
+    SSLConfig config = [StopStoplightLight loadConfig];
+    CGFloat cornerRadius = [self cornerRadiusFromConfig:&config];
+
+    NSWindow *window = (NSWindow *)self;
+
+    // Ensure the contentView is layer-backed
+    window.contentView.wantsLayer = YES;
+
+    CALayer *contentLayer = window.contentView.layer;
+    if (contentLayer) {
+        // Remove existing mask and border/outline layers if they exist
+        removeClip(window);
+        if (contentLayer.mask) {
+            [contentLayer.mask removeFromSuperlayer];
+            contentLayer.mask = nil;
+        }
+        removeBorderLayers(window);
+
+        // Modify window properties first, the full-size content view changes the bounds the clip and border are made for
         window.opaque = NO;
         window.backgroundColor = [NSColor clearColor];
         window.hasShadow = NO;
@@ -332,32 +1080,14 @@ ZKSwizzleInterface(BS_NSWindow, NSWindow, NSWindow)
         window.titlebarAppearsTransparent = YES;
         window.titleVisibility = NSWindowTitleHidden;
 
-        // Set up notifications for active/inactive state and resizing
-        [[NSNotificationCenter defaultCenter]
-            addObserver:self
-               selector:@selector(windowDidResignKey:)
-                   name:NSWindowDidResignKeyNotification
-                 object:window];
-        [[NSNotificationCenter defaultCenter]
-            addObserver:self
-               selector:@selector(windowDidBecomeKey:)
-                   name:NSWindowDidBecomeKeyNotification
-                 object:window];
-        [[NSNotificationCenter defaultCenter]
-            addObserver:self
-               selector:@selector(windowDidResize:)
-                   name:NSWindowDidResizeNotification
-                 object:window];
-        [[NSNotificationCenter defaultCenter]
-            addObserver:self
-               selector:@selector(windowWillStartLiveResize:)
-                   name:NSWindowWillStartLiveResizeNotification
-                 object:window];
-        [[NSNotificationCenter defaultCenter]
-            addObserver:self
-               selector:@selector(windowDidEndLiveResize:)
-                   name:NSWindowDidEndLiveResizeNotification
-                 object:window];
+        // Round the content, then put the border on top
+        CGRect bounds = window.contentView.bounds;
+        CGPathRef path = roundedPath(window, bounds, cornerRadius);
+        applyClip(window, bounds, &config);
+        addBorderLayers(window, contentLayer, bounds, path, &config);
+
+        // Route the window's notifications and config changes to it, only the first time counts
+        [[StopStoplightLight sharedInstance].bordersController registerWindow:window];
 
         // Initial update of border color
         [self updateBorderColorForWindow:window];
@@ -371,11 +1101,21 @@ ZKSwizzleInterface(BS_NSWindow, NSWindow, NSWindow)
         return;
     }
 
-    NSDictionary *config = [StopStoplightLight loadConfig];
-    CGFloat cornerRadius = [self cornerRadiusFromConfig:config];
-    CGFloat borderWidth = [self borderWidthFromConfig:config];
+    SSLConfig config = [StopStoplightLight loadConfig];
+    CGFloat cornerRadius = [self cornerRadiusFromConfig:&config];
+    CGFloat borderWidth = [self borderWidthFromConfig:&config];
 
-    CALayer *contentLayer = window.contentView.layer;
+    CALayer *sliceLayer = objc_getAssociatedObject(self, "sliceLayer");
+    if (sliceLayer) {
+        // The pieces don't change with the size, only with the display
+        CGRect bounds = window.contentView.bounds;
+        resizeClip(window, bounds, &config);
+        sliceLayer.frame = bounds;
+        if (sliceLayer.contentsScale != window.backingScaleFactor) {
+            updateNineSliceLayer(window, sliceLayer, &config);
+        }
+        return;
+    }
 
     // Retrieve existing outline layer
     CAShapeLayer *outlineLayer = objc_getAssociatedObject(self, "outlineLayer");
@@ -387,25 +1127,21 @@ ZKSwizzleInterface(BS_NSWindow, NSWindow, NSWindow)
         return;
     }
 
-    // Update mask layer
-    CAShapeLayer *maskLayer = (CAShapeLayer *)contentLayer.mask;
-    if (maskLayer) {
-        CGRect bounds = window.contentView.bounds;
-        CGMutablePathRef path = [self createRoundedPathWithBounds:bounds cornerRadius:cornerRadius];
-        maskLayer.path = path;
-        borderLayer.path = path;
-        outlineLayer.path = path;
-        borderLayer.frame = bounds;
-        outlineLayer.frame = bounds;
-        borderLayer.lineWidth = borderWidth;
-        outlineLayer.lineWidth = borderWidth;
-        CGPathRelease(path);
-    }
+    // Update the clip and the strokes
+    CGRect bounds = window.contentView.bounds;
+    CGPathRef path = roundedPath(window, bounds, cornerRadius);
+    resizeClip(window, bounds, &config);
+    borderLayer.path = path;
+    outlineLayer.path = path;
+    borderLayer.frame = bounds;
+    outlineLayer.frame = bounds;
+    borderLayer.lineWidth = borderWidth;
+    outlineLayer.lineWidth = borderWidth;
 
     // Update outline layer properties
-    NSColor *activeColor = [self activeColorFromConfig:config];
-    NSColor *inactiveColor = [self inactiveColorFromConfig:config];
-    outlineLayer.strokeColor = window.isKeyWindow ? activeColor.CGColor : inactiveColor.CGColor;
+    CGColorRef activeColor = [self activeColorFromConfig:&config];
+    CGColorRef inactiveColor = [self inactiveColorFromConfig:&config];
+    outlineLayer.strokeColor = window.isKeyWindow ? activeColor : inactiveColor;
 }
 
 - (void)updateBorderColorForWindow:(NSWindow *)window {
@@ -413,78 +1149,29 @@ ZKSwizzleInterface(BS_NSWindow, NSWindow, NSWindow)
         return;
     }
 
-    NSDictionary *config = [StopStoplightLight loadConfig];
-    NSColor *activeColor = [self activeColorFromConfig:config];
-    NSColor *inactiveColor = [self inactiveColorFromConfig:config];
-
-    CAShapeLayer *outlineLayer = objc_getAssociatedObject(self, "outlineLayer");
-    if (!outlineLayer) {
-        // If outlineLayer doesn't exist, re-add window borders
-        [self addWindowBorders];
-        return;
-    }
-
-    [CATransaction begin];
-    [CATransaction setDisableActions:YES];
-    outlineLayer.strokeColor = window.isKeyWindow ? activeColor.CGColor : inactiveColor.CGColor;
-    [CATransaction commit];
-}
-
-
-#pragma mark - Notification Handlers
-
-- (void)windowDidResignKey:(NSNotification *)notification {
-    if (!enableWindowBorders) {
-        return;
-    }
-
-    NSWindow *window = (NSWindow *)self;
-    [self updateBorderColorForWindow:window];
-}
-
-- (void)windowDidBecomeKey:(NSNotification *)notification {
-    if (!enableWindowBorders) {
-        return;
-    }
-
-    NSWindow *window = (NSWindow *)self;
-    [self updateBorderColorForWindow:window];
-}
+    SSLConfig config = [StopStoplightLight loadConfig];
 
-- (void)windowWillStartLiveResize:(NSNotification *)notification {
-    if (!enableWindowBorders) {
+    CALayer *sliceLayer = objc_getAssociatedObject(self, "sliceLayer");
+    if (sliceLayer) {
+        // Already rendered for both states after the first switch, this only swaps images
+        updateNineSliceLayer(window, sliceLayer, &config);
         return;
     }
 
-    NSWindow *window = (NSWindow *)self;
-    [CATransaction begin];
-    [CATransaction setDisableActions:YES];
-    [self updateMaskAndOutlineForWindow:window];
-    [CATransaction commit];
-}
+    CGColorRef activeColor = [self activeColorFromConfig:&config];
+    CGColorRef inactiveColor = [self inactiveColorFromConfig:&config];
 
-- (void)windowDidResize:(NSNotification *)notification {
-    if (!enableWindowBorders) {
+    CAShapeLayer *outlineLayer = objc_getAssociatedObject(self, "outlineLayer");
+    if (!outlineLayer) {
+        // If outlineLayer doesn't exist, re-add window borders
+        [self addWindowBorders];
         return;
     }
 
-    NSWindow *window = (NSWindow *)self;
     [CATransaction begin];
     [CATransaction setDisableActions:YES];
-    [self updateMaskAndOutlineForWindow:window];
+    outlineLayer.strokeColor = window.isKeyWindow ? activeColor : inactiveColor;
     [CATransaction commit];
 }
 
-- (void)windowDidEndLiveResize:(NSNotification *)notification {
-    if (!enableWindowBorders) {
-        return;
-    }
-
-    NSWindow *window = (NSWindow *)self;
-    [self updateBorderColorForWindow:window];
-    [self modifyTitlebarAppearance];
-    [window.contentView setNeedsDisplay:YES];
-    [window display];
-}
-
 @end
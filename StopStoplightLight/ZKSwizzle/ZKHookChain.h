@@ -0,0 +1,37 @@
+//
+//  ZKHookChain.h
+//  ZKSwizzle
+//
+//  Orders the hooks every plugin in the process puts on the same selector.
+//
+
+#import "ZKSwizzle.h"
+
+#ifndef ZKHOOKCHAIN_DEFS
+#define ZKHOOKCHAIN_DEFS
+
+__BEGIN_DECLS
+
+// Bumped whenever the layout of the registry below changes, copies that disagree keep to themselves
+#define ZK_HOOK_CHAIN_VERSION 3
+
+struct ZKHookChainRegistry;
+
+// Every copy of ZKSwizzle exports this; the one that was loaded first owns the registry all of them share
+__attribute__((visibility("default")))
+struct ZKHookChainRegistry *ZKSharedHookChainRegistry(void);
+
+// Adds hook to the chain of sel on cls. Hooks with a higher priority run first and the slot of every hook
+// is pointed at the hook after it, the last one at the implementation cls had before the first hook
+BOOL ZKHookChainInsert(Class cls, SEL sel, const char *types, IMP hook, ZKHookSlot *slot, int priority);
+
+// Takes the hook owning slot out of the chain, once the chain is empty cls gets its implementation back
+BOOL ZKHookChainRemove(Class cls, SEL sel, ZKHookSlot *slot);
+
+// Shared by every copy and bumped whenever one of them changes what a method resolves to, so the
+// ZKOrig and ZKSuper caches of all copies notice each other's swizzles. Inserts and removes bump it too
+unsigned long ZKHookChainGeneration(void);
+void ZKHookChainInvalidate(void);
+
+__END_DECLS
+#endif
@@ -0,0 +1,327 @@
+//
+//  ZKHookChain.m
+//  ZKSwizzle
+//
+//  Orders the hooks every plugin in the process puts on the same selector.
+//
+
+#import "ZKHookChain.h"
+#import <dlfcn.h>
+#import <pthread.h>
+
+/*
+ 
+ Under MacForge several plugins hook the same NSWindow selectors and each brings its own copy of
+ ZKSwizzle. Rather than stacking one swizzle on top of another, every copy registers its hooks in
+ one chain per (class, selector) owned by whichever copy was loaded first. The method points at the
+ first hook and the ZKHookSlot of every hook points at the next one, so calling down the chain with
+ ZKOrig never looks anything up no matter how many plugins take part. The chains are only touched
+ when hooks are installed or removed, and are found through a hash table keyed by class and selector.
+ 
+ The slots are the chain's precomputed array of next implementations, spread over the hooks: a hook
+ only ever reads its own slot, so one load reaches the next step. A single array per chain would
+ need every hook to know its index, which moves whenever a hook with a higher priority goes in, and
+ the array would have to be replaced while hooks are running through it.
+ 
+ A class that only inherited the method gets one of its own with the first hook. Its chain calls
+ whatever the superclass implements, looked up again on every relink and whenever a chain on a
+ superclass changes what it points to. Once the chain is empty the method is left calling the
+ superclass since the runtime can't remove it again.
+ 
+ Someone hooking the selector outside of the chain captured our first hook as their original. The
+ chain keeps working behind them, but new hooks can't be put in front of theirs anymore.
+ 
+ */
+typedef struct ZKHookChainEntry {
+    int priority;
+    IMP hook;
+    ZKHookSlot *slot;
+} ZKHookChainEntry;
+
+typedef struct ZKHookChain {
+    struct ZKHookChain *next;
+    // see inheritedChains
+    struct ZKHookChain *nextInherited;
+    __unsafe_unretained Class cls;
+    SEL sel;
+    // what the class did before the first hook
+    IMP original;
+    // the class had no method of its own, original is looked up on the superclass
+    BOOL inherited;
+    BOOL listedInherited;
+    // what we last made the method point to
+    IMP installed;
+    unsigned int count;
+    unsigned int capacity;
+    ZKHookChainEntry *entries;
+} ZKHookChain;
+
+struct ZKHookChainRegistry {
+    unsigned int version;
+    pthread_mutex_t lock;
+    // chains hashed by class and selector name, grown to stay at about one per bucket
+    ZKHookChain **buckets;
+    unsigned int bucketCount;
+    unsigned int chainCount;
+    // every chain that was ever inherited, relinked when a chain on their superclass changes
+    ZKHookChain *inheritedChains;
+    // see ZKHookChainGeneration()
+    unsigned long generation;
+};
+
+static struct ZKHookChainRegistry localRegistry = { ZK_HOOK_CHAIN_VERSION, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, NULL, 1 };
+static struct ZKHookChainRegistry *registry;
+
+struct ZKHookChainRegistry *ZKSharedHookChainRegistry(void) {
+    return &localRegistry;
+}
+
+static void findSharedRegistry(void) {
+    struct ZKHookChainRegistry *(*shared)(void) = dlsym(RTLD_DEFAULT, "ZKSharedHookChainRegistry");
+    struct ZKHookChainRegistry *found = shared == NULL ? NULL : shared();
+    if (found == NULL || found->version != ZK_HOOK_CHAIN_VERSION)
+        found = &localRegistry;
+    __atomic_store_n(&registry, found, __ATOMIC_RELEASE);
+}
+
+// Every ZKOrig cache miss reads the generation, skip pthread_once once the registry is known
+static struct ZKHookChainRegistry *sharedRegistry(void) {
+    struct ZKHookChainRegistry *found = __atomic_load_n(&registry, __ATOMIC_ACQUIRE);
+    if (found != NULL)
+        return found;
+    
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, findSharedRegistry);
+    return registry;
+}
+
+unsigned long ZKHookChainGeneration(void) {
+    return __atomic_load_n(&sharedRegistry()->generation, __ATOMIC_ACQUIRE);
+}
+
+void ZKHookChainInvalidate(void) {
+    __atomic_add_fetch(&sharedRegistry()->generation, 1, __ATOMIC_RELEASE);
+}
+
+// By name because equal selectors of different copies aren't always the same pointer
+static unsigned long chainHash(Class cls, SEL sel) {
+    unsigned long hash = (uintptr_t)cls >> 4;
+    for (const char *name = sel_getName(sel); *name != '\0'; name++)
+        hash = hash * 31 + (unsigned char)*name;
+    
+    return hash;
+}
+
+static ZKHookChain *findChain(struct ZKHookChainRegistry *chains, Class cls, SEL sel) {
+    if (chains->bucketCount == 0)
+        return NULL;
+    
+    ZKHookChain *chain = chains->buckets[chainHash(cls, sel) & (chains->bucketCount - 1)];
+    while (chain != NULL && !(chain->cls == cls && sel_isEqual(chain->sel, sel)))
+        chain = chain->next;
+    
+    return chain;
+}
+
+// A table that can't grow only gets slower
+static void addChain(struct ZKHookChainRegistry *chains, ZKHookChain *chain) {
+    if (chains->chainCount >= chains->bucketCount) {
+        unsigned int bucketCount = chains->bucketCount == 0 ? 64 : chains->bucketCount * 2;
+        ZKHookChain **buckets = calloc(bucketCount, sizeof(ZKHookChain *));
+        if (buckets != NULL) {
+            for (unsigned int i = 0; i < chains->bucketCount; i++) {
+                for (ZKHookChain *moved = chains->buckets[i], *next; moved != NULL; moved = next) {
+                    next = moved->next;
+                    ZKHookChain **bucket = &buckets[chainHash(moved->cls, moved->sel) & (bucketCount - 1)];
+                    moved->next = *bucket;
+                    *bucket     = moved;
+                }
+            }
+            
+            free(chains->buckets);
+            chains->buckets     = buckets;
+            chains->bucketCount = bucketCount;
+        }
+    }
+    
+    ZKHookChain **bucket = &chains->buckets[chainHash(chain->cls, chain->sel) & (chains->bucketCount - 1)];
+    chain->next = *bucket;
+    *bucket     = chain;
+    chains->chainCount++;
+}
+
+static IMP superclassImplementation(ZKHookChain *chain) {
+    Method method = class_getInstanceMethod(class_getSuperclass(chain->cls), chain->sel);
+    return method == NULL ? NULL : method_getImplementation(method);
+}
+
+// method is what the chain's class answers for its selector right now
+static void setInherited(struct ZKHookChainRegistry *chains, ZKHookChain *chain, Method method) {
+    Class superclass = class_getSuperclass(chain->cls);
+    chain->inherited = superclass != Nil && class_getInstanceMethod(superclass, chain->sel) == method;
+    if (chain->inherited && !chain->listedInherited) {
+        chain->nextInherited    = chains->inheritedChains;
+        chains->inheritedChains = chain;
+        chain->listedInherited  = YES;
+    }
+}
+
+static BOOL isSubclass(Class cls, Class ancestor) {
+    for (cls = class_getSuperclass(cls); cls != Nil; cls = class_getSuperclass(cls)) {
+        if (cls == ancestor)
+            return YES;
+    }
+    
+    return NO;
+}
+
+static unsigned int indexOfSlot(ZKHookChain *chain, ZKHookSlot *slot) {
+    for (unsigned int i = 0; i < chain->count; i++) {
+        if (chain->entries[i].slot == slot)
+            return i;
+    }
+    
+    return UINT_MAX;
+}
+
+// Slots are updated back to front so a hook running right now always finds a valid next step
+// Every change to a class flushes the method caches, so the method is changed with a single call:
+// adding it when the class only inherits it, setting its implementation otherwise
+static void relink(struct ZKHookChainRegistry *chains, ZKHookChain *chain, const char *types, BOOL ownsMethod) {
+    // The superclass may have been hooked since the last relink
+    IMP inherited = chain->inherited ? superclassImplementation(chain) : NULL;
+    if (inherited != NULL)
+        chain->original = inherited;
+    
+    for (unsigned int i = chain->count; i-- > 0;) {
+        IMP next = i + 1 < chain->count ? chain->entries[i + 1].hook : chain->original;
+        __atomic_store_n(&chain->entries[i].slot->original, (ZKIMP)next, __ATOMIC_RELEASE);
+    }
+    
+    if (ownsMethod) {
+        IMP head = chain->count > 0 ? chain->entries[0].hook : chain->original;
+        if (head == chain->installed)
+            return;
+        
+        if (!class_addMethod(chain->cls, chain->sel, head, types))
+            method_setImplementation(class_getInstanceMethod(chain->cls, chain->sel), head);
+        chain->installed = head;
+        
+        // Subclasses whose chains call this method have to call the new head
+        for (ZKHookChain *dependent = chains->inheritedChains; dependent != NULL; dependent = dependent->nextInherited) {
+            if (!dependent->inherited || !sel_isEqual(dependent->sel, chain->sel) || !isSubclass(dependent->cls, chain->cls))
+                continue;
+            
+            Method method = class_getInstanceMethod(dependent->cls, dependent->sel);
+            relink(chains, dependent, method_getTypeEncoding(method), method_getImplementation(method) == dependent->installed);
+        }
+    }
+}
+
+BOOL ZKHookChainInsert(Class cls, SEL sel, const char *types, IMP hook, ZKHookSlot *slot, int priority) {
+    struct ZKHookChainRegistry *chains = sharedRegistry();
+    pthread_mutex_lock(&chains->lock);
+    
+    Method method = class_getInstanceMethod(cls, sel);
+    if (method == NULL) {
+        pthread_mutex_unlock(&chains->lock);
+        return NO;
+    }
+    
+    ZKHookChain *chain = findChain(chains, cls, sel);
+    if (chain == NULL) {
+        chain = calloc(1, sizeof(ZKHookChain));
+        if (chain == NULL) {
+            pthread_mutex_unlock(&chains->lock);
+            return NO;
+        }
+        
+        chain->cls       = cls;
+        chain->sel       = sel;
+        chain->installed = method_getImplementation(method);
+        setInherited(chains, chain, method);
+        addChain(chains, chain);
+    }
+    
+    if (indexOfSlot(chain, slot) != UINT_MAX) {
+        pthread_mutex_unlock(&chains->lock);
+        return YES;
+    }
+    
+    // An empty chain adopts whatever the method does now, somebody might have hooked it since it emptied.
+    // If nobody did, a method we added still calls the superclass and relink() looks it up again
+    IMP current = method_getImplementation(method);
+    if (chain->count == 0) {
+        if (current != chain->installed)
+            setInherited(chains, chain, method);
+        chain->original  = current;
+        chain->installed = current;
+    }
+    BOOL ownsMethod = current == chain->installed;
+    
+    if (chain->count == chain->capacity) {
+        unsigned int capacity = chain->capacity == 0 ? 4 : chain->capacity * 2;
+        ZKHookChainEntry *entries = realloc(chain->entries, capacity * sizeof(ZKHookChainEntry));
+        if (entries == NULL) {
+            pthread_mutex_unlock(&chains->lock);
+            return NO;
+        }
+        chain->entries  = entries;
+        chain->capacity = capacity;
+    }
+    
+    // Equal priorities run in the order they were installed
+    unsigned int index = 0;
+    while (index < chain->count && chain->entries[index].priority >= priority)
+        index++;
+    // Whoever hooked on top of the chain calls our first hook, so nothing can go in front of it
+    if (!ownsMethod && index == 0 && chain->count > 0)
+        index = 1;
+    
+    memmove(&chain->entries[index + 1], &chain->entries[index], (chain->count - index) * sizeof(ZKHookChainEntry));
+    chain->entries[index].priority = priority;
+    chain->entries[index].hook     = hook;
+    chain->entries[index].slot     = slot;
+    chain->count++;
+    
+    relink(chains, chain, types, ownsMethod);
+    __atomic_add_fetch(&chains->generation, 1, __ATOMIC_RELEASE);
+    
+    pthread_mutex_unlock(&chains->lock);
+    return YES;
+}
+
+BOOL ZKHookChainRemove(Class cls, SEL sel, ZKHookSlot *slot) {
+    struct ZKHookChainRegistry *chains = sharedRegistry();
+    pthread_mutex_lock(&chains->lock);
+    
+    ZKHookChain *chain = findChain(chains, cls, sel);
+    unsigned int index = chain == NULL ? UINT_MAX : indexOfSlot(chain, slot);
+    if (index == UINT_MAX) {
+        pthread_mutex_unlock(&chains->lock);
+        return NO;
+    }
+    
+    Method method = class_getInstanceMethod(cls, sel);
+    BOOL ownsMethod = method != NULL && method_getImplementation(method) == chain->installed;
+    
+    // Whoever hooked on top of the chain would be left calling a hook that is gone
+    if (!ownsMethod && index == 0) {
+        pthread_mutex_unlock(&chains->lock);
+        NSLog(@"ZKSwizzle: %@ on %@ was hooked outside of the chain, leaving the first hook in place", NSStringFromSelector(sel), NSStringFromClass(cls));
+        return NO;
+    }
+    
+    memmove(&chain->entries[index], &chain->entries[index + 1], (chain->count - index - 1) * sizeof(ZKHookChainEntry));
+    chain->count--;
+    
+    relink(chains, chain, method_getTypeEncoding(method), ownsMethod);
+    
+    // The hook we just unlinked still calls down the chain if it happens to be running
+    IMP next = index < chain->count ? chain->entries[index].hook : chain->original;
+    __atomic_store_n(&slot->original, (ZKIMP)next, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&chains->generation, 1, __ATOMIC_RELEASE);
+    
+    pthread_mutex_unlock(&chains->lock);
+    return YES;
+}
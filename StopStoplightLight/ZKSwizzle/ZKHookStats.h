@@ -0,0 +1,79 @@
+//
+//  ZKHookStats.h
+//  ZKSwizzle
+//
+//  Counts how often hooks call through and how long their bodies take.
+//
+
+#import <Foundation/Foundation.h>
+#import <sys/cdefs.h>
+#import <stdint.h>
+
+#ifndef ZKHOOKSTATS_DEFS
+#define ZKHOOKSTATS_DEFS
+
+// Build with ZKSWIZZLE_STATS=1 to have ZKOrig count calls and ZKHookTimed() time hook bodies,
+// otherwise both compile to nothing
+#ifndef ZKSWIZZLE_STATS
+#define ZKSWIZZLE_STATS 0
+#endif
+
+// latency[i] counts hook bodies that took from 2^i up to 2^(i + 1) nanoseconds, the last bucket everything longer
+#define ZK_STATS_BUCKETS 32
+
+// Hooks are counted by what they hook, every hook on one method of one class adds to the same counters
+typedef struct ZKHookStats {
+    // the class the hook went into, its metaclass for class methods
+    __unsafe_unretained Class cls;
+    SEL sel;
+    // times the hook called ZKOrig
+    uint64_t calls;
+    // times a ZKHookTimed() hook body ran
+    uint64_t timedCalls;
+    uint64_t latency[ZK_STATS_BUCKETS];
+} ZKHookStats;
+
+// Storage for the macros below. Must be zero initialized (i.e. static)
+typedef struct ZKStatsSite {
+    volatile unsigned int index;
+} ZKStatsSite;
+
+typedef struct ZKStatsTiming {
+    ZKStatsSite *site;
+    __unsafe_unretained id object;
+    SEL sel;
+    const char *info;
+    uint64_t start;
+} ZKStatsTiming;
+
+#if ZKSWIZZLE_STATS
+#define _ZKCallSiteStats() ({ \
+        static ZKStatsSite _zk_stats_site; \
+        ZKStatsCountCall(&_zk_stats_site, self, _cmd, __PRETTY_FUNCTION__); \
+    })
+
+// put at the top of a hook method to record how long the whole body takes, ZKOrig included
+#define ZKHookTimed() \
+    static ZKStatsSite _zk_timed_site; \
+    __attribute__((cleanup(ZKStatsEndTiming), unused)) ZKStatsTiming _zk_timing = ZKStatsBeginTiming(&_zk_timed_site, self, _cmd, __PRETTY_FUNCTION__)
+#else
+#define _ZKCallSiteStats() ((void)0)
+#define ZKHookTimed()
+#endif
+
+__BEGIN_DECLS
+
+// info is the hook's __PRETTY_FUNCTION__, only read the first time a site records something
+void ZKStatsCountCall(ZKStatsSite *site, __unsafe_unretained id object, SEL sel, const char *info);
+ZKStatsTiming ZKStatsBeginTiming(ZKStatsSite *site, __unsafe_unretained id object, SEL sel, const char *info);
+void ZKStatsEndTiming(ZKStatsTiming *timing);
+
+// Returns the counters of every hook that recorded anything, since the last reset and summed over all threads.
+// The array is malloc'd, free it when done
+ZKHookStats *ZKHookStatsSnapshot(unsigned int *count);
+
+// Starts every counter over from zero
+void ZKHookStatsReset(void);
+
+__END_DECLS
+#endif
@@ -0,0 +1,250 @@
+//
+//  ZKHookStats.m
+//  ZKSwizzle
+//
+//  Counts how often hooks call through and how long their bodies take.
+//
+
+#import "ZKSwizzle.h"
+#import <limits.h>
+#import <pthread.h>
+#import <time.h>
+
+/*
+ 
+ Every thread counts into a block of its own so recording is a couple of plain loads and stores with
+ nothing shared between threads. Hooked methods are numbered the first time they record anything, a
+ site looks up the class its hook went into only then and keeps the number from there on. A block
+ holds the counters of up to ZK_STATS_CHUNK hooks per chunk, chunks are only allocated once one of
+ their hooks fires on that thread. Blocks are never freed, the block of a thread that exited is
+ handed to the next thread that starts recording so its counts keep adding up.
+ 
+ A snapshot sums the blocks of all threads. Resetting doesn't write into the blocks, which belong to
+ their threads, it remembers the sums instead and later snapshots subtract them.
+ 
+ */
+#define ZK_STATS_CHUNK 64
+#define ZK_STATS_CHUNKS 64
+
+typedef struct ZKStatsCounters {
+    uint64_t calls;
+    uint64_t timedCalls;
+    uint64_t latency[ZK_STATS_BUCKETS];
+} ZKStatsCounters;
+
+typedef struct ZKThreadStats {
+    struct ZKThreadStats *next;
+    BOOL inUse;
+    ZKStatsCounters *volatile chunks[ZK_STATS_CHUNKS];
+} ZKThreadStats;
+
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+// everything below is guarded by statsLock
+typedef struct ZKHookedMethod {
+    __unsafe_unretained Class cls;
+    SEL sel;
+} ZKHookedMethod;
+
+static ZKHookedMethod *hookedMethods;
+static unsigned int hookCount;
+static unsigned int hookCapacity;
+static ZKHookStats *baseline;
+static unsigned int baselineCount;
+static ZKThreadStats *threadStats;
+
+static pthread_key_t threadStatsKey;
+static pthread_once_t threadStatsOnce = PTHREAD_ONCE_INIT;
+static __thread ZKThreadStats *currentThreadStats;
+
+// The block must not be reachable from this thread anymore once another one can take it
+static void detachThreadStats(void *stats) {
+    currentThreadStats = NULL;
+    pthread_mutex_lock(&statsLock);
+    ((ZKThreadStats *)stats)->inUse = NO;
+    pthread_mutex_unlock(&statsLock);
+}
+
+static void createThreadStatsKey(void) {
+    pthread_key_create(&threadStatsKey, detachThreadStats);
+}
+
+static ZKThreadStats *attachThreadStats(void) {
+    pthread_once(&threadStatsOnce, createThreadStatsKey);
+    pthread_mutex_lock(&statsLock);
+    
+    ZKThreadStats *stats = threadStats;
+    while (stats != NULL && stats->inUse)
+        stats = stats->next;
+    
+    if (stats == NULL) {
+        stats = calloc(1, sizeof(ZKThreadStats));
+        if (stats == NULL) {
+            pthread_mutex_unlock(&statsLock);
+            return NULL;
+        }
+        
+        stats->next = threadStats;
+        threadStats = stats;
+    }
+    
+    stats->inUse = YES;
+    pthread_mutex_unlock(&statsLock);
+    
+    pthread_setspecific(threadStatsKey, stats);
+    currentThreadStats = stats;
+    return stats;
+}
+
+// The ZKOrig and ZKHookTimed() of one hook share their counters, and so do hooks of the same method
+static unsigned int siteIndex(ZKStatsSite *site, __unsafe_unretained id object, SEL sel, const char *info) {
+    unsigned int index = __atomic_load_n(&site->index, __ATOMIC_ACQUIRE);
+    if (index != 0)
+        return index - 1;
+    
+    Class cls = ZKHookTargetClass(object, info);
+    pthread_mutex_lock(&statsLock);
+    
+    for (index = 0; index < hookCount; index++) {
+        if (hookedMethods[index].cls == cls && sel_isEqual(hookedMethods[index].sel, sel))
+            break;
+    }
+    
+    if (index == hookCount) {
+        if (hookCount == hookCapacity) {
+            unsigned int capacity = hookCapacity == 0 ? 16 : hookCapacity * 2;
+            ZKHookedMethod *methods = realloc(hookedMethods, capacity * sizeof(ZKHookedMethod));
+            if (methods == NULL) {
+                pthread_mutex_unlock(&statsLock);
+                return UINT_MAX;
+            }
+            
+            hookedMethods = methods;
+            hookCapacity  = capacity;
+        }
+        
+        hookedMethods[hookCount++] = (ZKHookedMethod){ cls, sel };
+    }
+    
+    pthread_mutex_unlock(&statsLock);
+    __atomic_store_n(&site->index, index + 1, __ATOMIC_RELEASE);
+    return index;
+}
+
+static ZKStatsCounters *threadCounters(ZKStatsSite *site, __unsafe_unretained id object, SEL sel, const char *info) {
+    unsigned int index = siteIndex(site, object, sel, info);
+    if (index >= ZK_STATS_CHUNK * ZK_STATS_CHUNKS)
+        return NULL;
+    
+    ZKThreadStats *stats = currentThreadStats;
+    if (stats == NULL && (stats = attachThreadStats()) == NULL)
+        return NULL;
+    
+    ZKStatsCounters *chunk = __atomic_load_n(&stats->chunks[index / ZK_STATS_CHUNK], __ATOMIC_RELAXED);
+    if (chunk == NULL) {
+        chunk = calloc(ZK_STATS_CHUNK, sizeof(ZKStatsCounters));
+        if (chunk == NULL)
+            return NULL;
+        
+        __atomic_store_n(&stats->chunks[index / ZK_STATS_CHUNK], chunk, __ATOMIC_RELEASE);
+    }
+    
+    return &chunk[index % ZK_STATS_CHUNK];
+}
+
+// Only the owning thread writes, the atomics just keep snapshots from reading torn values
+static inline void bump(uint64_t *counter) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+void ZKStatsCountCall(ZKStatsSite *site, __unsafe_unretained id object, SEL sel, const char *info) {
+    ZKStatsCounters *counters = threadCounters(site, object, sel, info);
+    if (counters != NULL)
+        bump(&counters->calls);
+}
+
+ZKStatsTiming ZKStatsBeginTiming(ZKStatsSite *site, __unsafe_unretained id object, SEL sel, const char *info) {
+    return (ZKStatsTiming){ site, object, sel, info, now() };
+}
+
+void ZKStatsEndTiming(ZKStatsTiming *timing) {
+    uint64_t elapsed = now() - timing->start;
+    ZKStatsCounters *counters = threadCounters(timing->site, timing->object, timing->sel, timing->info);
+    if (counters == NULL)
+        return;
+    
+    unsigned int bucket = 63 - __builtin_clzll(elapsed | 1);
+    if (bucket >= ZK_STATS_BUCKETS)
+        bucket = ZK_STATS_BUCKETS - 1;
+    
+    bump(&counters->timedCalls);
+    bump(&counters->latency[bucket]);
+}
+
+// Must be called with statsLock held
+static ZKHookStats *sumThreadStats(void) {
+    ZKHookStats *sums = calloc(hookCount == 0 ? 1 : hookCount, sizeof(ZKHookStats));
+    if (sums == NULL)
+        return NULL;
+    
+    for (unsigned int i = 0; i < hookCount; i++) {
+        sums[i].cls = hookedMethods[i].cls;
+        sums[i].sel = hookedMethods[i].sel;
+    }
+    
+    for (ZKThreadStats *stats = threadStats; stats != NULL; stats = stats->next) {
+        for (unsigned int i = 0; i < hookCount; i++) {
+            ZKStatsCounters *chunk = __atomic_load_n(&stats->chunks[i / ZK_STATS_CHUNK], __ATOMIC_ACQUIRE);
+            if (chunk == NULL)
+                continue;
+            
+            ZKStatsCounters *counters = &chunk[i % ZK_STATS_CHUNK];
+            sums[i].calls      += __atomic_load_n(&counters->calls, __ATOMIC_RELAXED);
+            sums[i].timedCalls += __atomic_load_n(&counters->timedCalls, __ATOMIC_RELAXED);
+            for (unsigned int bucket = 0; bucket < ZK_STATS_BUCKETS; bucket++)
+                sums[i].latency[bucket] += __atomic_load_n(&counters->latency[bucket], __ATOMIC_RELAXED);
+        }
+    }
+    
+    return sums;
+}
+
+ZKHookStats *ZKHookStatsSnapshot(unsigned int *count) {
+    pthread_mutex_lock(&statsLock);
+    
+    ZKHookStats *snapshot = sumThreadStats();
+    if (snapshot == NULL) {
+        pthread_mutex_unlock(&statsLock);
+        *count = 0;
+        return NULL;
+    }
+    
+    for (unsigned int i = 0; i < baselineCount; i++) {
+        snapshot[i].calls      -= baseline[i].calls;
+        snapshot[i].timedCalls -= baseline[i].timedCalls;
+        for (unsigned int bucket = 0; bucket < ZK_STATS_BUCKETS; bucket++)
+            snapshot[i].latency[bucket] -= baseline[i].latency[bucket];
+    }
+    
+    *count = hookCount;
+    pthread_mutex_unlock(&statsLock);
+    return snapshot;
+}
+
+void ZKHookStatsReset(void) {
+    pthread_mutex_lock(&statsLock);
+    
+    ZKHookStats *sums = sumThreadStats();
+    if (sums != NULL) {
+        free(baseline);
+        baseline      = sums;
+        baselineCount = hookCount;
+    }
+    
+    pthread_mutex_unlock(&statsLock);
+}
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import <objc/runtime.h>
 #import <sys/cdefs.h>
+#import "ZKHookStats.h"
 
 // This is a class for streamlining swizzling. Simply create a new class of any name you want and
 // Example:
@@ -62,20 +63,48 @@
 #define ZKClass(CLASS) objc_getClass(#CLASS)
 
 // returns the value of an instance variable.
+// every use remembers the offset it found for each class, so the ivar list is searched once per class
 #if !__has_feature(objc_arc)
-#define ZKHookIvar(OBJECT, TYPE, NAME) (*(TYPE *)ZKIvarPointer(OBJECT, NAME))
+#define ZKHookIvar(OBJECT, TYPE, NAME) (*(TYPE *)_ZKCallSiteIvar(OBJECT, NAME))
 #else
 #define ZKHookIvar(OBJECT, TYPE, NAME) \
     _Pragma("clang diagnostic push") \
     _Pragma("clang diagnostic ignored \"-Wignored-attributes\"") \
-    (*(__unsafe_unretained TYPE *)ZKIvarPointer(OBJECT, NAME)) \
+    (*(__unsafe_unretained TYPE *)_ZKCallSiteIvar(OBJECT, NAME)) \
     _Pragma("clang diagnostic pop")
 #endif
+#define _ZKCallSiteIvar(OBJECT, NAME) ({ \
+        static ZKIvarSite _zk_ivar_site; \
+        _ZKIvarSitePointer(&_zk_ivar_site, OBJECT, NAME); \
+    })
 // returns the original implementation of the swizzled function or null or not found
-#define ZKOrig(TYPE, ...) ((TYPE (*)(id, SEL WRAP_LIST(__VA_ARGS__)))(ZKOriginalImplementation(self, _cmd, __PRETTY_FUNCTION__)))(self, _cmd, ##__VA_ARGS__)
+// every call site keeps its own cache so repeat calls skip the lookup entirely
+// with ZKSWIZZLE_STATS every call is also counted, see ZKHookStats.h
+#define ZKOrig(TYPE, ...) ((TYPE (*)(id, SEL WRAP_LIST(__VA_ARGS__)))(_ZKCallSiteOrig()))(self, _cmd, ##__VA_ARGS__)
+#define _ZKCallSiteOrig() ({ \
+        static ZKCallSite _zk_site; \
+        _ZKCallSiteStats(); \
+        ZKIMP _zk_bound = _ZKBoundImplementation(&_zk_site); \
+        _zk_bound != NULL ? _zk_bound : ZKCachedOriginalImplementation(&_zk_site, self, _cmd, __PRETTY_FUNCTION__); \
+    })
 
 // returns the original implementation of the superclass of the object swizzled
-#define ZKSuper(TYPE, ...) ((TYPE (*)(id, SEL WRAP_LIST(__VA_ARGS__)))(ZKSuperImplementation(self, _cmd, __PRETTY_FUNCTION__)))(self, _cmd, ##__VA_ARGS__)
+#define ZKSuper(TYPE, ...) ((TYPE (*)(id, SEL WRAP_LIST(__VA_ARGS__)))(_ZKCallSiteSuper()))(self, _cmd, ##__VA_ARGS__)
+#define _ZKCallSiteSuper() ({ \
+        static ZKCallSite _zk_site; \
+        ZKCachedSuperImplementation(&_zk_site, self, _cmd, __PRETTY_FUNCTION__); \
+    })
+
+// Interfaces don't get a +load, they leave a ZKHookDescriptor in a section of their own
+// which ZKSwizzle walks once when the image is loaded
+#if defined(__MACH__)
+#define ZK_HOOK_SEGMENT "__DATA"
+#define ZK_HOOK_SECTION "__zkhooks"
+#define ZK_HOOK_SECTION_ATTRIBUTE __attribute__((used, section(ZK_HOOK_SEGMENT "," ZK_HOOK_SECTION)))
+#else
+#define ZK_HOOK_SECTION "zkhooks"
+#define ZK_HOOK_SECTION_ATTRIBUTE __attribute__((used, section(ZK_HOOK_SECTION)))
+#endif
 
 #define _ZKSwizzleInterfaceConditionally(CLASS_NAME, TARGET_CLASS, SUPERCLASS, GROUP, IMMEDIATELY) \
     @interface _$ ## CLASS_NAME : SUPERCLASS @end \
@@ -83,22 +112,12 @@
     + (void)initialize {} \
     @end \
     @interface CLASS_NAME : _$ ## CLASS_NAME @end \
-    @implementation CLASS_NAME (ZKSWIZZLE) \
-    + (void)load { \
-        _$ZKRegisterInterface(self, #GROUP);\
-        if (IMMEDIATELY) { \
-            [self _ZK_unconditionallySwizzle]; \
-        } \
-    } \
-    + (void)_ZK_unconditionallySwizzle { \
-        ZKSwizzle(CLASS_NAME, TARGET_CLASS); \
-    } \
-@end
+    ZK_HOOK_SECTION_ATTRIBUTE \
+    static ZKHookDescriptor _ZKHookDescriptor_ ## CLASS_NAME = { #CLASS_NAME, #TARGET_CLASS, #GROUP, IMMEDIATELY };
 
 // Bootstraps your swizzling class so that it requires no setup
 // outside of this macro call
-// If you override +load you must call ZKSwizzle(CLASS_NAME, TARGET_CLASS)
-// yourself, otherwise the swizzling would not take place
+// The swizzling takes place before main() runs, +load is yours to use
 #define ZKSwizzleInterface(CLASS_NAME, TARGET_CLASS, SUPERCLASS) \
     _ZKSwizzleInterfaceConditionally(CLASS_NAME, TARGET_CLASS, SUPERCLASS, ZK_UNGROUPED, YES)
 
@@ -111,22 +130,115 @@ __BEGIN_DECLS
 // Make sure to cast this before you use it
 typedef id (*ZKIMP)(id, SEL, ...);
 
+// Emitted by the interface macros, one for every hook class in the image
+typedef struct ZKHookDescriptor {
+    const char *hookClass;
+    const char *targetClass;
+    const char *group;
+    BOOL immediately;
+} ZKHookDescriptor;
+
+// The original implementation captured by _ZKSwizzleBound for one hooked selector
+typedef struct ZKHookSlot {
+    ZKIMP original;
+    // Odd while the hook is in a chain, bumped whenever it's added or taken out
+    unsigned long generation;
+} ZKHookSlot;
+
+// Storage for the call site caches created by ZKOrig and ZKSuper. Must be zero initialized (i.e. static)
+typedef struct ZKCallSite {
+    void *volatile entries;
+    ZKHookSlot *volatile slot;
+    // of the slot when the call site was bound to it
+    unsigned long slotGeneration;
+} ZKCallSite;
+
+// Once a ZKOrig call site found its slot it never has to look anything up again, until the
+// source is unswizzled and the slot stops being the way to the original
+static inline ZKIMP _ZKBoundImplementation(ZKCallSite *site) {
+    ZKHookSlot *slot = __atomic_load_n(&site->slot, __ATOMIC_ACQUIRE);
+    if (slot == NULL || __atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) != __atomic_load_n(&site->slotGeneration, __ATOMIC_RELAXED))
+        return NULL;
+    return __atomic_load_n(&slot->original, __ATOMIC_RELAXED);
+}
+
 // returns a pointer to the instance variable "name" on the object
 void *ZKIvarPointer(id self, const char *name);
+
+// Storage for the offset caches created by ZKHookIvar. Must be zero initialized (i.e. static)
+typedef struct ZKIvarSiteEntry {
+    struct ZKIvarSiteEntry *next;
+    __unsafe_unretained Class cls;
+    ptrdiff_t offset;
+} ZKIvarSiteEntry;
+
+typedef struct ZKIvarSite {
+    ZKIvarSiteEntry *volatile entries;
+} ZKIvarSite;
+
+// same as ZKIvarPointer but remembers the offset for the object's class in site
+void *ZKCachedIvarPointer(ZKIvarSite *site, id self, const char *name);
+
+// The class resolved last sits at the front, so the common case is a compare and an add
+static inline void *_ZKIvarSitePointer(ZKIvarSite *site, id self, const char *name) {
+    ZKIvarSiteEntry *entry = __atomic_load_n(&site->entries, __ATOMIC_ACQUIRE);
+    if (entry != NULL && entry->cls == object_getClass(self))
+        return (char *)(__bridge void *)self + entry->offset;
+    
+    return ZKCachedIvarPointer(site, self, name);
+}
 // returns the original implementation of a method with selector "sel" of an object hooked by the methods below
 ZKIMP ZKOriginalImplementation(id self, SEL sel, const char *info);
+// same as above but remembers the result in site until the next swizzle is installed
+ZKIMP ZKCachedOriginalImplementation(ZKCallSite *site, id self, SEL sel, const char *info);
 // returns the implementation of a method with selector "sel" of the superclass of object
 ZKIMP ZKSuperImplementation(id object, SEL sel, const char *info);
+ZKIMP ZKCachedSuperImplementation(ZKCallSite *site, id object, SEL sel, const char *info);
+// the class the hook running as info on object went into, or its metaclass for class methods
+Class ZKHookTargetClass(id object, const char *info);
 
 // hooks all the implemented methods of source with destination
 // adds any methods that arent implemented on destination to destination that are implemented in source
 #define ZKSwizzle(src, dst) _ZKSwizzle(ZKClass(src), ZKClass(dst))
 BOOL _ZKSwizzle(Class src, Class dest);
 
+// Same as above, but instead of adding _ZK_old_ selectors the original implementations are captured
+// at install time so ZKOrig calls them directly. This is what ZKSwizzleInterface uses
+// Hooks on the same selector from every plugin in the process are chained, higher priorities run first
+#define ZKSwizzleBound(src, dst) _ZKSwizzleBound(ZKClass(src), ZKClass(dst))
+BOOL _ZKSwizzleBound(Class src, Class dest);
+#define ZKSwizzleBoundWithPriority(src, dst, PRIORITY) _ZKSwizzleBoundWithPriority(ZKClass(src), ZKClass(dst), PRIORITY)
+BOOL _ZKSwizzleBoundWithPriority(Class src, Class dest, int priority);
+
+// swizzles (including group swizzles) made on this thread between these two calls are only queued
+// the commit checks every type encoding before anything is touched and installs all of them or none
+// while a transaction is open the swizzle functions return YES, the commit tells whether it worked
+void ZKSwizzleBegin(void);
+BOOL ZKSwizzleCommit(void);
+
 #define ZKSwizzleGroup(NAME) _ZKSwizzleGroup(#NAME)
-void _$ZKRegisterInterface(Class cls, const char *groupName);
+// adds cls to a group by hand, it hooks the class named targetClass when the group is swizzled
+void _$ZKRegisterInterface(Class cls, const char *targetClass, const char *groupName);
 BOOL _ZKSwizzleGroup(const char *groupName);
 
+// puts back the original implementations of everything src hooked so it can be swizzled again later
+// methods that were only added to the destination stay, the runtime can't remove them
+#define ZKUnswizzle(src) _ZKUnswizzle(ZKClass(src))
+BOOL _ZKUnswizzle(Class src);
+
+#define ZKUnswizzleGroup(NAME) _ZKUnswizzleGroup(#NAME)
+BOOL _ZKUnswizzleGroup(const char *groupName);
+
+// hooks only this object with the instance methods of src by moving it to a generated subclass, like KVO does
+// ZKOrig and ZKSuper behave as if src was swizzled with the object's class. src can't also be used with ZKSwizzle
+// fails if something else, like KVO, already changed the object's class, so hook objects before they are observed
+#define ZKSwizzleInstance(OBJECT, src) _ZKSwizzleInstance(OBJECT, ZKClass(src))
+BOOL _ZKSwizzleInstance(id object, Class src);
+
+// moves the object back to its original class, fails if something else changed its class in the meantime
+#define ZKUnswizzleInstance(OBJECT, src) _ZKUnswizzleInstance(OBJECT, ZKClass(src))
+BOOL _ZKUnswizzleInstance(id object, Class src);
+
 // Calls above method with the superclass of source for desination
 #define ZKSwizzleClass(src) _ZKSwizzleClass(ZKClass(src))
 BOOL _ZKSwizzleClass(Class cls);
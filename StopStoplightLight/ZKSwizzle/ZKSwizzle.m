@@ -7,47 +7,223 @@
 //
 
 #import "ZKSwizzle.h"
-static NSMutableDictionary *classTable;
+#import "ZKHookChain.h"
+#import <pthread.h>
 
-@interface NSObject (ZKSwizzle)
-+ (void)_ZK_unconditionallySwizzle;
-@end
+#if defined(__MACH__)
+#import <mach-o/getsect.h>
+#import <mach-o/loader.h>
+#endif
+
+#if defined(__GNUSTEP_RUNTIME__)
+#import <objc/hooks.h>
+#endif
+
+/*
+ 
+ Hooks can fire on any thread, so everything ZKSwizzle looks up while dispatching is readable
+ without taking a lock. Writers (installs and group registration) are serialized by registryLock.
+ 
+ The class table maps a swizzle source to the class it was installed into. It is an immutable array
+ sorted by source pointer which is replaced wholesale on every install. Readers that don't hold the
+ lock count themselves in classTableReaders while they search, a replaced table is retired and freed
+ by the first install or unswizzle that finds no such reader. Bound slots and groups are append-only
+ lists whose nodes never change after being published.
+ 
+ */
+typedef struct ZKClassPair {
+    __unsafe_unretained Class source;
+    __unsafe_unretained Class destination;
+    BOOL bound;
+} ZKClassPair;
+
+typedef struct ZKClassTable {
+    // once it was replaced, the table retired before it
+    struct ZKClassTable *retired;
+    unsigned int count;
+    ZKClassPair pairs[];
+} ZKClassTable;
+
+static ZKClassTable *classTable;
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+// see readSwizzledDestination() and replaceClassTable()
+static unsigned long classTableReaders;
+static ZKClassTable *retiredTables;
+
+// Original implementations captured by _ZKSwizzleBound, see boundSlot()
+typedef struct ZKBoundSlot {
+    ZKHookSlot hook;
+    struct ZKBoundSlot *next;
+    __unsafe_unretained Class source;
+    SEL sel;
+} ZKBoundSlot;
+
+static ZKBoundSlot *boundSlots;
+
+static const ZKClassPair *swizzledPair(Class source) {
+    // Sequentially consistent with the reader count, see replaceClassTable()
+    ZKClassTable *table = __atomic_load_n(&classTable, __ATOMIC_SEQ_CST);
+    if (table == NULL)
+        return NULL;
+    
+    unsigned int low = 0, high = table->count;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        uintptr_t key = (uintptr_t)table->pairs[mid].source;
+        if (key == (uintptr_t)source)
+            return &table->pairs[mid];
+        if (key < (uintptr_t)source)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    
+    return NULL;
+}
+
+static Class swizzledDestination(Class source) {
+    const ZKClassPair *pair = swizzledPair(source);
+    return pair == NULL ? Nil : pair->destination;
+}
+
+// For callers that don't hold registryLock, the table stays allocated while they search it
+static Class readSwizzledDestination(Class source) {
+    __atomic_add_fetch(&classTableReaders, 1, __ATOMIC_SEQ_CST);
+    Class destination = swizzledDestination(source);
+    __atomic_sub_fetch(&classTableReaders, 1, __ATOMIC_RELEASE);
+    return destination;
+}
+
+// Must be called with registryLock held
+// A reader that counted itself after the new table was published can't load an old one, so once no
+// reader is counted every retired table can go. Otherwise they wait for a later install to find none
+static void replaceClassTable(ZKClassTable *newTable) {
+    ZKClassTable *old = classTable;
+    __atomic_store_n(&classTable, newTable, __ATOMIC_SEQ_CST);
+    if (old != NULL) {
+        old->retired  = retiredTables;
+        retiredTables = old;
+    }
+    
+    if (__atomic_load_n(&classTableReaders, __ATOMIC_SEQ_CST) != 0)
+        return;
+    
+    while (retiredTables != NULL) {
+        ZKClassTable *table = retiredTables;
+        retiredTables = table->retired;
+        free(table);
+    }
+}
+
+// Must be called with registryLock held
+static BOOL setSwizzledDestination(Class source, Class destination, BOOL bound) {
+    ZKClassTable *table = classTable;
+    unsigned int count = table == NULL ? 0 : table->count;
+    
+    ZKClassTable *newTable = malloc(sizeof(ZKClassTable) + (count + 1) * sizeof(ZKClassPair));
+    if (newTable == NULL)
+        return NO;
+    
+    unsigned int index = 0;
+    while (index < count && (uintptr_t)table->pairs[index].source < (uintptr_t)source)
+        index++;
+    
+    if (index > 0)
+        memcpy(newTable->pairs, table->pairs, index * sizeof(ZKClassPair));
+    newTable->pairs[index].source      = source;
+    newTable->pairs[index].destination = destination;
+    newTable->pairs[index].bound       = bound;
+    if (count > index)
+        memcpy(&newTable->pairs[index + 1], &table->pairs[index], (count - index) * sizeof(ZKClassPair));
+    newTable->count = count + 1;
+    
+    replaceClassTable(newTable);
+    return YES;
+}
+
+// Must be called with registryLock held
+static BOOL removeSwizzledDestination(Class source) {
+    ZKClassTable *table = classTable;
+    if (swizzledPair(source) == NULL)
+        return NO;
+    
+    ZKClassTable *newTable = malloc(sizeof(ZKClassTable) + (table->count - 1) * sizeof(ZKClassPair));
+    if (newTable == NULL)
+        return NO;
+    
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < table->count; i++) {
+        if (table->pairs[i].source != source)
+            newTable->pairs[count++] = table->pairs[i];
+    }
+    newTable->count = count;
+    
+    replaceClassTable(newTable);
+    return YES;
+}
 
 void *ZKIvarPointer(id self, const char *name) {
     Ivar ivar = class_getInstanceVariable(object_getClass(self), name);
     return ivar == NULL ? NULL : (__bridge void *)self + ivar_getOffset(ivar);
 }
 
+// An ivar keeps its offset in every subclass but subclasses can be laid out differently once the
+// superclass grew (non-fragile ivars), so offsets are remembered per class rather than per name.
+// Like call site entries these are never freed, there is one per class a ZKHookIvar ever saw
+void *ZKCachedIvarPointer(ZKIvarSite *site, id self, const char *name) {
+    if (self == nil)
+        return NULL;
+    
+    Class cls = object_getClass(self);
+    for (ZKIvarSiteEntry *entry = __atomic_load_n(&site->entries, __ATOMIC_ACQUIRE); entry != NULL; entry = entry->next) {
+        if (entry->cls == cls)
+            return (__bridge void *)self + entry->offset;
+    }
+    
+    Ivar ivar = class_getInstanceVariable(cls, name);
+    if (ivar == NULL)
+        return NULL;
+    
+    ZKIvarSiteEntry *entry = malloc(sizeof(ZKIvarSiteEntry));
+    if (entry != NULL) {
+        entry->cls    = cls;
+        entry->offset = ivar_getOffset(ivar);
+        
+        ZKIvarSiteEntry *head = __atomic_load_n(&site->entries, __ATOMIC_RELAXED);
+        do {
+            entry->next = head;
+        } while (!__atomic_compare_exchange_n(&site->entries, &head, entry, YES, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    
+    return (__bridge void *)self + ivar_getOffset(ivar);
+}
+
 static SEL destinationSelectorForSelector(SEL cmd, Class dst) {
     return NSSelectorFromString([@"_ZK_old_" stringByAppendingFormat:@"%s_%@", class_getName(dst), NSStringFromSelector(cmd)]);
 }
 
 static Class classFromInfo(const char *info) {
-    NSUInteger bracket_index = -1;
-    for (NSUInteger i = 0; i < strlen(info); i++) {
-        if (info[i] == '[') {
-            bracket_index = i;
-        }
-    }
-    bracket_index++;
-    
-    if (bracket_index == -1) {
+    // info looks like -[Class selector:] or +[Class selector:], the class name runs from the last bracket to the space
+    const char *start = strrchr(info, '[');
+    if (start == NULL) {
         [NSException raise:@"Failed to parse info" format:@"Couldn't find swizzle class for info: %s", info];
         return NULL;
     }
+    start++;
     
-    char after_bracket[255];
-    memcpy(after_bracket, &info[bracket_index], strlen(info) - bracket_index - 1);
-    
-    for (NSUInteger i = 0; i < strlen(info); i++) {
-        if (after_bracket[i] == ' ') {
-            after_bracket[i] = '\0';
-        }
-    }
+    size_t length = strcspn(start, " (]");
+    char name[length + 1];
+    memcpy(name, start, length);
+    name[length] = '\0';
 
-    return objc_getClass(after_bracket);
+    return objc_getClass(name);
 }
 
+static ZKHookSlot *boundSlotForInfo(const char *info, SEL sel);
+static BOOL slotLinked(ZKHookSlot *slot);
+static ZKIMP instanceOriginalImplementation(Class cls, Class source, SEL sel);
+static Class instanceStatedClass(Class cls, Class source);
+
 // takes __PRETTY_FUNCTION__ for info which gives the name of the swizzle source class
 /*
  
@@ -71,10 +247,22 @@ ZKIMP ZKOriginalImplementation(id self, SEL sel, const char *info) {
         return NULL;
     }
     
+    ZKHookSlot *slot = boundSlotForInfo(info, sel);
+    if (slot != NULL && slotLinked(slot))
+        return __atomic_load_n(&slot->original, __ATOMIC_ACQUIRE);
+    
+    ZKIMP instanceImplementation = instanceOriginalImplementation(dest, cls, sel);
+    if (instanceImplementation != NULL)
+        return instanceImplementation;
+    
     SEL destSel = destinationSelectorForSelector(sel, cls);
     
     Method method =  class_getInstanceMethod(dest, destSel);
     
+    // A hook that was unswizzled while it was running goes on with what came after it then
+    if (method == NULL && slot != NULL)
+        return __atomic_load_n(&slot->original, __ATOMIC_ACQUIRE);
+    
     if (method == NULL) {
         [NSException raise:@"Failed to retrieve method" format:@"Got null for the source class %@ with selector %@ (%@)", NSStringFromClass(cls), NSStringFromSelector(sel), NSStringFromSelector(destSel)];
         return NULL;
@@ -88,6 +276,219 @@ ZKIMP ZKOriginalImplementation(id self, SEL sel, const char *info) {
     return implementation;
 }
 
+/*
+ 
+ Each ZKOrig call site owns a ZKCallSite which holds a lock-free list of resolved implementations
+ keyed by the receiver's class and selector. Entries are tagged with the swizzle generation they
+ were resolved in, so installing another swizzle simply makes every existing entry miss. A stale
+ entry is resolved again in place: the writer that claims it clears the tag, stores the new
+ implementation and tags it with the new generation, and readers check the tag on both sides of
+ reading the implementation. Entries are never unlinked, so a call site keeps one per class and
+ selector it was called with, no matter how often something is swizzled.
+ 
+ */
+typedef struct ZKCallSiteEntry {
+    struct ZKCallSiteEntry *next;
+    __unsafe_unretained Class cls;
+    SEL sel;
+    ZKIMP implementation;
+    // 0 while a writer is updating the entry, generations start at 1
+    unsigned long generation;
+} ZKCallSiteEntry;
+
+// The generation lives in the hook chain registry so swizzles made by other copies of ZKSwizzle count too
+static void invalidateCallSites(void) {
+    ZKHookChainInvalidate();
+}
+
+static ZKCallSiteEntry *callSiteEntry(ZKCallSite *site, Class cls, SEL sel) {
+    ZKCallSiteEntry *entry = __atomic_load_n((ZKCallSiteEntry **)&site->entries, __ATOMIC_ACQUIRE);
+    while (entry != NULL && !(entry->cls == cls && entry->sel == sel))
+        entry = entry->next;
+    
+    return entry;
+}
+
+static ZKIMP callSiteLookup(ZKCallSite *site, Class cls, SEL sel, unsigned long generation) {
+    ZKCallSiteEntry *entry = callSiteEntry(site, cls, sel);
+    if (entry == NULL || __atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE) != generation)
+        return NULL;
+    
+    ZKIMP implementation = __atomic_load_n(&entry->implementation, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&entry->generation, __ATOMIC_RELAXED) == generation ? implementation : NULL;
+}
+
+static void callSiteInsert(ZKCallSite *site, Class cls, SEL sel, ZKIMP implementation, unsigned long generation) {
+    ZKCallSiteEntry *entry = callSiteEntry(site, cls, sel);
+    if (entry != NULL) {
+        // Losing the race to another writer, or to one with a newer generation, only costs a later miss
+        unsigned long tag = __atomic_load_n(&entry->generation, __ATOMIC_RELAXED);
+        if (tag == 0 || tag >= generation || !__atomic_compare_exchange_n(&entry->generation, &tag, 0, NO, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+        
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&entry->implementation, implementation, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->generation, generation, __ATOMIC_RELEASE);
+        return;
+    }
+    
+    entry = malloc(sizeof(ZKCallSiteEntry));
+    if (entry == NULL)
+        return;
+    
+    entry->cls            = cls;
+    entry->sel            = sel;
+    entry->implementation = implementation;
+    entry->generation     = generation;
+    
+    // Two threads missing at once may both add one, the later lookups find the newer
+    void *head = __atomic_load_n(&site->entries, __ATOMIC_RELAXED);
+    do {
+        entry->next = head;
+    } while (!__atomic_compare_exchange_n(&site->entries, &head, entry, YES, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static ZKIMP cachedImplementation(ZKCallSite *site, id object, SEL sel, const char *info, ZKIMP (*resolve)(ZKCallSite *, id, SEL, const char *)) {
+    // Read the generation before resolving so a swizzle racing with us leaves a stale entry behind, not a wrong one
+    unsigned long generation = ZKHookChainGeneration();
+    Class cls = object_getClass(object);
+    
+    ZKIMP implementation = callSiteLookup(site, cls, sel, generation);
+    if (implementation != NULL)
+        return implementation;
+    
+    implementation = resolve(site, object, sel, info);
+    if (implementation != NULL)
+        callSiteInsert(site, cls, sel, implementation, generation);
+    
+    return implementation;
+}
+
+/*
+ 
+ _ZKSwizzleBound doesn't add _ZK_old_ selectors, every hooked selector gets a slot owned by the
+ (source class, selector) pair instead which ZKHookChain keeps pointed at whatever runs after the
+ hook. Slots live for the life of the process so a call site can hold on to its slot once it found
+ it, after which ZKOrig is a load and an indirect call.
+ 
+ */
+static ZKHookSlot *boundSlot(Class source, SEL sel) {
+    ZKBoundSlot *slot = __atomic_load_n(&boundSlots, __ATOMIC_ACQUIRE);
+    while (slot != NULL && !(slot->source == source && sel_isEqual(slot->sel, sel)))
+        slot = slot->next;
+    
+    return slot == NULL ? NULL : &slot->hook;
+}
+
+// Must be called with registryLock held
+static ZKHookSlot *createBoundSlot(Class source, SEL sel) {
+    ZKHookSlot *existing = boundSlot(source, sel);
+    if (existing != NULL)
+        return existing;
+    
+    ZKBoundSlot *slot = calloc(1, sizeof(ZKBoundSlot));
+    if (slot == NULL)
+        return NULL;
+    
+    slot->source = source;
+    slot->sel    = sel;
+    slot->next   = boundSlots;
+    __atomic_store_n(&boundSlots, slot, __ATOMIC_RELEASE);
+    return &slot->hook;
+}
+
+/*
+ 
+ A hook class doesn't change once it's loaded, so the methods it hooks with are read into a table the
+ first time it is used. Installing, validating and removing it later walk that table instead of
+ copying the method list out of the runtime every time. The class and its metaclass each get one.
+ 
+ */
+typedef struct ZKHookMethod {
+    SEL sel;
+    IMP hook;
+    const char *types;
+} ZKHookMethod;
+
+typedef struct ZKHookManifest {
+    struct ZKHookManifest *next;
+    __unsafe_unretained Class source;
+    unsigned int count;
+    ZKHookMethod methods[];
+} ZKHookManifest;
+
+static ZKHookManifest *hookManifests;
+
+// Must be called with registryLock held
+static ZKHookManifest *hookManifest(Class source) {
+    for (ZKHookManifest *manifest = hookManifests; manifest != NULL; manifest = manifest->next) {
+        if (manifest->source == source)
+            return manifest;
+    }
+    
+    unsigned int methodCount;
+    Method *methodList = class_copyMethodList(source, &methodCount);
+    ZKHookManifest *manifest = malloc(sizeof(ZKHookManifest) + methodCount * sizeof(ZKHookMethod));
+    if (manifest == NULL) {
+        free(methodList);
+        NSLog(@"ZKSwizzle: out of memory reading the methods of %@", NSStringFromClass(source));
+        return NULL;
+    }
+    
+    manifest->source = source;
+    manifest->count  = 0;
+    for (unsigned int i = 0; i < methodCount; i++) {
+        SEL selector = method_getName(methodList[i]);
+        ZKHookMethod *method = &manifest->methods[manifest->count++];
+        method->sel   = selector;
+        method->hook  = method_getImplementation(methodList[i]);
+        method->types = method_getTypeEncoding(methodList[i]);
+    }
+    
+    free(methodList);
+    manifest->next = hookManifests;
+    hookManifests  = manifest;
+    return manifest;
+}
+
+static ZKHookSlot *boundSlotForInfo(const char *info, SEL sel) {
+    Class source = classFromInfo(info);
+    // Class methods were bound on the metaclass
+    if (info[0] == '+')
+        source = object_getClass(source);
+    
+    ZKHookSlot *slot = source == NULL ? NULL : boundSlot(source, sel);
+    return slot == NULL || __atomic_load_n(&slot->original, __ATOMIC_ACQUIRE) == NULL ? NULL : slot;
+}
+
+// Links and unlinks of a slot happen with registryLock held
+static BOOL slotLinked(ZKHookSlot *slot) {
+    return __atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) & 1;
+}
+
+static void setSlotLinked(ZKHookSlot *slot, BOOL linked) {
+    if (slotLinked(slot) != linked)
+        __atomic_add_fetch(&slot->generation, 1, __ATOMIC_RELEASE);
+}
+
+static ZKIMP resolveOriginal(ZKCallSite *site, id self, SEL sel, const char *info) {
+    // Bind the call site to the slot if the source is currently installed by _ZKSwizzleBound
+    ZKHookSlot *slot = (sel == NULL || info == NULL) ? NULL : boundSlotForInfo(info, sel);
+    unsigned long generation = slot == NULL ? 0 : __atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE);
+    if (generation & 1) {
+        __atomic_store_n(&site->slotGeneration, generation, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->slot, slot, __ATOMIC_RELEASE);
+        return __atomic_load_n(&slot->original, __ATOMIC_ACQUIRE);
+    }
+    
+    return ZKOriginalImplementation(self, sel, info);
+}
+
+ZKIMP ZKCachedOriginalImplementation(ZKCallSite *site, id self, SEL sel, const char *info) {
+    return cachedImplementation(site, self, sel, info, resolveOriginal);
+}
+
 ZKIMP ZKSuperImplementation(id object, SEL sel, const char *info) {
     if (sel == NULL || object == NULL) {
         [NSException raise:@"Invalid Arguments" format:@"One of self: %@, self: %@ is NULL", object, NSStringFromSelector(sel)];
@@ -112,9 +513,12 @@ ZKIMP ZKSuperImplementation(id object, SEL sel, const char *info) {
     if (sourceClass != NULL) {
         BOOL isClassMethod = class_isMetaClass(cls);
         // This was called from a swizzled method, get the class it was swizzled with
-        NSString *className = classTable[NSStringFromClass(sourceClass)];
-        if (className != NULL) {
-            cls = NSClassFromString(className);
+        Class destination = readSwizzledDestination(sourceClass);
+        // Objects hooked on their own pretend to be their original class
+        if (destination == Nil && !isClassMethod)
+            destination = instanceStatedClass(cls, sourceClass);
+        if (destination != Nil) {
+            cls = destination;
             // make sure we get a class method if we asked for one
             if (isClassMethod) {
                 cls = object_getClass(cls);
@@ -144,91 +548,602 @@ ZKIMP ZKSuperImplementation(id object, SEL sel, const char *info) {
     return implementation;
 }
 
-static BOOL enumerateMethods(Class, Class);
-BOOL _ZKSwizzle(Class src, Class dest) {
+// The source class is fixed for a call site and the metaclass flag follows from the receiver's class,
+// so keying on the receiver's class covers (source, metaclass, selector) and also the case where the
+// source was never swizzled and the answer depends on the receiver alone
+Class ZKHookTargetClass(id object, const char *info) {
+    Class source = classFromInfo(info);
+    if (source == Nil)
+        return Nil;
+    
+    Class target = readSwizzledDestination(source);
+    if (target == Nil)
+        target = instanceStatedClass(object_getClass(object), source);
+    // Hooks installed some other way count as themselves
+    if (target == Nil)
+        target = source;
+    
+    return info[0] == '+' ? object_getClass(target) : target;
+}
+
+static ZKIMP resolveSuper(ZKCallSite *site, id object, SEL sel, const char *info) {
+    return ZKSuperImplementation(object, sel, info);
+}
+
+ZKIMP ZKCachedSuperImplementation(ZKCallSite *site, id object, SEL sel, const char *info) {
+    return cachedImplementation(site, object, sel, info, resolveSuper);
+}
+
+static BOOL enumerateMethods(Class, Class, BOOL, int);
+static BOOL sourceHooksInstances(Class source);
+// Must be called with registryLock held
+static BOOL installSwizzle(Class src, Class dest, BOOL bound, int priority) {
+    BOOL success = enumerateMethods(dest, src, bound, priority);
+    // The above method only gets instance methods. Do the same method for the metaclass of the class
+    success     &= enumerateMethods(object_getClass(dest), object_getClass(src), bound, priority);
+    
+    success &= setSwizzledDestination(src, dest, bound);
+    return success;
+}
+
+static BOOL deferSwizzle(Class src, Class dest, BOOL bound, int priority);
+static BOOL swizzle(Class src, Class dest, BOOL bound, int priority) {
     if (dest == NULL)
         return NO;
     
-    NSString *destName = NSStringFromClass(dest);
-    if (!destName) {
-        return NO;
+    if (deferSwizzle(src, dest, bound, priority))
+        return YES;
+    
+    pthread_mutex_lock(&registryLock);
+    
+    Class existing = swizzledDestination(src);
+    if (existing == dest) {
+        pthread_mutex_unlock(&registryLock);
+        return YES;
     }
     
-    if (!classTable) {
-        classTable = [[NSMutableDictionary alloc] init];
+    if (existing != Nil) {
+        pthread_mutex_unlock(&registryLock);
+        [NSException raise:@"Invalid Argument"
+                    format:@"This source class (%@) was already swizzled with another, (%@)", NSStringFromClass(src), NSStringFromClass(existing)];
+        return NO;
     }
     
-    if ([classTable objectForKey:NSStringFromClass(src)]) {
+    if (sourceHooksInstances(src)) {
+        pthread_mutex_unlock(&registryLock);
         [NSException raise:@"Invalid Argument"
-                    format:@"This source class (%@) was already swizzled with another, (%@)", NSStringFromClass(src), classTable[NSStringFromClass(src)]];
+                    format:@"This source class (%@) is already used to hook single objects", NSStringFromClass(src)];
         return NO;
     }
     
-    BOOL success = enumerateMethods(dest, src);
-    // The above method only gets instance methods. Do the same method for the metaclass of the class
-    success     &= enumerateMethods(object_getClass(dest), object_getClass(src));
+    BOOL success = installSwizzle(src, dest, bound, priority);
+    invalidateCallSites();
     
-    [classTable setObject:destName forKey:NSStringFromClass(src)];
+    pthread_mutex_unlock(&registryLock);
     return success;
 }
 
+BOOL _ZKSwizzle(Class src, Class dest) {
+    return swizzle(src, dest, NO, 0);
+}
+
+BOOL _ZKSwizzleBound(Class src, Class dest) {
+    return swizzle(src, dest, YES, 0);
+}
+
+BOOL _ZKSwizzleBoundWithPriority(Class src, Class dest, int priority) {
+    return swizzle(src, dest, YES, priority);
+}
+
 BOOL _ZKSwizzleClass(Class cls) {
     return _ZKSwizzle(cls, [cls superclass]);
 }
 
-static BOOL enumerateMethods(Class destination, Class source) {
-#if OBJC_API_VERSION < 2
-    [NSException raise:@"Unsupported feature" format:@"ZKSwizzle is only available in objc 2.0"];
+/*
+ 
+ Unswizzling puts the original implementations back on every selector the source hooked and forgets
+ the source, so it can be swizzled again later. The objective-c runtime has no way of removing methods,
+ so methods that were only added to the destination and the _ZK_old_ selectors stay behind; the
+ latter are reused if the source is swizzled again. A selector somebody else hooked on top of us is
+ left alone, restoring it would throw their hook away.
+ 
+ */
+static BOOL restoreMethods(Class destination, Class source, BOOL bound) {
+    ZKHookManifest *manifest = hookManifest(source);
+    if (manifest == NULL)
+        return NO;
+    
+    BOOL success = YES;
+    for (unsigned int i = 0; i < manifest->count; i++) {
+        SEL selector = manifest->methods[i].sel;
+        IMP hook     = manifest->methods[i].hook;
+        
+        if (bound) {
+            ZKHookSlot *slot = boundSlot(source, selector);
+            if (slot != NULL && ZKHookChainRemove(destination, selector, slot))
+                setSlotLinked(slot, NO);
+            else if (slot != NULL)
+                success = NO;
+            continue;
+        }
+        
+        Method saved = class_getInstanceMethod(destination, destinationSelectorForSelector(selector, source));
+        if (saved == NULL)
+            continue;
+        
+        Method installed = class_getInstanceMethod(destination, selector);
+        if (installed == NULL || method_getImplementation(installed) != hook) {
+            NSLog(@"ZKSwizzle: %@ on %@ was hooked again after %@, leaving it in place", NSStringFromSelector(selector), NSStringFromClass(destination), NSStringFromClass(source));
+            success = NO;
+            continue;
+        }
+        
+        method_exchangeImplementations(installed, saved);
+    }
+    
+    return success;
+}
+
+// Must be called with registryLock held
+static BOOL uninstallSwizzle(Class src) {
+    const ZKClassPair *pair = swizzledPair(src);
+    if (pair == NULL)
+        return NO;
+    
+    Class dest = pair->destination;
+    BOOL success = restoreMethods(dest, src, pair->bound);
+    success     &= restoreMethods(object_getClass(dest), object_getClass(src), pair->bound);
+    
+    removeSwizzledDestination(src);
+    return success;
+}
+
+BOOL _ZKUnswizzle(Class src) {
+    pthread_mutex_lock(&registryLock);
+    
+    // Even a partial uninstall changed what some call sites resolve to
+    BOOL success = uninstallSwizzle(src);
+    invalidateCallSites();
+    
+    pthread_mutex_unlock(&registryLock);
+    return success;
+}
+
+/*
+ 
+ A transaction queues every swizzle made on its thread until it is committed. The commit checks the
+ type encodings of all of them before either class is touched, then installs them in one pass under
+ a single hold of registryLock and invalidates the call site caches once. If anything fails halfway
+ whatever was installed so far is undone, so a transaction installs everything or nothing.
+ 
+ */
+typedef struct ZKPendingSwizzle {
+    __unsafe_unretained Class source;
+    __unsafe_unretained Class destination;
+    BOOL bound;
+    int priority;
+    // already swizzled the same way, or queued twice
+    BOOL redundant;
+} ZKPendingSwizzle;
+
+typedef struct ZKSwizzleTransaction {
+    unsigned int depth;
+    // something couldn't be queued, the commit mustn't install only part of it
+    BOOL incomplete;
+    unsigned int count;
+    unsigned int capacity;
+    ZKPendingSwizzle *pending;
+} ZKSwizzleTransaction;
+
+static __thread ZKSwizzleTransaction *currentTransaction;
+
+static BOOL deferSwizzle(Class src, Class dest, BOOL bound, int priority) {
+    ZKSwizzleTransaction *transaction = currentTransaction;
+    if (transaction == NULL)
+        return NO;
+    
+    if (transaction->count == transaction->capacity) {
+        unsigned int capacity = transaction->capacity == 0 ? 8 : transaction->capacity * 2;
+        ZKPendingSwizzle *pending = realloc(transaction->pending, capacity * sizeof(ZKPendingSwizzle));
+        if (pending == NULL) {
+            transaction->incomplete = YES;
+            return YES;
+        }
+        transaction->pending  = pending;
+        transaction->capacity = capacity;
+    }
+    
+    transaction->pending[transaction->count++] = (ZKPendingSwizzle){ src, dest, bound, priority, NO };
+    return YES;
+}
+
+// Checks the type encoding of every selector source would hook without changing either class
+static BOOL validateMethods(Class destination, Class source) {
+    ZKHookManifest *manifest = hookManifest(source);
+    if (manifest == NULL)
+        return NO;
+    
+    BOOL valid = YES;
+    for (unsigned int i = 0; i < manifest->count; i++) {
+        SEL selector = manifest->methods[i].sel;
+        Method originalMethod = class_getInstanceMethod(destination, selector);
+        if (originalMethod == NULL)
+            continue;
+        
+        const char *originalType = method_getTypeEncoding(originalMethod);
+        const char *newType = manifest->methods[i].types;
+        if (strcmp(originalType, newType) != 0) {
+            NSLog(@"ZKSwizzle: incompatible type encoding for %@ in %@. (expected %s, got %s)", NSStringFromSelector(selector), NSStringFromClass(source), originalType, newType);
+            valid = NO;
+        }
+    }
+    
+    return valid;
+}
+
+// Must be called with registryLock held
+static BOOL validatePending(ZKSwizzleTransaction *transaction) {
+    BOOL valid = YES;
+    for (unsigned int i = 0; i < transaction->count; i++) {
+        ZKPendingSwizzle *pending = &transaction->pending[i];
+        
+        Class existing = swizzledDestination(pending->source);
+        for (unsigned int j = 0; j < i && existing == Nil; j++) {
+            if (transaction->pending[j].source == pending->source)
+                existing = transaction->pending[j].destination;
+        }
+        
+        if (existing == pending->destination) {
+            pending->redundant = YES;
+            continue;
+        }
+        
+        if (existing != Nil || sourceHooksInstances(pending->source)) {
+            NSLog(@"ZKSwizzle: %@ is already used to hook something other than %@", NSStringFromClass(pending->source), NSStringFromClass(pending->destination));
+            valid = NO;
+            continue;
+        }
+        
+        valid &= validateMethods(pending->destination, pending->source);
+        valid &= validateMethods(object_getClass(pending->destination), object_getClass(pending->source));
+    }
+    
+    return valid;
+}
+
+void ZKSwizzleBegin(void) {
+    if (currentTransaction == NULL)
+        currentTransaction = calloc(1, sizeof(ZKSwizzleTransaction));
+    
+    if (currentTransaction != NULL)
+        currentTransaction->depth++;
+}
+
+BOOL ZKSwizzleCommit(void) {
+    ZKSwizzleTransaction *transaction = currentTransaction;
+    if (transaction == NULL)
+        return NO;
+    
+    if (--transaction->depth > 0)
+        return YES;
+    currentTransaction = NULL;
+    
+    pthread_mutex_lock(&registryLock);
+    
+    BOOL success = !transaction->incomplete && validatePending(transaction);
+    if (success) {
+        unsigned int installed = 0;
+        for (; installed < transaction->count; installed++) {
+            ZKPendingSwizzle *pending = &transaction->pending[installed];
+            if (!pending->redundant && !installSwizzle(pending->source, pending->destination, pending->bound, pending->priority))
+                break;
+        }
+        
+        if (installed < transaction->count) {
+            success = NO;
+            // The one that failed may have gotten halfway, so it is undone too
+            for (unsigned int i = 0; i <= installed; i++) {
+                if (!transaction->pending[i].redundant)
+                    uninstallSwizzle(transaction->pending[i].source);
+            }
+        }
+        
+        invalidateCallSites();
+    }
+    
+    pthread_mutex_unlock(&registryLock);
+    
+    free(transaction->pending);
+    free(transaction);
+    return success;
+}
+
+/*
+ 
+ Hooking a single object works like KVO: the object's class is changed to a generated subclass of
+ its current class which carries the methods of the source, so every other instance keeps running
+ the untouched implementations. The generated class answers -class with the original class.
+ 
+ If somebody else already changed the object's class the object is refused. KVO does this the moment
+ an observer is added and shares its class between every observed object of a class, so hooks put
+ into it would reach all of them. A subclass of it doesn't work either: KVO's setters find what they
+ notify about through the object's class and KVO puts its own class back once the last observer is
+ gone. Hook the object before anybody observes it instead.
+ 
+ Each hooked class gets a record of the original implementations it replaced which ZKOrig reads. A
+ source class can be used to hook objects or to swizzle a class, not both.
+ 
+ */
+typedef struct ZKInstanceHook {
+    SEL sel;
+    ZKIMP original;
+} ZKInstanceHook;
+
+typedef struct ZKInstanceClass {
+    struct ZKInstanceClass *next;
+    __unsafe_unretained Class source;
+    // the generated subclass
+    __unsafe_unretained Class hookedClass;
+    // what -class answers for the hooked objects
+    __unsafe_unretained Class statedClass;
+    unsigned int hookCount;
+    ZKInstanceHook hooks[];
+} ZKInstanceClass;
+
+static ZKInstanceClass *instanceClasses;
+
+static ZKInstanceClass *instanceClassForClass(Class cls, Class source) {
+    for (; cls != Nil; cls = class_getSuperclass(cls)) {
+        for (ZKInstanceClass *record = __atomic_load_n(&instanceClasses, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+            if (record->hookedClass == cls && (source == Nil || record->source == source))
+                return record;
+        }
+    }
+    
+    return NULL;
+}
+
+// Whether cls itself is one of the generated subclasses
+static BOOL isInstanceClass(Class cls) {
+    for (ZKInstanceClass *record = __atomic_load_n(&instanceClasses, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        if (record->hookedClass == cls)
+            return YES;
+    }
+    
     return NO;
+}
+
+static BOOL sourceHooksInstances(Class source) {
+    for (ZKInstanceClass *record = __atomic_load_n(&instanceClasses, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        if (record->source == source)
+            return YES;
+    }
     
-#else
+    return NO;
+}
+
+static ZKIMP instanceOriginalImplementation(Class cls, Class source, SEL sel) {
+    ZKInstanceClass *record = instanceClassForClass(cls, source);
+    if (record == NULL)
+        return NULL;
+    
+    for (unsigned int i = 0; i < record->hookCount; i++) {
+        if (sel_isEqual(record->hooks[i].sel, sel))
+            return record->hooks[i].original;
+    }
+    
+    return NULL;
+}
+
+static Class instanceStatedClass(Class cls, Class source) {
+    ZKInstanceClass *record = instanceClassForClass(cls, source);
+    return record == NULL ? Nil : record->statedClass;
+}
+
+// Must be called with registryLock held, record has to be big enough for every method of source
+static BOOL installInstanceHooks(Class target, Class source, ZKInstanceClass *record) {
+    ZKHookManifest *manifest = hookManifest(source);
+    if (manifest == NULL)
+        return NO;
     
-    unsigned int methodCount;
-    Method *methodList = class_copyMethodList(source, &methodCount);
     BOOL success = YES;
-    for (int i = 0; i < methodCount; i++) {
-        Method method = methodList[i];
-        SEL selector  = method_getName(method);
-        NSString *methodName = NSStringFromSelector(selector);
+    for (unsigned int i = 0; i < manifest->count; i++) {
+        SEL selector   = manifest->methods[i].sel;
+        IMP hook       = manifest->methods[i].hook;
+        const char *newType = manifest->methods[i].types;
+        
+        Method originalMethod = class_getInstanceMethod(target, selector);
+        if (originalMethod == NULL) {
+            // Add any extra methods to the class but don't hook them
+            success &= class_addMethod(target, selector, hook, newType);
+            continue;
+        }
         
-        // Don't do anything with the unconditional swizzle
-        if (sel_isEqual(selector, @selector(_ZK_unconditionallySwizzle))) {
+        const char *originalType = method_getTypeEncoding(originalMethod);
+        if (strcmp(originalType, newType) != 0) {
+            NSLog(@"ZKSwizzle: incompatible type encoding for %@. (expected %s, got %s)", NSStringFromSelector(selector), originalType, newType);
+            success = NO;
             continue;
         }
         
+        IMP original = method_getImplementation(originalMethod);
+        if (original == hook)
+            continue;
+        
+        record->hooks[record->hookCount].sel      = selector;
+        record->hooks[record->hookCount].original = (ZKIMP)original;
+        record->hookCount++;
+        
+        if (!class_addMethod(target, selector, hook, originalType))
+            method_setImplementation(originalMethod, hook);
+    }
+    
+    return success;
+}
+
+BOOL _ZKSwizzleInstance(id object, Class src) {
+    if (object == nil || src == Nil)
+        return NO;
+    
+    pthread_mutex_lock(&registryLock);
+    
+    Class existing = swizzledDestination(src);
+    if (existing != Nil) {
+        pthread_mutex_unlock(&registryLock);
+        [NSException raise:@"Invalid Argument"
+                    format:@"This source class (%@) was already swizzled with %@", NSStringFromClass(src), NSStringFromClass(existing)];
+        return NO;
+    }
+    
+    Class current = object_getClass(object);
+    if (instanceClassForClass(current, src) != NULL) {
+        pthread_mutex_unlock(&registryLock);
+        return YES;
+    }
+    
+    // Reuse the subclass made for an earlier object of the same class
+    ZKInstanceClass *record = __atomic_load_n(&instanceClasses, __ATOMIC_ACQUIRE);
+    while (record != NULL && !(record->source == src && class_getSuperclass(record->hookedClass) == current))
+        record = record->next;
+    
+    if (record == NULL) {
+        // Somebody else made a class for this object, see above. Our own subclasses answer -class like theirs
+        Class stated = [object class];
+        if (current != stated && !isInstanceClass(current)) {
+            pthread_mutex_unlock(&registryLock);
+            NSLog(@"ZKSwizzle: can't hook an instance of %@ with %@, its class was changed to %@", NSStringFromClass(stated), NSStringFromClass(src), NSStringFromClass(current));
+            return NO;
+        }
+        
+        ZKHookManifest *manifest = hookManifest(src);
+        record = manifest == NULL ? NULL : calloc(1, sizeof(ZKInstanceClass) + manifest->count * sizeof(ZKInstanceHook));
+        if (record == NULL) {
+            pthread_mutex_unlock(&registryLock);
+            return NO;
+        }
+        
+        record->source      = src;
+        record->statedClass = stated;
+        
+        NSString *name = [NSString stringWithFormat:@"%s_ZKInstance_%s", class_getName(current), class_getName(src)];
+        Class subclass = objc_allocateClassPair(current, name.UTF8String, 0);
+        if (subclass == Nil) {
+            pthread_mutex_unlock(&registryLock);
+            free(record);
+            NSLog(@"ZKSwizzle: failed to create %@ to hook an instance of %@", name, NSStringFromClass(current));
+            return NO;
+        }
+        
+        Method classMethod = class_getInstanceMethod(current, @selector(class));
+        class_addMethod(subclass, @selector(class), imp_implementationWithBlock(^Class(id self) {
+            return stated;
+        }), method_getTypeEncoding(classMethod));
+        BOOL success = installInstanceHooks(subclass, src, record);
+        objc_registerClassPair(subclass);
+        record->hookedClass = subclass;
+        
+        // The record has to be visible before the first hook can run
+        record->next = instanceClasses;
+        __atomic_store_n(&instanceClasses, record, __ATOMIC_RELEASE);
+        invalidateCallSites();
+        
+        if (!success)
+            NSLog(@"ZKSwizzle: some methods of %@ could not be hooked on %@", NSStringFromClass(src), NSStringFromClass(record->hookedClass));
+    }
+    
+    object_setClass(object, record->hookedClass);
+    
+    pthread_mutex_unlock(&registryLock);
+    return YES;
+}
+
+BOOL _ZKUnswizzleInstance(id object, Class src) {
+    if (object == nil || src == Nil)
+        return NO;
+    
+    pthread_mutex_lock(&registryLock);
+    
+    // Only a subclass we made and that is still the object's class can be taken away again
+    ZKInstanceClass *record = instanceClassForClass(object_getClass(object), src);
+    BOOL success = record != NULL && object_getClass(object) == record->hookedClass;
+    if (success)
+        object_setClass(object, class_getSuperclass(record->hookedClass));
+    
+    pthread_mutex_unlock(&registryLock);
+    return success;
+}
+
+static BOOL enumerateMethods(Class destination, Class source, BOOL bound, int priority) {
+// The GNUstep runtime has the objc 2.0 functions used here but never defines OBJC_API_VERSION
+#if OBJC_API_VERSION < 2 && !defined(__GNUSTEP_RUNTIME__)
+    [NSException raise:@"Unsupported feature" format:@"ZKSwizzle is only available in objc 2.0"];
+    return NO;
+    
+#else
+    
+    ZKHookManifest *manifest = hookManifest(source);
+    if (manifest == NULL)
+        return NO;
+    
+    BOOL success = YES;
+    for (unsigned int i = 0; i < manifest->count; i++) {
+        ZKHookMethod *method = &manifest->methods[i];
+        SEL selector = method->sel;
+        
         // We only swizzle methods that are implemented
-        if (class_respondsToSelector(destination, selector)) {
-            Method originalMethod = class_getInstanceMethod(destination, selector);
-            
+        Method originalMethod = class_getInstanceMethod(destination, selector);
+        if (originalMethod != NULL) {
             const char *originalType = method_getTypeEncoding(originalMethod);
-            const char *newType = method_getTypeEncoding(method);
+            const char *newType = method->types;
             if (strcmp(originalType, newType) != 0) {
-                NSLog(@"ZKSwizzle: incompatible type encoding for %@. (expected %s, got %s)", methodName, originalType, newType);
+                NSLog(@"ZKSwizzle: incompatible type encoding for %@. (expected %s, got %s)", NSStringFromSelector(selector), originalType, newType);
                 // Incompatible type encoding
                 success = NO;
                 continue;
             }
             
+            // Added by an earlier swizzle of this source that was undone since, there is nothing to hook
+            if (method_getImplementation(originalMethod) == method->hook) {
+                continue;
+            }
+            
+            if (bound) {
+                // The chain points the slot at whatever runs after this hook before the hook can run
+                ZKHookSlot *slot = createBoundSlot(source, selector);
+                if (slot == NULL || !ZKHookChainInsert(destination, selector, originalType, method->hook, slot, priority)) {
+                    NSLog(@"ZKSwizzle: failed to hook %@ on class %@ with %@", NSStringFromSelector(selector), NSStringFromClass(destination), NSStringFromClass(source));
+                    success = NO;
+                    continue;
+                }
+                setSlotLinked(slot, YES);
+                continue;
+            }
+            
             // We are re-adding the destination selector because it could be on a superclass and not on the class itself. This method could fail
             class_addMethod(destination, selector, method_getImplementation(originalMethod), method_getTypeEncoding(originalMethod));
             
             SEL destSel = destinationSelectorForSelector(selector, source);
-            if (!class_addMethod(destination, destSel, method_getImplementation(method), method_getTypeEncoding(originalMethod))) {
-                NSLog(@"ZKSwizzle: failed to add method %@ onto class %@ with selector %@", NSStringFromSelector(selector), NSStringFromClass(source), NSStringFromSelector(destSel));
-                success = NO;
-                continue;
+            if (!class_addMethod(destination, destSel, method->hook, method_getTypeEncoding(originalMethod))) {
+                // An earlier swizzle that was undone left it behind, reuse it
+                Method leftover = class_getInstanceMethod(destination, destSel);
+                if (leftover == NULL) {
+                    NSLog(@"ZKSwizzle: failed to add method %@ onto class %@ with selector %@", NSStringFromSelector(selector), NSStringFromClass(source), NSStringFromSelector(destSel));
+                    success = NO;
+                    continue;
+                }
+                method_setImplementation(leftover, method->hook);
             }
             
             method_exchangeImplementations(class_getInstanceMethod(destination, selector), class_getInstanceMethod(destination, destSel));
         } else {
             // Add any extra methods to the class but don't swizzle them
-            success &= class_addMethod(destination, selector, method_getImplementation(method), method_getTypeEncoding(method));
+            success &= class_addMethod(destination, selector, method->hook, method->types);
         }
     }
     
     unsigned int propertyCount;
     objc_property_t *propertyList = class_copyPropertyList(source, &propertyCount);
-    for (int i = 0; i < propertyCount; i++) {
+    for (unsigned int i = 0; i < propertyCount; i++) {
         objc_property_t property = propertyList[i];
         const char *name = property_getName(property);
         unsigned int attributeCount;
@@ -244,48 +1159,182 @@ static BOOL enumerateMethods(Class destination, Class source) {
     }
     
     free(propertyList);
-    free(methodList);
     return success;
 #endif
 }
 
-// Options were to use a group class and traverse its subclasses
-// or to create a groups dictionary
-// This works because +load on NSObject is called before attribute((constructor))
-static NSMutableDictionary *groups = nil;
-void _$ZKRegisterInterface(Class cls, const char *groupName) {
-    if (!groups)
-        groups = [NSMutableDictionary dictionary];
+// The hook descriptors of the image this copy of ZKSwizzle is linked into, see ZK_HOOK_SECTION
+#if defined(__MACH__)
+extern const struct mach_header_64 __dso_handle;
+
+static ZKHookDescriptor *hookDescriptors(size_t *count) {
+    unsigned long size = 0;
+    uint8_t *data = getsectiondata(&__dso_handle, ZK_HOOK_SEGMENT, ZK_HOOK_SECTION, &size);
+    *count = data == NULL ? 0 : size / sizeof(ZKHookDescriptor);
+    return (ZKHookDescriptor *)data;
+}
+#else
+// The linker only defines these when something was put into the section
+extern ZKHookDescriptor __start_zkhooks[] __attribute__((weak, visibility("hidden")));
+extern ZKHookDescriptor __stop_zkhooks[] __attribute__((weak, visibility("hidden")));
+
+static ZKHookDescriptor *hookDescriptors(size_t *count) {
+    *count = __start_zkhooks == NULL ? 0 : (size_t)(__stop_zkhooks - __start_zkhooks);
+    return __start_zkhooks;
+}
+#endif
+
+// Returns NO if one of the classes isn't there (yet)
+static BOOL installImmediateHook(const ZKHookDescriptor *descriptor) {
+    Class hookClass   = objc_getClass(descriptor->hookClass);
+    Class targetClass = objc_getClass(descriptor->targetClass);
+    if (hookClass == Nil || targetClass == Nil)
+        return NO;
     
-    NSString *groupString = @(groupName);
-    NSMutableArray *groupList = groups[groupString];
-    if (!groupList) {
-        groupList = [NSMutableArray array];
-        groups[groupString] = groupList;
-    }
+    _ZKSwizzleBound(hookClass, targetClass);
+    return YES;
+}
+
+#if defined(__GNUSTEP_RUNTIME__)
+// On ELF nothing orders the constructor below against the runtime loading the classes of this image,
+// so hooks whose classes weren't there yet wait for libobjc2 to report them loaded. The list is filled
+// before the load callback is set and entries are claimed by swapping them with NULL, readers don't lock
+static ZKHookDescriptor **pendingHooks;
+static size_t pendingHookCount;
+static size_t pendingHooksLeft;
+static void (*previousLoadCallback)(Class cls, struct objc_category *category);
+
+static void installPendingHooks(void) {
+    if (__atomic_load_n(&pendingHooksLeft, __ATOMIC_ACQUIRE) == 0)
+        return;
     
-    [groupList addObject:NSStringFromClass(cls)];
+    for (size_t i = 0; i < pendingHookCount; i++) {
+        ZKHookDescriptor *descriptor = __atomic_load_n(&pendingHooks[i], __ATOMIC_ACQUIRE);
+        if (descriptor == NULL || objc_getClass(descriptor->hookClass) == Nil || objc_getClass(descriptor->targetClass) == Nil)
+            continue;
+        if (!__atomic_compare_exchange_n(&pendingHooks[i], &descriptor, NULL, NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+        
+        installImmediateHook(descriptor);
+        __atomic_sub_fetch(&pendingHooksLeft, 1, __ATOMIC_RELEASE);
+    }
 }
 
-BOOL _ZKSwizzleGroup(const char *groupName) {
-    NSArray *groupList = groups[@(groupName)];
-    if (!groupList) {
-        [NSException raise:@"Invalid Argument" format:@"ZKSwizzle: There is no group by the name of %s", groupName];
-        return NO;
+static void classLoaded(Class cls, struct objc_category *category) {
+    if (previousLoadCallback != NULL)
+        previousLoadCallback(cls, category);
+    installPendingHooks();
+}
+#endif
+
+// Installs the hooks that aren't in a group. This only touches the runtime, nothing from Foundation
+// is allocated unless something fails
+__attribute__((constructor))
+static void installImmediateHooks(void) {
+    size_t count;
+    ZKHookDescriptor *descriptors = hookDescriptors(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (!descriptors[i].immediately || installImmediateHook(&descriptors[i]))
+            continue;
+        
+#if defined(__GNUSTEP_RUNTIME__)
+        if (pendingHooks == NULL)
+            pendingHooks = calloc(count, sizeof(ZKHookDescriptor *));
+        if (pendingHooks != NULL) {
+            pendingHooks[pendingHookCount++] = &descriptors[i];
+            continue;
+        }
+#endif
+        NSLog(@"ZKSwizzle: can't find %s or %s to hook", descriptors[i].hookClass, descriptors[i].targetClass);
     }
     
+#if defined(__GNUSTEP_RUNTIME__)
+    if (pendingHookCount == 0)
+        return;
+    
+    __atomic_store_n(&pendingHooksLeft, pendingHookCount, __ATOMIC_RELEASE);
+    previousLoadCallback = _objc_load_callback;
+    _objc_load_callback = classLoaded;
+    // Classes loaded before the callback was set aren't reported again
+    installPendingHooks();
+#endif
+}
+
+// Interfaces that register themselves by hand with _$ZKRegisterInterface
+// Options were to use a group class and traverse its subclasses
+// or to create a groups list
+typedef struct ZKGroupMember {
+    struct ZKGroupMember *next;
+    const char *groupName;
+    const char *targetClass;
+    __unsafe_unretained Class cls;
+} ZKGroupMember;
+
+static ZKGroupMember *groups = NULL;
+static ZKGroupMember *lastGroupMember = NULL;
+
+void _$ZKRegisterInterface(Class cls, const char *targetClass, const char *groupName) {
+    ZKGroupMember *member = calloc(1, sizeof(ZKGroupMember));
+    if (member == NULL)
+        return;
+    
+    // The names usually come from the interface macros so they are string literals that live forever
+    member->groupName   = groupName;
+    member->targetClass = targetClass;
+    member->cls         = cls;
+    
+    // Append so groups are swizzled in the order they were registered
+    pthread_mutex_lock(&registryLock);
+    if (lastGroupMember == NULL)
+        __atomic_store_n(&groups, member, __ATOMIC_RELEASE);
+    else
+        __atomic_store_n(&lastGroupMember->next, member, __ATOMIC_RELEASE);
+    lastGroupMember = member;
+    pthread_mutex_unlock(&registryLock);
+}
+
+// Members are looked up by name when the group is swizzled, the target may come from an image loaded later
+static BOOL forEachGroupMember(const char *groupName, BOOL (^block)(Class cls, Class target)) {
+    BOOL found = NO;
     BOOL success = YES;
-    for (NSString *className in groupList) {
-        Class cls = NSClassFromString(className);
-        if (cls == NULL)
+    
+    size_t count;
+    ZKHookDescriptor *descriptors = hookDescriptors(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(descriptors[i].group, groupName) != 0)
             continue;
         
-        if (class_respondsToSelector(object_getClass(cls), @selector(_ZK_unconditionallySwizzle))) {
-            [cls _ZK_unconditionallySwizzle];
-        } else {
-            success = NO;
-        }
+        found = YES;
+        Class cls    = objc_getClass(descriptors[i].hookClass);
+        Class target = objc_getClass(descriptors[i].targetClass);
+        success &= cls != Nil && target != Nil && block(cls, target);
+    }
+    
+    for (ZKGroupMember *member = __atomic_load_n(&groups, __ATOMIC_ACQUIRE); member != NULL; member = __atomic_load_n(&member->next, __ATOMIC_ACQUIRE)) {
+        if (strcmp(member->groupName, groupName) != 0)
+            continue;
+        
+        found = YES;
+        Class target = objc_getClass(member->targetClass);
+        success &= target != Nil && block(member->cls, target);
+    }
+    
+    if (!found) {
+        [NSException raise:@"Invalid Argument" format:@"ZKSwizzle: There is no group by the name of %s", groupName];
+        return NO;
     }
     
     return success;
 }
+
+BOOL _ZKSwizzleGroup(const char *groupName) {
+    return forEachGroupMember(groupName, ^BOOL(Class cls, Class target) {
+        return _ZKSwizzleBound(cls, target);
+    });
+}
+
+BOOL _ZKUnswizzleGroup(const char *groupName) {
+    return forEachGroupMember(groupName, ^BOOL(Class cls, Class target) {
+        return _ZKUnswizzle(cls);
+    });
+}
@@ -0,0 +1,103 @@
+//
+//  Check.h
+//  StopStoplightLight tests
+//
+//  Just enough of a test harness for plain C: checks that count failures and benchmarks that print JSON or CSV.
+//
+
+#ifndef Check_h
+#define Check_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Where the sample configs are, the Makefile passes the absolute path
+#ifndef FIXTURE_DIR
+#define FIXTURE_DIR "configs"
+#endif
+
+static int checkFailures;
+static bool benchCSV;
+
+#define CHECK(CONDITION)                                                                          \
+    do {                                                                                          \
+        if (!(CONDITION)) {                                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #CONDITION);         \
+            checkFailures++;                                                                      \
+        }                                                                                         \
+    } while (0)
+
+#define CHECK_EQUAL(ACTUAL, EXPECTED)                                                             \
+    do {                                                                                          \
+        long long _actual = (long long)(ACTUAL), _expected = (long long)(EXPECTED);               \
+        if (_actual != _expected) {                                                               \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #ACTUAL,    \
+                    _actual, _expected);                                                          \
+            checkFailures++;                                                                      \
+        }                                                                                         \
+    } while (0)
+
+#define CHECK_STRING(ACTUAL, EXPECTED)                                                            \
+    do {                                                                                          \
+        const char *_actual = (ACTUAL), *_expected = (EXPECTED);                                  \
+        if (_actual == NULL || strcmp(_actual, _expected) != 0) {                                 \
+            fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__,         \
+                    #ACTUAL, _actual ? _actual : "(null)", _expected);                            \
+            checkFailures++;                                                                      \
+        }                                                                                         \
+    } while (0)
+
+// Runs a test function and names it if it failed
+#define RUN(TEST)                                                                                 \
+    do {                                                                                          \
+        int _before = checkFailures;                                                              \
+        TEST();                                                                                   \
+        if (checkFailures != _before)                                                             \
+            fprintf(stderr, "FAILED %s\n", #TEST);                                                \
+    } while (0)
+
+static inline int checkResult(void) {
+    return checkFailures == 0 ? 0 : 1;
+}
+
+// --bench runs the benchmarks instead of the tests, --csv next to it has them print CSV
+static inline bool benchRequested(int argc, char **argv) {
+    bool requested = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0)
+            requested = true;
+        else if (strcmp(argv[i], "--csv") == 0)
+            benchCSV = true;
+    }
+    return requested;
+}
+
+static inline uint64_t nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// One line per benchmark so results can be collected with grep or jq, or loaded into a spreadsheet
+static inline void benchReport(const char *name, uint64_t operations, uint64_t nanoseconds) {
+    static bool header;
+    double perOperation = operations ? (double)nanoseconds / (double)operations : 0.0;
+
+    if (!benchCSV) {
+        printf("{\"benchmark\": \"%s\", \"operations\": %" PRIu64 ", \"ns\": %" PRIu64 ", \"ns_per_op\": %.2f}\n",
+               name, operations, nanoseconds, perOperation);
+        return;
+    }
+
+    if (!header) {
+        printf("benchmark,operations,ns,ns_per_op\n");
+        header = true;
+    }
+    printf("%s,%" PRIu64 ",%" PRIu64 ",%.2f\n", name, operations, nanoseconds, perOperation);
+}
+
+#endif /* Check_h */
@@ -0,0 +1,216 @@
+//
+//  SSLBorderOpsTests.c
+//  StopStoplightLight tests
+//
+//  A config change touches only what changed, on every decorated window, in one transaction.
+//
+
+#include "Check.h"
+#include "SSLBorderOps.h"
+#include "SSLConfig.h"
+
+#define OP_COUNT 7
+
+// Stands in for a window with borders, counts what was done to its layers
+typedef struct MockWindow {
+    SSLBorderKind kind;
+    bool key;
+    int ops[OP_COUNT];
+} MockWindow;
+
+typedef struct MockApp {
+    MockWindow windows[16];
+    int windowCount;
+    int transactions;
+} MockApp;
+
+static int opIndex(uint32_t op) {
+    int index = 0;
+    while (op > 1) {
+        op >>= 1;
+        index++;
+    }
+    return index;
+}
+
+// What applyConfigChanges:config: does
+static void applyConfigChanges(MockApp *app, uint32_t changes) {
+    if (!(changes & SSLConfigChangeBorders))
+        return;
+
+    app->transactions++;
+    for (int i = 0; i < app->windowCount; i++) {
+        MockWindow *window = &app->windows[i];
+        uint32_t ops = SSLBorderOpsForChanges(changes, window->kind, window->key);
+        for (uint32_t op = 1; op < (1u << OP_COUNT); op <<= 1) {
+            if (ops & op)
+                window->ops[opIndex(op)]++;
+        }
+    }
+}
+
+static void resetOps(MockApp *app) {
+    app->transactions = 0;
+    for (int i = 0; i < app->windowCount; i++)
+        memset(app->windows[i].ops, 0, sizeof(app->windows[i].ops));
+}
+
+static int countOps(const MockApp *app, SSLBorderOp op) {
+    int count = 0;
+    for (int i = 0; i < app->windowCount; i++)
+        count += app->windows[i].ops[opIndex(op)];
+    return count;
+}
+
+static int countAllOps(const MockApp *app) {
+    int count = 0;
+    for (uint32_t op = 1; op < (1u << OP_COUNT); op <<= 1)
+        count += countOps(app, op);
+    return count;
+}
+
+// Four stroked windows, one of them key, two nine-slice windows, one key, and one without a border
+static void makeApp(MockApp *app) {
+    memset(app, 0, sizeof(MockApp));
+    const SSLBorderKind kinds[] = { SSLBorderKindStroked, SSLBorderKindStroked, SSLBorderKindStroked, SSLBorderKindStroked,
+                                    SSLBorderKindNineSlice, SSLBorderKindNineSlice, SSLBorderKindNone };
+    const bool key[] = { true, false, false, false, true, false, false };
+    for (int i = 0; i < 7; i++) {
+        app->windows[i].kind = kinds[i];
+        app->windows[i].key  = key[i];
+    }
+    app->windowCount = 7;
+}
+
+// Goes through SSLConfigDiff the way a reload does
+static uint32_t change(void (*edit)(SSLConfig *config)) {
+    SSLConfig old, current;
+    SSLConfigInitDefaults(&old);
+    old.outlineWindow.enabled = true;
+    current = old;
+    edit(&current);
+    return SSLConfigDiff(&old, &current);
+}
+
+static void editActiveColor(SSLConfig *config) { config->outlineWindow.activeColor ^= 0xFF00; }
+static void editInactiveColor(SSLConfig *config) { config->outlineWindow.inactiveColor ^= 0xFF00; }
+static void editWidth(SSLConfig *config) { config->outlineWindow.width += 1; }
+static void editRadius(SSLConfig *config) { config->outlineWindow.cornerRadius += 2; }
+static void editStyle(SSLConfig *config) { config->outlineWindow.style = config->outlineWindow.style == SSLBorderStyleStroked ? SSLBorderStyleNineSlice : SSLBorderStyleStroked; }
+static void editTitlebar(SSLConfig *config) { config->disableTitlebar = !config->disableTitlebar; }
+
+static void testActiveColorChange(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, change(editActiveColor));
+
+    CHECK_EQUAL(app.transactions, 1);
+    // Every stroked border's border layer, the key window's outline and the key nine-slice image
+    CHECK_EQUAL(countOps(&app, SSLBorderOpBorderColor), 4);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpOutlineColor), 1);
+    CHECK_EQUAL(app.windows[0].ops[opIndex(SSLBorderOpOutlineColor)], 1);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpSliceImage), 1);
+    CHECK_EQUAL(app.windows[4].ops[opIndex(SSLBorderOpSliceImage)], 1);
+    CHECK_EQUAL(countAllOps(&app), 6);
+}
+
+static void testInactiveColorChange(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, change(editInactiveColor));
+
+    CHECK_EQUAL(app.transactions, 1);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpOutlineColor), 3);
+    CHECK_EQUAL(app.windows[0].ops[opIndex(SSLBorderOpOutlineColor)], 0);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpSliceImage), 1);
+    CHECK_EQUAL(app.windows[5].ops[opIndex(SSLBorderOpSliceImage)], 1);
+    CHECK_EQUAL(countAllOps(&app), 4);
+}
+
+static void testWidthChange(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, change(editWidth));
+
+    CHECK_EQUAL(countOps(&app, SSLBorderOpLineWidth), 4);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpSliceImage), 2);
+    CHECK_EQUAL(countAllOps(&app), 6);
+}
+
+static void testRadiusChange(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, change(editRadius));
+
+    CHECK_EQUAL(countOps(&app, SSLBorderOpClip), 6);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpPath), 4);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpSliceImage), 2);
+    CHECK_EQUAL(countAllOps(&app), 12);
+}
+
+static void testStyleChangeRebuilds(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, change(editStyle));
+
+    CHECK_EQUAL(countOps(&app, SSLBorderOpRebuild), 6);
+    CHECK_EQUAL(countAllOps(&app), 6);
+
+    // A rebuild with a new radius clips again too, and does nothing else
+    resetOps(&app);
+    applyConfigChanges(&app, SSLConfigChangeBorderStyle | SSLConfigChangeCornerRadius | SSLConfigChangeBorderWidth);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpRebuild), 6);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpClip), 6);
+    CHECK_EQUAL(countAllOps(&app), 12);
+}
+
+static void testUnrelatedChangesDoNothing(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, change(editTitlebar));
+    applyConfigChanges(&app, SSLConfigChangeNone);
+    CHECK_EQUAL(app.transactions, 0);
+    CHECK_EQUAL(countAllOps(&app), 0);
+}
+
+static void testCombinedChangeIsOneTransaction(void) {
+    MockApp app;
+    makeApp(&app);
+    applyConfigChanges(&app, SSLConfigChangeActiveColor | SSLConfigChangeInactiveColor | SSLConfigChangeBorderWidth);
+
+    CHECK_EQUAL(app.transactions, 1);
+    // Each window's image is redone once however much changed
+    CHECK_EQUAL(countOps(&app, SSLBorderOpSliceImage), 2);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpOutlineColor), 4);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpBorderColor), 4);
+    CHECK_EQUAL(countOps(&app, SSLBorderOpLineWidth), 4);
+    CHECK_EQUAL(app.windows[6].ops[opIndex(SSLBorderOpLineWidth)], 0);
+}
+
+// Benchmarks
+
+static void benchOps(void) {
+    const uint64_t iterations = 10000000;
+    volatile uint32_t sink = 0;
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++)
+        sink = SSLBorderOpsForChanges((uint32_t)i & 0x3F, (SSLBorderKind)(i % 3), i & 1);
+    benchReport("border_ops_for_changes", iterations, nowNanoseconds() - start);
+    (void)sink;
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchOps();
+        return 0;
+    }
+
+    RUN(testActiveColorChange);
+    RUN(testInactiveColorChange);
+    RUN(testWidthChange);
+    RUN(testRadiusChange);
+    RUN(testStyleChangeRebuilds);
+    RUN(testUnrelatedChangesDoNothing);
+    RUN(testCombinedChangeIsOneTransaction);
+    return checkResult();
+}
@@ -0,0 +1,165 @@
+//
+//  SSLClipTests.c
+//  StopStoplightLight tests
+//
+//  SSLClipChoose on mock layer trees.
+//
+
+#include "Check.h"
+#include "SSLClip.h"
+#include <stdlib.h>
+
+typedef struct MockLayer {
+    double cornerRadius;
+    bool hostsRemoteContent;
+    size_t sublayerCount;
+    struct MockLayer **sublayers;
+} MockLayer;
+
+static size_t infoCalls;
+
+static void mockInfo(const void *layer, SSLClipLayerInfo *info) {
+    const MockLayer *mock = layer;
+    info->cornerRadius       = mock->cornerRadius;
+    info->hostsRemoteContent = mock->hostsRemoteContent;
+    infoCalls++;
+}
+
+static size_t mockSublayerCount(const void *layer) {
+    return ((const MockLayer *)layer)->sublayerCount;
+}
+
+static const void *mockSublayer(const void *layer, size_t index) {
+    return ((const MockLayer *)layer)->sublayers[index];
+}
+
+static const SSLClipTree mockTree = { mockInfo, mockSublayerCount, mockSublayer };
+
+static const SSLClipWindow roundedWindow = { .cornerRadius = 10, .fullScreen = false };
+
+static void testNothingToRound(void) {
+    MockLayer content = { 0 };
+    SSLClipWindow square = { .cornerRadius = 0 };
+    CHECK_EQUAL(SSLClipChoose(&square, &mockTree, &content), SSLClipModeNone);
+
+    SSLClipWindow fullScreen = { .cornerRadius = 10, .fullScreen = true };
+    CHECK_EQUAL(SSLClipChoose(&fullScreen, &mockTree, &content), SSLClipModeNone);
+}
+
+static void testPlainTreeUsesCornerRadius(void) {
+    MockLayer leaf1 = { 0 }, leaf2 = { .cornerRadius = 4 };
+    MockLayer *children[] = { &leaf1, &leaf2 };
+    MockLayer content = { .sublayerCount = 2, .sublayers = children };
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, &content), SSLClipModeCornerRadius);
+
+    // A content layer already rounded by the same radius, e.g. by an earlier choice, is fine
+    content.cornerRadius = 10;
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, &content), SSLClipModeCornerRadius);
+}
+
+static void testForeignContentRadiusUsesMask(void) {
+    MockLayer content = { .cornerRadius = 6 };
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, &content), SSLClipModeShapeMask);
+}
+
+static void testRemoteContentUsesMask(void) {
+    MockLayer host = { .hostsRemoteContent = true };
+    MockLayer *grandchildren[] = { &host };
+    MockLayer middle = { .sublayerCount = 1, .sublayers = grandchildren };
+    MockLayer *children[] = { &middle };
+    MockLayer content = { .sublayerCount = 1, .sublayers = children };
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, &content), SSLClipModeShapeMask);
+}
+
+// A chain of count layers below content, all with nothing special about them
+static MockLayer *makeChain(size_t count) {
+    MockLayer *layers = calloc(count + 1, sizeof(MockLayer));
+    MockLayer **links = calloc(count, sizeof(MockLayer *));
+    for (size_t i = 0; i < count; i++) {
+        links[i]                = &layers[i + 1];
+        layers[i].sublayerCount = 1;
+        layers[i].sublayers     = &links[i];
+    }
+    return layers;
+}
+
+static void freeChain(MockLayer *layers) {
+    free(layers[0].sublayers);
+    free(layers);
+}
+
+static void testLayerLimit(void) {
+    MockLayer *within = makeChain(SSL_CLIP_MAX_LAYERS - 1);
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, within), SSLClipModeCornerRadius);
+    freeChain(within);
+
+    MockLayer *beyond = makeChain(SSL_CLIP_MAX_LAYERS);
+    infoCalls = 0;
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, beyond), SSLClipModeShapeMask);
+    CHECK(infoCalls <= SSL_CLIP_MAX_LAYERS);
+    freeChain(beyond);
+
+    // Too many siblings to even put on the stack
+    MockLayer leaf = { 0 };
+    MockLayer *wide[SSL_CLIP_MAX_LAYERS + 1];
+    for (size_t i = 0; i < SSL_CLIP_MAX_LAYERS + 1; i++)
+        wide[i] = &leaf;
+    MockLayer content = { .sublayerCount = SSL_CLIP_MAX_LAYERS + 1, .sublayers = wide };
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, &content), SSLClipModeShapeMask);
+}
+
+static void testStopsAtFirstReason(void) {
+    MockLayer host = { .hostsRemoteContent = true }, leaf = { 0 };
+    MockLayer *children[] = { &leaf, &leaf, &host };
+    MockLayer content = { .sublayerCount = 3, .sublayers = children };
+    infoCalls = 0;
+    CHECK_EQUAL(SSLClipChoose(&roundedWindow, &mockTree, &content), SSLClipModeShapeMask);
+    // Depth first from the last sublayer, the host is the second layer looked at
+    CHECK_EQUAL(infoCalls, 2);
+}
+
+static void testModeNames(void) {
+    CHECK_STRING(SSLClipModeName(SSLClipModeNone), "none");
+    CHECK_STRING(SSLClipModeName(SSLClipModeCornerRadius), "cornerRadius");
+    CHECK_STRING(SSLClipModeName(SSLClipModeShapeMask), "shapeMask");
+}
+
+static void benchTypicalTree(void) {
+    // Roughly a window with a toolbar, a sidebar and a scroll view
+    MockLayer leaves[24] = { { 0 } };
+    MockLayer *leafLinks[24];
+    for (size_t i = 0; i < 24; i++)
+        leafLinks[i] = &leaves[i];
+    MockLayer groups[4] = {
+        { .sublayerCount = 6, .sublayers = &leafLinks[0] },
+        { .sublayerCount = 6, .sublayers = &leafLinks[6] },
+        { .sublayerCount = 6, .sublayers = &leafLinks[12] },
+        { .sublayerCount = 6, .sublayers = &leafLinks[18] },
+    };
+    MockLayer *groupLinks[] = { &groups[0], &groups[1], &groups[2], &groups[3] };
+    MockLayer content = { .sublayerCount = 4, .sublayers = groupLinks };
+
+    const uint64_t iterations = 200000;
+    volatile SSLClipMode mode = SSLClipModeNone;
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++)
+        mode = SSLClipChoose(&roundedWindow, &mockTree, &content);
+    benchReport("clip_choose_29_layers", iterations, nowNanoseconds() - start);
+    (void)mode;
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchTypicalTree();
+        return 0;
+    }
+
+    RUN(testNothingToRound);
+    RUN(testPlainTreeUsesCornerRadius);
+    RUN(testForeignContentRadiusUsesMask);
+    RUN(testRemoteContentUsesMask);
+    RUN(testLayerLimit);
+    RUN(testStopsAtFirstReason);
+    RUN(testModeNames);
+    return checkResult();
+}
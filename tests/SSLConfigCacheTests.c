@@ -0,0 +1,413 @@
+//
+//  SSLConfigCacheTests.c
+//  StopStoplightLight tests
+//
+//  Processes sharing one compiled config: torn reads, missed changes and racing writers.
+//
+
+#include "Check.h"
+#include "SSLConfigCache.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define READERS 200
+#define RACING_WRITERS 16
+#define WRITES 3000
+// Every this many writes another version of the plugin takes the file over
+#define SWAP_INTERVAL 250
+#define FINAL_WRITE INT64_MAX
+
+static char directory[64];
+static char cachePath[128];
+
+// Write n of the test, every field is derived from n so a torn read shows
+static void makeConfig(int64_t n, SSLConfig *config) {
+    SSLConfigInitDefaults(config);
+    config->outlineWindow.enabled       = true;
+    config->outlineWindow.cornerRadius  = (float)(n % 1000);
+    config->outlineWindow.width         = (float)(n % 1000);
+    config->outlineWindow.activeColor   = (uint32_t)n;
+    config->outlineWindow.inactiveColor = ~(uint32_t)n;
+    config->unknownCount                = (uint32_t)(n % SSL_CONFIG_MAX_UNKNOWN);
+    for (uint32_t i = 0; i < config->unknownCount; i++)
+        config->unknown[i] = (SSLConfigSpan){ (uint32_t)n, i };
+    snprintf(config->unknownText, sizeof(config->unknownText), "\"write\": %lld", (long long)n);
+}
+
+static bool consistent(const SSLConfig *config, int64_t sourceModified, int64_t sourceSize) {
+    SSLConfig expected;
+    makeConfig(sourceSize, &expected);
+    return sourceModified == sourceSize && memcmp(config, &expected, sizeof(SSLConfig)) == 0;
+}
+
+static bool writeConfig(SSLConfigCache *cache, int64_t n) {
+    SSLConfig config;
+    makeConfig(n, &config);
+    return SSLConfigCacheWrite(cache, &config, n, n);
+}
+
+/*
+
+ What a version with another layout does when it finds our file: under the shared writer lock it
+ retires it and renames its own into place, which our next write retires and replaces in turn.
+
+ */
+static void foreignWrite(void) {
+    char lockPath[160], temporary[160];
+    snprintf(lockPath, sizeof(lockPath), "%s.lock", cachePath);
+    snprintf(temporary, sizeof(temporary), "%s.foreign", cachePath);
+
+    int lock = open(lockPath, O_RDWR | O_CREAT, 0644);
+    flock(lock, LOCK_EX);
+
+    int fd = open(cachePath, O_RDWR);
+    if (fd >= 0) {
+        SSLConfigCacheHeader *header = mmap(NULL, sizeof(SSLConfigCacheHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (header != MAP_FAILED) {
+            __atomic_store_n(&header->epoch, SSL_CONFIG_CACHE_RETIRED, __ATOMIC_RELEASE);
+            munmap(header, sizeof(SSLConfigCacheHeader));
+        }
+        close(fd);
+    }
+
+    SSLConfigCacheHeader header = { .magic = SSL_CONFIG_CACHE_MAGIC, .epoch = 2, .format = SSL_CONFIG_CACHE_FORMAT + 1, .configSize = 16 };
+    char padding[16] = { 0 };
+    fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (write(fd, &header, sizeof(header)) != sizeof(header) || write(fd, padding, sizeof(padding)) != sizeof(padding))
+        checkFailures++;
+    close(fd);
+    rename(temporary, cachePath);
+
+    flock(lock, LOCK_UN);
+    close(lock);
+}
+
+static void makeDirectory(void) {
+    snprintf(directory, sizeof(directory), "/tmp/sslcache.XXXXXX");
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    snprintf(cachePath, sizeof(cachePath), "%s/config.sslcache", directory);
+}
+
+static void removeDirectory(void) {
+    char path[160];
+    unlink(cachePath);
+    snprintf(path, sizeof(path), "%s.lock", cachePath);
+    unlink(path);
+    rmdir(directory);
+}
+
+// Exit status of every child, 0 if all of them passed
+static int waitForChildren(pid_t *children, int count) {
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        int status = 0;
+        waitpid(children[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            if (failed++ < 5)
+                fprintf(stderr, "child %d failed with %d\n", i, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        }
+    }
+    return failed;
+}
+
+static void waitForBytes(int fd, int count) {
+    char byte;
+    for (int i = 0; i < count; i++) {
+        if (read(fd, &byte, 1) != 1)
+            break;
+    }
+}
+
+static void testOwnWriteIsNoChange(void) {
+    makeDirectory();
+
+    SSLConfigCache writer, other;
+    CHECK(SSLConfigCacheOpen(&writer, cachePath));
+    CHECK(writer.header == NULL);
+    CHECK(writeConfig(&writer, 1));
+    CHECK(writer.header != NULL);
+    CHECK(!SSLConfigCacheChanged(&writer));
+
+    CHECK(writeConfig(&writer, 2));
+    CHECK(!SSLConfigCacheChanged(&writer));
+
+    // Somebody else's write is a change until it was read
+    CHECK(SSLConfigCacheOpen(&other, cachePath));
+    CHECK(writeConfig(&other, 3));
+    CHECK(!SSLConfigCacheChanged(&other));
+    CHECK(SSLConfigCacheChanged(&writer));
+
+    SSLConfig config;
+    int64_t modified = 0, size = 0;
+    CHECK(SSLConfigCacheRead(&writer, &config, &modified, &size));
+    CHECK_EQUAL(size, 3);
+    CHECK(consistent(&config, modified, size));
+    CHECK(!SSLConfigCacheChanged(&writer));
+
+    SSLConfigCacheClose(&writer);
+    SSLConfigCacheClose(&other);
+    removeDirectory();
+}
+
+static void testReplacedFileIsNoticed(void) {
+    makeDirectory();
+
+    SSLConfigCache reader, writer;
+    SSLConfigCacheOpen(&writer, cachePath);
+    CHECK(writeConfig(&writer, 10));
+    SSLConfigCacheOpen(&reader, cachePath);
+    CHECK(reader.header != NULL);
+
+    SSLConfig config;
+    int64_t modified = 0, size = 0;
+    CHECK(SSLConfigCacheRead(&reader, &config, &modified, &size));
+
+    // Taken over by another version and back, the reader has to find the new file
+    foreignWrite();
+    CHECK(SSLConfigCacheChanged(&reader));
+    CHECK(!SSLConfigCacheRead(&reader, &config, &modified, &size));
+    CHECK(writeConfig(&writer, 11));
+    CHECK(SSLConfigCacheRead(&reader, &config, &modified, &size));
+    CHECK_EQUAL(size, 11);
+    CHECK(consistent(&config, modified, size));
+
+    SSLConfigCacheClose(&reader);
+    SSLConfigCacheClose(&writer);
+    removeDirectory();
+}
+
+// Waits for writes the way the plugin does, only reading again once the cache says it changed
+static int readUntilFinal(SSLConfigCache *cache, double seconds) {
+    uint64_t deadline = nowNanoseconds() + (uint64_t)(seconds * 1e9);
+    int64_t last = -1;
+    while (nowNanoseconds() < deadline) {
+        SSLConfig config;
+        int64_t modified, size;
+        if (SSLConfigCacheRead(cache, &config, &modified, &size)) {
+            if (!consistent(&config, modified, size))
+                return 2;
+            if (size < last)
+                return 3;
+            last = size;
+            if (size == FINAL_WRITE)
+                return 0;
+        }
+
+        while (cache->header != NULL && !SSLConfigCacheChanged(cache) && nowNanoseconds() < deadline)
+            usleep(200);
+    }
+    return 4;
+}
+
+static void testManyReadersOneWriter(void) {
+    makeDirectory();
+
+    SSLConfigCache writer;
+    SSLConfigCacheOpen(&writer, cachePath);
+    CHECK(writeConfig(&writer, 0));
+
+    int ready[2];
+    if (pipe(ready) != 0)
+        return;
+
+    pid_t children[READERS];
+    for (int i = 0; i < READERS; i++) {
+        children[i] = fork();
+        if (children[i] == 0) {
+            close(ready[0]);
+            SSLConfigCache cache;
+            SSLConfigCacheOpen(&cache, cachePath);
+            if (write(ready[1], "r", 1) != 1)
+                _exit(1);
+            _exit(readUntilFinal(&cache, 60));
+        }
+    }
+    close(ready[1]);
+    waitForBytes(ready[0], READERS);
+    close(ready[0]);
+
+    uint64_t start = nowNanoseconds();
+    int failedWrites = 0;
+    for (int64_t n = 1; n <= WRITES; n++) {
+        if (n % SWAP_INTERVAL == 0)
+            foreignWrite();
+        if (!writeConfig(&writer, n))
+            failedWrites++;
+    }
+    CHECK(writeConfig(&writer, FINAL_WRITE));
+    uint64_t elapsed = nowNanoseconds() - start;
+
+    CHECK_EQUAL(failedWrites, 0);
+    CHECK_EQUAL(waitForChildren(children, READERS), 0);
+    printf("  %d writes with %d readers took %.1f ms\n", WRITES, READERS, elapsed / 1e6);
+
+    SSLConfigCacheClose(&writer);
+    removeDirectory();
+}
+
+/*
+
+ Processes that all find no cache file write theirs at the same time. Every one of them has to
+ notice a write made afterwards, none may be left mapping a file nobody writes to anymore.
+
+ */
+static void testRacingCreation(void) {
+    for (int round = 0; round < 100; round++) {
+        makeDirectory();
+
+        int go[2], done[2], check[2];
+        if (pipe(go) != 0 || pipe(done) != 0 || pipe(check) != 0)
+            return;
+
+        pid_t children[RACING_WRITERS];
+        for (int i = 0; i < RACING_WRITERS; i++) {
+            children[i] = fork();
+            if (children[i] == 0) {
+                close(go[1]);
+                close(check[1]);
+                SSLConfigCache cache;
+                SSLConfigCacheOpen(&cache, cachePath);
+
+                // Everybody starts writing when the pipe closes
+                char byte;
+                if (read(go[0], &byte, 1) != 0)
+                    _exit(1);
+                if (!writeConfig(&cache, i + 1))
+                    _exit(5);
+                if (write(done[1], "d", 1) != 1)
+                    _exit(1);
+                close(done[1]);
+
+                if (read(check[0], &byte, 1) != 0)
+                    _exit(1);
+                _exit(readUntilFinal(&cache, 5));
+            }
+        }
+        close(go[0]);
+        close(done[1]);
+        close(check[0]);
+
+        close(go[1]);
+        waitForBytes(done[0], RACING_WRITERS);
+        close(done[0]);
+
+        SSLConfigCache parent;
+        SSLConfigCacheOpen(&parent, cachePath);
+        CHECK(writeConfig(&parent, FINAL_WRITE));
+        close(check[1]);
+
+        int failed = waitForChildren(children, RACING_WRITERS);
+        CHECK_EQUAL(failed, 0);
+
+        SSLConfigCacheClose(&parent);
+        removeDirectory();
+        if (failed)
+            break;
+    }
+}
+
+// Benchmarks
+
+static void benchReads(void) {
+    makeDirectory();
+    SSLConfigCache cache;
+    SSLConfigCacheOpen(&cache, cachePath);
+    writeConfig(&cache, 1);
+
+    const uint64_t iterations = 2000000;
+    volatile bool sink = false;
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++)
+        sink = SSLConfigCacheChanged(&cache);
+    benchReport("config_cache_changed", iterations, nowNanoseconds() - start);
+
+    SSLConfig config;
+    int64_t modified, size;
+    start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++)
+        sink = SSLConfigCacheRead(&cache, &config, &modified, &size);
+    benchReport("config_cache_read", iterations, nowNanoseconds() - start);
+
+    const uint64_t writes = 20000;
+    start = nowNanoseconds();
+    for (uint64_t i = 0; i < writes; i++)
+        writeConfig(&cache, (int64_t)i);
+    benchReport("config_cache_write", writes, nowNanoseconds() - start);
+    (void)sink;
+
+    SSLConfigCacheClose(&cache);
+    removeDirectory();
+}
+
+// What every live resize step needs from the config. Before the snapshot it read and parsed the file,
+// now it copies the snapshot under a lock and asks the cache whether another process compiled a newer one
+static void benchResizeEvents(void) {
+    static const char json[] = "{\"disableTitlebar\": true, \"outlineWindow\": {\"enabled\": true, \"cornerRadius\": 10, "
+                               "\"width\": 2, \"activeColor\": \"#8AADF4\", \"inactiveColor\": \"#494D64\"}}";
+    makeDirectory();
+    char configPath[160];
+    snprintf(configPath, sizeof(configPath), "%s/config.json", directory);
+    FILE *file = fopen(configPath, "wb");
+    fputs(json, file);
+    fclose(file);
+
+    const uint64_t events = 200000;
+    volatile float sink = 0;
+    SSLConfig config;
+    char text[sizeof(json)];
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < events; i++) {
+        file = fopen(configPath, "rb");
+        size_t length = fread(text, 1, sizeof(text), file);
+        fclose(file);
+        SSLConfigInitDefaults(&config);
+        SSLConfigParse(text, length, &config);
+        sink += config.outlineWindow.width;
+    }
+    benchReport("config_resize_event_from_disk", events, nowNanoseconds() - start);
+
+    SSLConfigCache cache;
+    SSLConfigCacheOpen(&cache, cachePath);
+    SSLConfigCacheWrite(&cache, &config, 1, 1);
+    SSLConfig snapshot = config;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    start = nowNanoseconds();
+    for (uint64_t i = 0; i < events; i++) {
+        pthread_mutex_lock(&lock);
+        config = snapshot;
+        pthread_mutex_unlock(&lock);
+        if (SSLConfigCacheChanged(&cache))
+            checkFailures++;
+        sink += config.outlineWindow.width;
+    }
+    benchReport("config_resize_event_snapshot", events, nowNanoseconds() - start);
+    (void)sink;
+
+    SSLConfigCacheClose(&cache);
+    unlink(configPath);
+    removeDirectory();
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchReads();
+        benchResizeEvents();
+        return 0;
+    }
+
+    RUN(testOwnWriteIsNoChange);
+    RUN(testReplacedFileIsNoticed);
+    RUN(testManyReadersOneWriter);
+    RUN(testRacingCreation);
+    return checkResult();
+}
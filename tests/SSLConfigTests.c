@@ -0,0 +1,383 @@
+//
+//  SSLConfigTests.c
+//  StopStoplightLight tests
+//
+//  Decoding the sample configs, what is kept of members the schema doesn't know, colors and parse throughput.
+//
+
+#include "Check.h"
+#include "SSLConfig.h"
+#include <stdlib.h>
+
+// Reads one of the files in FIXTURE_DIR
+static char *readConfig(const char *name, size_t *length) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", FIXTURE_DIR, name);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *json = malloc((size_t)size + 1);
+    *length = fread(json, 1, (size_t)size, file);
+    json[*length] = '\0';
+    fclose(file);
+    return json;
+}
+
+static bool parseFile(const char *name, SSLConfig *config, char **text) {
+    size_t length = 0;
+    char *json = readConfig(name, &length);
+    SSLConfigInitDefaults(config);
+    bool parsed = json != NULL && SSLConfigParse(json, length, config);
+    if (text != NULL)
+        *text = json;
+    else
+        free(json);
+    return parsed;
+}
+
+static bool parseString(const char *json, SSLConfig *config) {
+    SSLConfigInitDefaults(config);
+    return SSLConfigParse(json, strlen(json), config);
+}
+
+static void testDefaults(void) {
+    SSLConfig config;
+    SSLConfigInitDefaults(&config);
+    CHECK(!config.disableTrafficLights);
+    CHECK(!config.disableTitlebar);
+    CHECK(!config.disableWindowSizeConstraints);
+    CHECK(!config.outlineWindow.enabled);
+    CHECK_EQUAL(config.outlineWindow.style, SSLBorderStyleStroked);
+    CHECK(config.outlineWindow.width == 2.0f);
+    CHECK(config.outlineWindow.cornerRadius == 0.0f);
+    CHECK_EQUAL(config.outlineWindow.activeColor, 0xFFFFFFFF);
+    CHECK_EQUAL(config.outlineWindow.inactiveColor, 0x555555FF);
+    CHECK_EQUAL(config.unknownCount, 0);
+}
+
+static void testMinimal(void) {
+    SSLConfig config, defaults;
+    CHECK(parseFile("minimal.json", &config, NULL));
+    SSLConfigInitDefaults(&defaults);
+    defaults.outlineWindow.enabled = true;
+    CHECK(memcmp(&config, &defaults, sizeof(SSLConfig)) == 0);
+}
+
+static void testFull(void) {
+    SSLConfig config;
+    CHECK(parseFile("full.json", &config, NULL));
+    CHECK(config.disableTrafficLights);
+    CHECK(config.disableTitlebar);
+    CHECK(!config.disableWindowSizeConstraints);
+    CHECK(config.outlineWindow.enabled);
+    CHECK_EQUAL(config.outlineWindow.style, SSLBorderStyleNineSlice);
+    CHECK(config.outlineWindow.cornerRadius == 10.5f);
+    CHECK(config.outlineWindow.width == 3.0f);
+    CHECK_EQUAL(config.outlineWindow.activeColor, 0xFF8800FF);
+    CHECK_EQUAL(config.outlineWindow.inactiveColor, 0x22334480);
+    CHECK_EQUAL(config.unknownCount, 0);
+}
+
+// Unknown members are kept exactly as written, nested ones only as part of the outermost
+static void testUnknownMembers(void) {
+    SSLConfig config;
+    CHECK(parseFile("macwmfx.json", &config, NULL));
+    CHECK(config.disableTitlebar);
+    CHECK(config.disableWindowSizeConstraints);
+    CHECK(config.outlineWindow.cornerRadius == 12.0f);
+    CHECK_EQUAL(config.outlineWindow.activeColor, 0x8AADF4FF);
+    CHECK_EQUAL(config.outlineWindow.inactiveColor, 0x494D64FF);
+
+    const char *expected[] = {
+        "\"windowShadow\": {\n        \"enabled\": false,\n        \"radius\": 20,\n        \"color\": \"#00000080\"\n    }",
+        "\"blur\": { \"enabled\": true, \"passes\": 2, \"radius\": 1e1 }",
+        "\"glow\": { \"enabled\": false }",
+        "\"blacklist\": [\"com.apple.finder\", \"com.apple.dock\", \"com.apple.Spotlight\"]",
+        "\"comment\": \"escaped \\\"quotes\\\" and é survive\"",
+    };
+    // The JSON is gone by now
+    CHECK_EQUAL(config.unknownCount, sizeof(expected) / sizeof(expected[0]));
+    for (uint32_t i = 0; i < config.unknownCount && i < sizeof(expected) / sizeof(expected[0]); i++) {
+        size_t length;
+        const char *member = SSLConfigUnknownMember(&config, i, &length);
+        CHECK_EQUAL(length, strlen(expected[i]));
+        CHECK(strncmp(member, expected[i], length) == 0);
+    }
+    CHECK(!config.unknownOverflow);
+}
+
+static void testUnknownOverflow(void) {
+    char json[4096] = "{";
+    for (int i = 0; i < SSL_CONFIG_MAX_UNKNOWN + 3; i++) {
+        char member[32];
+        snprintf(member, sizeof(member), "%s\"extra%d\": %d", i ? ", " : "", i, i);
+        strcat(json, member);
+    }
+    strcat(json, ", \"disableTitlebar\": true}");
+
+    SSLConfig config;
+    CHECK(parseString(json, &config));
+    CHECK_EQUAL(config.unknownCount, SSL_CONFIG_MAX_UNKNOWN);
+    CHECK(config.unknownOverflow);
+    // Members after the overflow are still decoded
+    CHECK(config.disableTitlebar);
+}
+
+static void testUnknownTextOverflow(void) {
+    // Three members of a bit over a third of the text each, the last one doesn't fit but a small one does
+    static char json[SSL_CONFIG_UNKNOWN_BYTES * 2];
+    size_t valueLength = SSL_CONFIG_UNKNOWN_BYTES / 3;
+    strcpy(json, "{");
+    for (int i = 0; i < 3; i++) {
+        snprintf(json + strlen(json), 16, "\"big%d\": \"", i);
+        memset(json + strlen(json), 'x', valueLength);
+        strcat(json, "\", ");
+    }
+    strcat(json, "\"small\": 1, \"disableTitlebar\": true}");
+
+    SSLConfig config;
+    CHECK(parseString(json, &config));
+    CHECK(config.unknownOverflow);
+    CHECK_EQUAL(config.unknownCount, 3);
+    CHECK(config.disableTitlebar);
+
+    size_t length;
+    const char *member = SSLConfigUnknownMember(&config, 2, &length);
+    CHECK_EQUAL(length, strlen("\"small\": 1"));
+    CHECK(strncmp(member, "\"small\": 1", length) == 0);
+}
+
+// Values of the wrong type keep the default, numbers count as booleans like in NSNumber
+static void testWrongTypes(void) {
+    SSLConfig config, defaults;
+    CHECK(parseFile("wrong-types.json", &config, NULL));
+    SSLConfigInitDefaults(&defaults);
+    CHECK(!config.disableTrafficLights);
+    CHECK(config.disableTitlebar);
+    CHECK(!config.outlineWindow.enabled);
+    CHECK(config.outlineWindow.cornerRadius == defaults.outlineWindow.cornerRadius);
+    CHECK(config.outlineWindow.width == defaults.outlineWindow.width);
+    CHECK_EQUAL(config.outlineWindow.activeColor, defaults.outlineWindow.activeColor);
+    CHECK_EQUAL(config.outlineWindow.inactiveColor, defaults.outlineWindow.inactiveColor);
+    CHECK_EQUAL(config.outlineWindow.style, defaults.outlineWindow.style);
+}
+
+static void testInvalidJSONLeavesConfigAlone(void) {
+    const char *invalid[] = {
+        "",
+        "[]",
+        "{",
+        "{\"disableTitlebar\": true",
+        "{\"disableTitlebar\": tru}",
+        "{\"disableTitlebar\": true,}",
+        "{\"a\": 01}",
+        "{\"a\": 1.}",
+        "{\"a\": \"\x01\"}",
+        "{\"a\": \"\\q\"}",
+        "{\"a\": [1 2]}",
+        "{} {}",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        SSLConfig config, before;
+        SSLConfigInitDefaults(&config);
+        config.outlineWindow.width = 7;
+        before = config;
+        if (SSLConfigParse(invalid[i], strlen(invalid[i]), &config)) {
+            fprintf(stderr, "parsed invalid JSON: %s\n", invalid[i]);
+            checkFailures++;
+        }
+        CHECK(memcmp(&config, &before, sizeof(SSLConfig)) == 0);
+    }
+}
+
+static void testDepthLimit(void) {
+    char json[512];
+    size_t length = 0;
+    json[length++] = '{';
+    const char *open = "\"a\": [";
+    for (int i = 0; i < 70; i++) {
+        memcpy(json + length, open, strlen(open));
+        length += strlen(open);
+    }
+    for (int i = 0; i < 70; i++)
+        json[length++] = ']';
+    json[length++] = '}';
+
+    SSLConfig config;
+    SSLConfigInitDefaults(&config);
+    CHECK(!SSLConfigParse(json, length, &config));
+}
+
+static void testDiff(void) {
+    SSLConfig old, current;
+    SSLConfigInitDefaults(&old);
+    current = old;
+    CHECK_EQUAL(SSLConfigDiff(&old, &current), SSLConfigChangeNone);
+
+    current.outlineWindow.activeColor = 0x112233FF;
+    current.outlineWindow.cornerRadius = 4;
+    CHECK_EQUAL(SSLConfigDiff(&old, &current), SSLConfigChangeActiveColor | SSLConfigChangeCornerRadius);
+
+    current = old;
+    current.outlineWindow.enabled = true;
+    current.outlineWindow.style = SSLBorderStyleNineSlice;
+    current.outlineWindow.width = 1;
+    current.outlineWindow.inactiveColor = 0;
+    uint32_t changes = SSLConfigDiff(&old, &current);
+    CHECK_EQUAL(changes, SSLConfigChangeFeatures | SSLConfigChangeBorderStyle | SSLConfigChangeBorderWidth | SSLConfigChangeInactiveColor);
+    CHECK((changes & ~SSLConfigChangeFeatures & ~SSLConfigChangeBorders) == 0);
+}
+
+static void testHexColors(void) {
+    struct {
+        const char *string;
+        uint32_t rgba;
+    } valid[] = {
+        { "#FFF", 0xFFFFFFFF },
+        { "F80", 0xFF8800FF },
+        { "#ff8800", 0xFF8800FF },
+        { "0x8AADF4", 0x8AADF4FF },
+        { "0X8aadf4", 0x8AADF4FF },
+        { "#12345678", 0x12345678 },
+        { "00000000", 0x00000000 },
+    };
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        uint32_t rgba = 0xDEADBEEF;
+        if (!SSLParseHexColor(valid[i].string, strlen(valid[i].string), &rgba)) {
+            fprintf(stderr, "didn't parse %s\n", valid[i].string);
+            checkFailures++;
+            continue;
+        }
+        CHECK_EQUAL(rgba, valid[i].rgba);
+    }
+
+    const char *invalid[] = { "", "#", "0x", "#FF", "#FFFF", "#12345", "#1234567", "#123456789", "#GG0000", "# FFFFFF", "#FF 000", "0x0x123", "red" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        uint32_t rgba = 0xDEADBEEF;
+        if (SSLParseHexColor(invalid[i], strlen(invalid[i]), &rgba)) {
+            fprintf(stderr, "parsed %s\n", invalid[i]);
+            checkFailures++;
+        }
+        CHECK_EQUAL(rgba, 0xDEADBEEF);
+    }
+
+    // Only length bytes are looked at
+    uint32_t rgba = 0;
+    CHECK(SSLParseHexColor("#ABCDEF99", 7, &rgba));
+    CHECK_EQUAL(rgba, 0xABCDEFFF);
+}
+
+// Benchmarks
+
+static void benchSampleConfigs(void) {
+    const char *names[] = { "minimal.json", "full.json", "macwmfx.json" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        size_t length = 0;
+        char *json = readConfig(names[i], &length);
+        if (json == NULL)
+            continue;
+
+        const uint64_t iterations = 200000;
+        SSLConfig config;
+        uint64_t start = nowNanoseconds();
+        for (uint64_t j = 0; j < iterations; j++) {
+            SSLConfigInitDefaults(&config);
+            SSLConfigParse(json, length, &config);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "config_parse_%s", names[i]);
+        benchReport(name, iterations, nowNanoseconds() - start);
+        free(json);
+    }
+}
+
+// About 4 MB of settings from other tools around the outline, most of it nested unknown members
+static char *generateLargeConfig(size_t *length) {
+    size_t capacity = 8 << 20, used = 0;
+    char *json = malloc(capacity);
+    used += (size_t)snprintf(json + used, capacity - used, "{\n  \"outlineWindow\": {\"enabled\": true, \"cornerRadius\": 10},\n");
+    for (int i = 0; used < (4u << 20); i++) {
+        used += (size_t)snprintf(json + used, capacity - used,
+                                 "  \"app%d\": {\"bundle\": \"com.example.app%d\", \"rules\": [{\"match\": \"title\\u0020%d\", "
+                                 "\"opacity\": 0.%d5, \"radius\": %de-1, \"colors\": [\"#%06X\", \"#%06X80\"], \"on\": %s}]},\n",
+                                 i, i, i, i % 10, i % 200, i & 0xFFFFFF, (i * 7) & 0xFFFFFF, i % 2 ? "true" : "null");
+    }
+    used += (size_t)snprintf(json + used, capacity - used, "  \"disableTitlebar\": true\n}\n");
+    *length = used;
+    return json;
+}
+
+static void benchLargeConfig(void) {
+    size_t length = 0;
+    char *json = generateLargeConfig(&length);
+
+    SSLConfig config;
+    SSLConfigInitDefaults(&config);
+    if (!SSLConfigParse(json, length, &config) || !config.disableTitlebar) {
+        fprintf(stderr, "the generated config didn't parse\n");
+        checkFailures++;
+    }
+
+    const uint64_t iterations = 20;
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++) {
+        SSLConfigInitDefaults(&config);
+        SSLConfigParse(json, length, &config);
+    }
+    uint64_t elapsed = nowNanoseconds() - start;
+    benchReport("config_parse_generated_4mb", iterations, elapsed);
+    // Not a row of its own, the CSV only has the columns benchReport() prints
+    if (!benchCSV)
+        printf("{\"benchmark\": \"config_parse_generated_4mb_throughput\", \"mb_per_s\": %.1f}\n",
+               (double)length * iterations / (1 << 20) / ((double)elapsed / 1e9));
+    free(json);
+}
+
+static void benchHexColors(void) {
+    const char *strings[] = { "#FFF", "#8AADF4", "0x22334480" };
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        const uint64_t iterations = 10000000;
+        size_t length = strlen(strings[i]);
+        volatile uint32_t sink = 0;
+        uint32_t rgba;
+        uint64_t start = nowNanoseconds();
+        for (uint64_t j = 0; j < iterations; j++) {
+            SSLParseHexColor(strings[i], length, &rgba);
+            sink += rgba;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "hex_color_%zu_chars", length);
+        benchReport(name, iterations, nowNanoseconds() - start);
+        (void)sink;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchSampleConfigs();
+        benchLargeConfig();
+        benchHexColors();
+        return checkResult();
+    }
+
+    RUN(testDefaults);
+    RUN(testMinimal);
+    RUN(testFull);
+    RUN(testUnknownMembers);
+    RUN(testUnknownOverflow);
+    RUN(testUnknownTextOverflow);
+    RUN(testWrongTypes);
+    RUN(testInvalidJSONLeavesConfigAlone);
+    RUN(testDepthLimit);
+    RUN(testDiff);
+    RUN(testHexColors);
+    return checkResult();
+}
@@ -0,0 +1,164 @@
+//
+//  SSLFeaturesTests.c
+//  StopStoplightLight tests
+//
+//  Only the groups of enabled features get installed, and windows are decorated in the old order.
+//
+
+#include "Check.h"
+#include "SSLFeatures.h"
+
+typedef struct InstallLog {
+    const char *groups[8];
+    size_t count;
+    const char *uninstalled[8];
+    size_t uninstallCount;
+    // install fails for this group, NULL for none
+    const char *failing;
+} InstallLog;
+
+static bool recordInstall(const char *group, void *context) {
+    InstallLog *log = context;
+    if (log->count < sizeof(log->groups) / sizeof(log->groups[0]))
+        log->groups[log->count++] = group;
+    return log->failing == NULL || strcmp(group, log->failing) != 0;
+}
+
+static void recordUninstall(const char *group, void *context) {
+    InstallLog *log = context;
+    if (log->uninstallCount < sizeof(log->uninstalled) / sizeof(log->uninstalled[0]))
+        log->uninstalled[log->uninstallCount++] = group;
+}
+
+static void testFeaturesFromConfig(void) {
+    SSLConfig config;
+    SSLConfigInitDefaults(&config);
+    config.disableTitlebar              = false;
+    config.disableTrafficLights         = false;
+    config.disableWindowSizeConstraints = false;
+    config.outlineWindow.enabled        = false;
+    CHECK_EQUAL(SSLFeaturesFromConfig(&config), 0);
+
+    config.disableTrafficLights  = true;
+    config.outlineWindow.enabled = true;
+    CHECK_EQUAL(SSLFeaturesFromConfig(&config), SSLFeatureTrafficLights | SSLFeatureWindowBorders);
+}
+
+static void testNothingEnabledInstallsNothing(void) {
+    InstallLog log = { 0 };
+    CHECK(SSLFeaturesInstall(0, recordInstall, &log));
+    CHECK_EQUAL(log.count, 0);
+}
+
+static void testDecorationOnlyFeatures(void) {
+    InstallLog log = { 0 };
+    CHECK(SSLFeaturesInstall(SSLFeatureTitlebar | SSLFeatureResizability, recordInstall, &log));
+    CHECK_EQUAL(log.count, 1);
+    CHECK_STRING(log.groups[0], SSL_FEATURE_DECORATION_GROUP);
+}
+
+static void testBordersBringTheirGroup(void) {
+    InstallLog log = { 0 };
+    CHECK(SSLFeaturesInstall(SSLFeatureWindowBorders, recordInstall, &log));
+    CHECK_EQUAL(log.count, 2);
+    CHECK_STRING(log.groups[0], SSL_FEATURE_DECORATION_GROUP);
+    CHECK_STRING(log.groups[1], "SSLWindowBordersGroup");
+}
+
+static void testEveryGroupAtMostOnce(void) {
+    InstallLog log = { 0 };
+    uint32_t all = SSLFeatureTitlebar | SSLFeatureTrafficLights | SSLFeatureResizability | SSLFeatureWindowBorders;
+    CHECK(SSLFeaturesInstall(all, recordInstall, &log));
+    for (size_t i = 0; i < log.count; i++) {
+        for (size_t j = i + 1; j < log.count; j++)
+            CHECK(strcmp(log.groups[i], log.groups[j]) != 0);
+    }
+}
+
+static void testInstallStopsAtFailure(void) {
+    InstallLog log = { .failing = SSL_FEATURE_DECORATION_GROUP };
+    CHECK(!SSLFeaturesInstall(SSLFeatureWindowBorders, recordInstall, &log));
+    CHECK_EQUAL(log.count, 1);
+}
+
+static void testSwitchOnlyTouchesFlippedGroups(void) {
+    InstallLog log = { 0 };
+    CHECK(SSLFeaturesSwitch(SSLFeatureTitlebar, SSLFeatureTitlebar | SSLFeatureWindowBorders, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.uninstallCount, 0);
+    CHECK_EQUAL(log.count, 1);
+    CHECK_STRING(log.groups[0], "SSLWindowBordersGroup");
+
+    log = (InstallLog){ 0 };
+    CHECK(SSLFeaturesSwitch(SSLFeatureTitlebar | SSLFeatureWindowBorders, SSLFeatureTrafficLights, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.count, 0);
+    CHECK_EQUAL(log.uninstallCount, 1);
+    CHECK_STRING(log.uninstalled[0], "SSLWindowBordersGroup");
+
+    log = (InstallLog){ 0 };
+    CHECK(SSLFeaturesSwitch(SSLFeatureTitlebar, SSLFeatureTrafficLights, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.count, 0);
+    CHECK_EQUAL(log.uninstallCount, 0);
+}
+
+static void testSwitchingEverythingOff(void) {
+    InstallLog log = { 0 };
+    CHECK(SSLFeaturesSwitch(SSLFeatureResizability | SSLFeatureWindowBorders, 0, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.count, 0);
+    CHECK_EQUAL(log.uninstallCount, 2);
+    CHECK_STRING(log.uninstalled[0], "SSLWindowBordersGroup");
+    CHECK_STRING(log.uninstalled[1], SSL_FEATURE_DECORATION_GROUP);
+
+    // and back on
+    log = (InstallLog){ 0 };
+    CHECK(SSLFeaturesSwitch(0, SSLFeatureResizability | SSLFeatureWindowBorders, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.uninstallCount, 0);
+    CHECK_EQUAL(log.count, 2);
+    CHECK_STRING(log.groups[0], SSL_FEATURE_DECORATION_GROUP);
+    CHECK_STRING(log.groups[1], "SSLWindowBordersGroup");
+}
+
+static void testSwitchStopsAtFailure(void) {
+    InstallLog log = { .failing = "SSLWindowBordersGroup" };
+    CHECK(!SSLFeaturesSwitch(SSLFeatureTitlebar, SSLFeatureTitlebar | SSLFeatureWindowBorders, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.count, 1);
+    CHECK_EQUAL(log.uninstallCount, 0);
+
+    log = (InstallLog){ .failing = SSL_FEATURE_DECORATION_GROUP };
+    CHECK(!SSLFeaturesSwitch(0, SSLFeatureWindowBorders, recordInstall, recordUninstall, &log));
+    CHECK_EQUAL(log.count, 1);
+    CHECK_EQUAL(log.uninstallCount, 0);
+}
+
+static void testDecoratorOrder(void) {
+    const char *decorators[4];
+    uint32_t all = SSLFeatureTitlebar | SSLFeatureTrafficLights | SSLFeatureResizability | SSLFeatureWindowBorders;
+    CHECK_EQUAL(SSLFeatureDecorators(all, decorators, 4), 4);
+    CHECK_STRING(decorators[0], "modifyTitlebarAppearance");
+    CHECK_STRING(decorators[1], "hideTrafficLights");
+    CHECK_STRING(decorators[2], "makeResizableToAnySize");
+    CHECK_STRING(decorators[3], "addWindowBorders");
+
+    CHECK_EQUAL(SSLFeatureDecorators(SSLFeatureWindowBorders | SSLFeatureTrafficLights, decorators, 4), 2);
+    CHECK_STRING(decorators[0], "hideTrafficLights");
+    CHECK_STRING(decorators[1], "addWindowBorders");
+
+    CHECK_EQUAL(SSLFeatureDecorators(all, decorators, 1), 1);
+    CHECK_EQUAL(SSLFeatureDecorators(0, decorators, 4), 0);
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv))
+        return 0;
+
+    RUN(testFeaturesFromConfig);
+    RUN(testNothingEnabledInstallsNothing);
+    RUN(testDecorationOnlyFeatures);
+    RUN(testBordersBringTheirGroup);
+    RUN(testEveryGroupAtMostOnce);
+    RUN(testInstallStopsAtFailure);
+    RUN(testSwitchOnlyTouchesFlippedGroups);
+    RUN(testSwitchingEverythingOff);
+    RUN(testSwitchStopsAtFailure);
+    RUN(testDecoratorOrder);
+    return checkResult();
+}
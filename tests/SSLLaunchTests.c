@@ -0,0 +1,357 @@
+//
+//  SSLLaunchTests.c
+//  StopStoplightLight tests
+//
+//  A headless launch: the config arrives late, windows shown before and after get decorated once.
+//
+
+#include "Check.h"
+#include "SSLLaunch.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_WINDOWS 8
+#define MAX_CALLS 32
+
+typedef struct MockWindow {
+    bool visible;
+    const char *calls[MAX_CALLS];
+    int callCount;
+} MockWindow;
+
+// What the app looks like to the plugin: its windows and whether the hooks are in
+typedef struct MockApp {
+    MockWindow windows[MAX_WINDOWS];
+    int windowCount;
+    bool hooked;
+    bool failInstall;
+    int installs;
+    int starts;
+    uint32_t installedFeatures;
+    bool bordersStarted;
+    SSLLaunch launch;
+} MockApp;
+
+// Runs the decorators of features, all of the decided ones for the makeKeyAndOrderFront: hook
+static void decorateWith(MockWindow *window, uint32_t features) {
+    const char *decorators[SSL_FEATURE_COUNT];
+    size_t count = SSLFeatureDecorators(features, decorators, SSL_FEATURE_COUNT);
+    for (size_t i = 0; i < count; i++) {
+        if (window->callCount < MAX_CALLS)
+            window->calls[window->callCount++] = decorators[i];
+    }
+}
+
+static void decorate(MockApp *app, MockWindow *window) {
+    decorateWith(window, app->launch.features);
+}
+
+// The makeKeyAndOrderFront: hook, only there once installed
+static MockWindow *showWindow(MockApp *app) {
+    MockWindow *window = &app->windows[app->windowCount++];
+    window->visible = true;
+    if (app->hooked)
+        decorate(app, window);
+    return window;
+}
+
+static bool install(uint32_t previous, uint32_t features, void *context) {
+    MockApp *app = context;
+    app->installs++;
+    // What was turned off is out either way
+    app->installedFeatures = previous & features;
+    app->hooked            = app->installedFeatures != 0;
+    if (app->failInstall)
+        return false;
+
+    app->hooked            = features != 0;
+    app->installedFeatures = features;
+    return true;
+}
+
+static void start(const SSLLaunch *launch, uint32_t previous, void *context) {
+    MockApp *app = context;
+    app->starts++;
+    app->bordersStarted = (launch->features & SSLFeatureWindowBorders) != 0;
+    for (int i = 0; i < app->windowCount; i++) {
+        if (app->windows[i].visible)
+            decorateWith(&app->windows[i], launch->features & ~previous);
+    }
+}
+
+static const SSLLaunchSteps steps = { install, start };
+
+// Parses one of the files in FIXTURE_DIR
+static void parseConfig(const char *name, SSLConfig *config) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", FIXTURE_DIR, name);
+
+    SSLConfigInitDefaults(config);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        checkFailures++;
+        fprintf(stderr, "can't open %s\n", path);
+        return;
+    }
+
+    char json[4096];
+    size_t length = fread(json, 1, sizeof(json), file);
+    fclose(file);
+    CHECK(SSLConfigParse(json, length, config));
+}
+
+static void checkDecoratedOnce(const MockWindow *window) {
+    // full.json turns on the titlebar, traffic lights and borders
+    CHECK_EQUAL(window->callCount, 3);
+    if (window->callCount == 3) {
+        CHECK_STRING(window->calls[0], "modifyTitlebarAppearance");
+        CHECK_STRING(window->calls[1], "hideTrafficLights");
+        CHECK_STRING(window->calls[2], "addWindowBorders");
+    }
+}
+
+static void testUndecidedIsAllOff(void) {
+    MockApp app = { 0 };
+    CHECK(!app.launch.decided);
+    CHECK_EQUAL(app.launch.features, 0);
+    CHECK_EQUAL(app.launch.decoratorCount, 0);
+
+    MockWindow *window = showWindow(&app);
+    CHECK_EQUAL(window->callCount, 0);
+}
+
+static void testDecideInstallsThenStarts(void) {
+    MockApp app = { 0 };
+    SSLConfig config;
+    parseConfig("full.json", &config);
+
+    MockWindow *early = showWindow(&app);
+    MockWindow *hidden = showWindow(&app);
+    hidden->visible = false;
+
+    uint32_t features = SSLLaunchDecide(&app.launch, &config, &steps, &app);
+    CHECK_EQUAL(features, SSLFeatureTitlebar | SSLFeatureTrafficLights | SSLFeatureWindowBorders);
+    CHECK_EQUAL(app.installedFeatures, features);
+    CHECK_EQUAL(app.installs, 1);
+    CHECK_EQUAL(app.starts, 1);
+    CHECK(app.launch.decided);
+    CHECK(app.bordersStarted);
+
+    // The window shown before was decorated by start, the one shown after by the hook
+    checkDecoratedOnce(early);
+    CHECK_EQUAL(hidden->callCount, 0);
+    checkDecoratedOnce(showWindow(&app));
+
+    // A config arriving later with the same features doesn't decide again
+    uint64_t cost = app.launch.costNanoseconds;
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), features);
+    CHECK_EQUAL(app.installs, 1);
+    CHECK_EQUAL(app.starts, 1);
+    CHECK_EQUAL(app.launch.costNanoseconds, cost);
+    checkDecoratedOnce(early);
+}
+
+static void testLaterConfigSwitchesFeatures(void) {
+    MockApp app = { 0 };
+    SSLConfig config;
+    parseConfig("full.json", &config);
+    SSLLaunchDecide(&app.launch, &config, &steps, &app);
+    MockWindow *early = showWindow(&app);
+    uint64_t cost = app.launch.costNanoseconds;
+
+    // Borders off: their hooks go, windows already shown aren't decorated again
+    config.outlineWindow.enabled = false;
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), SSLFeatureTitlebar | SSLFeatureTrafficLights);
+    CHECK_EQUAL(app.installedFeatures, SSLFeatureTitlebar | SSLFeatureTrafficLights);
+    CHECK_EQUAL(app.installs, 2);
+    CHECK_EQUAL(app.starts, 2);
+    CHECK(!app.bordersStarted);
+    CHECK_EQUAL(app.launch.decoratorCount, 2);
+    checkDecoratedOnce(early);
+    CHECK_EQUAL(showWindow(&app)->callCount, 2);
+
+    // Back on: only the borders are added to the windows shown meanwhile
+    config.outlineWindow.enabled = true;
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), SSLFeatureTitlebar | SSLFeatureTrafficLights | SSLFeatureWindowBorders);
+    CHECK(app.bordersStarted);
+    CHECK_EQUAL(early->callCount, 4);
+    CHECK_STRING(early->calls[3], "addWindowBorders");
+    checkDecoratedOnce(showWindow(&app));
+
+    // Everything off unhooks everything
+    SSLConfigInitDefaults(&config);
+    config.disableTitlebar              = false;
+    config.disableTrafficLights         = false;
+    config.disableWindowSizeConstraints = false;
+    config.outlineWindow.enabled        = false;
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), 0);
+    CHECK(!app.hooked);
+    CHECK_EQUAL(showWindow(&app)->callCount, 0);
+
+    // Only the launch counts toward the cost
+    CHECK_EQUAL(app.launch.costNanoseconds, cost);
+}
+
+static void testFailedSwitchKeepsWhatStayed(void) {
+    MockApp app = { 0 };
+    SSLConfig config;
+    parseConfig("full.json", &config);
+    config.outlineWindow.enabled = false;
+    SSLLaunchDecide(&app.launch, &config, &steps, &app);
+
+    // Borders in and traffic lights out, the borders don't make it
+    app.failInstall              = true;
+    config.outlineWindow.enabled = true;
+    config.disableTrafficLights  = false;
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), SSLFeatureTitlebar);
+    CHECK_EQUAL(app.installedFeatures, SSLFeatureTitlebar);
+    CHECK(!app.bordersStarted);
+    CHECK_EQUAL(app.launch.decoratorCount, 1);
+    CHECK_EQUAL(showWindow(&app)->callCount, 1);
+}
+
+static void testNothingEnabledHooksNothing(void) {
+    MockApp app = { 0 };
+    SSLConfig config;
+    SSLConfigInitDefaults(&config);
+    config.disableTitlebar              = false;
+    config.disableTrafficLights         = false;
+    config.disableWindowSizeConstraints = false;
+    config.outlineWindow.enabled        = false;
+
+    MockWindow *window = showWindow(&app);
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), 0);
+    CHECK_EQUAL(app.installs, 0);
+    CHECK_EQUAL(app.starts, 1);
+    CHECK(app.launch.decided);
+    CHECK_EQUAL(window->callCount, 0);
+}
+
+static void testFailedInstallIsAllOff(void) {
+    MockApp app = { .failInstall = true };
+    SSLConfig config;
+    parseConfig("full.json", &config);
+
+    MockWindow *window = showWindow(&app);
+    CHECK_EQUAL(SSLLaunchDecide(&app.launch, &config, &steps, &app), 0);
+    CHECK_EQUAL(app.installs, 1);
+    CHECK_EQUAL(app.starts, 1);
+    CHECK(!app.bordersStarted);
+    CHECK_EQUAL(app.launch.decoratorCount, 0);
+    CHECK_EQUAL(window->callCount, 0);
+    CHECK_EQUAL(showWindow(&app)->callCount, 0);
+}
+
+/*
+
+ The launch the way the plugin does it: +load only starts the config read on another thread, the
+ main thread goes on showing windows and decides once the config is handed back to it. The config
+ read is slow here, none of that may count toward the launch cost.
+
+ */
+#define SLOW_READ_MICROSECONDS 50000
+
+typedef struct MainQueue {
+    pthread_mutex_t lock;
+    SSLConfig config;
+    bool posted;
+} MainQueue;
+
+static void *readConfigThread(void *context) {
+    MainQueue *queue = context;
+    SSLConfig config;
+    usleep(SLOW_READ_MICROSECONDS);
+    parseConfig("full.json", &config);
+
+    pthread_mutex_lock(&queue->lock);
+    queue->config = config;
+    queue->posted = true;
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+static bool takeConfig(MainQueue *queue, SSLConfig *config) {
+    pthread_mutex_lock(&queue->lock);
+    bool posted = queue->posted;
+    if (posted)
+        *config = queue->config;
+    queue->posted = false;
+    pthread_mutex_unlock(&queue->lock);
+    return posted;
+}
+
+static void testHeadlessLaunch(void) {
+    MockApp app = { 0 };
+    MainQueue queue = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+    // +load
+    pthread_t reader;
+    uint64_t start = SSLLaunchNanoseconds();
+    pthread_create(&reader, NULL, readConfigThread, &queue);
+    SSLLaunchAddCost(&app.launch, start);
+    uint64_t loadCost = app.launch.costNanoseconds;
+
+    // The app starts up and shows windows while the config is read, then the main queue runs
+    MockWindow *beforeDecision[3];
+    int shown = 0;
+    SSLConfig config;
+    uint64_t deadline = nowNanoseconds() + 5000000000u;
+    while (!takeConfig(&queue, &config) && nowNanoseconds() < deadline) {
+        if (shown < 3)
+            beforeDecision[shown++] = showWindow(&app);
+        CHECK(!app.launch.decided);
+        usleep(1000);
+    }
+    pthread_join(reader, NULL);
+
+    for (int i = 0; i < shown; i++)
+        CHECK_EQUAL(beforeDecision[i]->callCount, 0);
+
+    SSLLaunchDecide(&app.launch, &config, &steps, &app);
+    MockWindow *afterDecision = showWindow(&app);
+
+    CHECK_EQUAL(shown, 3);
+    for (int i = 0; i < shown; i++)
+        checkDecoratedOnce(beforeDecision[i]);
+    checkDecoratedOnce(afterDecision);
+
+    CHECK(app.launch.costNanoseconds > loadCost);
+    CHECK(SSLLaunchCostMicroseconds(&app.launch) < SLOW_READ_MICROSECONDS);
+    printf("  launch cost %" PRIu64 " us with a %d us config read, +load %.1f us\n",
+           SSLLaunchCostMicroseconds(&app.launch), SLOW_READ_MICROSECONDS, loadCost / 1e3);
+}
+
+// Benchmarks
+
+static void benchDecide(void) {
+    SSLConfig config;
+    parseConfig("full.json", &config);
+
+    const uint64_t iterations = 200000;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        MockApp app = { 0 };
+        for (int window = 0; window < 4; window++)
+            showWindow(&app);
+        SSLLaunchDecide(&app.launch, &config, &steps, &app);
+        total += app.launch.costNanoseconds;
+    }
+    benchReport("launch_decide_4_windows", iterations, total);
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchDecide();
+        return 0;
+    }
+
+    RUN(testUndecidedIsAllOff);
+    RUN(testDecideInstallsThenStarts);
+    RUN(testNothingEnabledHooksNothing);
+    RUN(testFailedInstallIsAllOff);
+    RUN(testLaterConfigSwitchesFeatures);
+    RUN(testFailedSwitchKeepsWhatStayed);
+    RUN(testHeadlessLaunch);
+    return checkResult();
+}
@@ -0,0 +1,237 @@
+//
+//  SSLNineSliceTests.c
+//  StopStoplightLight tests
+//
+//  The border image pixel for pixel at 1x and 2x, and stretched to a window the way the layer does it.
+//
+
+#include "Check.h"
+#include "SSLNineSlice.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Top left quarter of the alpha channel, including the middle row and column. Radius 4, width 2
+static const uint8_t goldenAlpha1x[6][6] = {
+    {   0,  51, 176, 246, 255, 255 },
+    {  51, 246, 106,  13,   0,   0 },
+    { 176, 106,   0,   0,   0,   0 },
+    { 246,  13,   0,   0,   0,   0 },
+    { 255,   0,   0,   0,   0,   0 },
+    { 255,   0,   0,   0,   0,   0 },
+};
+
+static const uint8_t goldenAlpha2x[10][10] = {
+    {   0,   0,   0,   0,  57, 152, 217, 251, 255, 255 },
+    {   0,   0,   0, 152, 255, 255, 255, 255, 255, 255 },
+    {   0,   0, 184, 255, 255, 138,  51,   6,   0,   0 },
+    {   0, 152, 255, 220,  51,   0,   0,   0,   0,   0 },
+    {  57, 255, 255,  51,   0,   0,   0,   0,   0,   0 },
+    { 152, 255, 138,   0,   0,   0,   0,   0,   0,   0 },
+    { 217, 255,  51,   0,   0,   0,   0,   0,   0,   0 },
+    { 251, 255,   6,   0,   0,   0,   0,   0,   0,   0 },
+    { 255, 255,   0,   0,   0,   0,   0,   0,   0,   0 },
+    { 255, 255,   0,   0,   0,   0,   0,   0,   0,   0 },
+};
+
+static uint8_t *render(SSLNineSlice slice, double radius, double width, double scale, uint32_t rgba) {
+    uint8_t *pixels = malloc((size_t)slice.size * slice.size * 4);
+    memset(pixels, 0xAB, (size_t)slice.size * slice.size * 4);
+    SSLNineSliceRender(slice, radius, width, scale, rgba, pixels);
+    return pixels;
+}
+
+static const uint8_t *pixelAt(const uint8_t *pixels, uint32_t size, uint32_t x, uint32_t y) {
+    return &pixels[(y * size + x) * 4];
+}
+
+static void checkGolden(const uint8_t *pixels, SSLNineSlice slice, const uint8_t *golden) {
+    uint32_t side = slice.inset + 1;
+    int mismatches = 0;
+    for (uint32_t y = 0; y < side; y++) {
+        for (uint32_t x = 0; x < side; x++) {
+            uint8_t alpha = pixelAt(pixels, slice.size, x, y)[3];
+            if (alpha != golden[y * side + x] && mismatches++ < 5)
+                fprintf(stderr, "  alpha at %u,%u is %u, expected %u\n", x, y, alpha, golden[y * side + x]);
+        }
+    }
+    CHECK_EQUAL(mismatches, 0);
+}
+
+// The image looks the same mirrored either way and across the diagonal
+static void checkSymmetric(const uint8_t *pixels, uint32_t size) {
+    int mismatches = 0;
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            const uint8_t *pixel = pixelAt(pixels, size, x, y);
+            if (memcmp(pixel, pixelAt(pixels, size, size - 1 - x, y), 4) != 0 ||
+                memcmp(pixel, pixelAt(pixels, size, x, size - 1 - y), 4) != 0 ||
+                memcmp(pixel, pixelAt(pixels, size, y, x), 4) != 0)
+                mismatches++;
+        }
+    }
+    CHECK_EQUAL(mismatches, 0);
+}
+
+// Every channel is the color times the pixel's coverage, never more than alpha
+static void checkPremultiplied(const uint8_t *pixels, uint32_t size, uint32_t rgba) {
+    double alpha = (rgba & 0xFF) / 255.0;
+    int mismatches = 0;
+    for (uint32_t i = 0; i < size * size; i++) {
+        const uint8_t *pixel = &pixels[i * 4];
+        double coverage = alpha > 0 ? pixel[3] / (255 * alpha) : 0;
+        for (int channel = 0; channel < 3; channel++) {
+            double color = (rgba >> (24 - 8 * channel)) & 0xFF;
+            if (pixel[channel] > pixel[3] || fabs(pixel[channel] - color * coverage * alpha) > 1)
+                mismatches++;
+        }
+    }
+    CHECK_EQUAL(mismatches, 0);
+}
+
+static void testLayout(void) {
+    SSLNineSlice slice = SSLNineSliceLayout(4, 2, 1);
+    CHECK_EQUAL(slice.inset, 5);
+    CHECK_EQUAL(slice.size, 11);
+
+    slice = SSLNineSliceLayout(4, 2, 2);
+    CHECK_EQUAL(slice.inset, 9);
+    CHECK_EQUAL(slice.size, 19);
+
+    // A stroke wider than the corner decides the inset, no radius and no scale still leave an edge
+    slice = SSLNineSliceLayout(1, 10, 1);
+    CHECK_EQUAL(slice.inset, 6);
+    slice = SSLNineSliceLayout(0, 0, 0);
+    CHECK_EQUAL(slice.inset, 1);
+    CHECK_EQUAL(slice.size, 3);
+    slice = SSLNineSliceLayout(-5, -1, 1.5);
+    CHECK_EQUAL(slice.inset, 1);
+}
+
+static void testGolden1x(void) {
+    SSLNineSlice slice = SSLNineSliceLayout(4, 2, 1);
+    uint8_t *pixels = render(slice, 4, 2, 1, 0xFFFFFFFF);
+    checkGolden(pixels, slice, &goldenAlpha1x[0][0]);
+    checkSymmetric(pixels, slice.size);
+
+    // White at full alpha is the same in every channel
+    for (uint32_t i = 0; i < slice.size * slice.size; i++)
+        CHECK(pixels[i * 4] == pixels[i * 4 + 3] && pixels[i * 4 + 1] == pixels[i * 4 + 3] && pixels[i * 4 + 2] == pixels[i * 4 + 3]);
+    free(pixels);
+}
+
+static void testGolden2x(void) {
+    SSLNineSlice slice = SSLNineSliceLayout(4, 2, 2);
+    uint8_t *pixels = render(slice, 4, 2, 2, 0xFFFFFFFF);
+    checkGolden(pixels, slice, &goldenAlpha2x[0][0]);
+    checkSymmetric(pixels, slice.size);
+
+    // Same border, twice the pixels: the straight edge is a two pixel wide solid line
+    CHECK_EQUAL(pixelAt(pixels, slice.size, slice.inset, 0)[3], 255);
+    CHECK_EQUAL(pixelAt(pixels, slice.size, slice.inset, 1)[3], 255);
+    CHECK_EQUAL(pixelAt(pixels, slice.size, slice.inset, 2)[3], 0);
+    free(pixels);
+}
+
+static void testPremultipliedColor(void) {
+    const uint32_t colors[] = { 0xFF8000FF, 0x3366CC80, 0x12345601, 0xFFFFFF00 };
+    for (size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); i++) {
+        for (double scale = 1; scale <= 2; scale += 0.5) {
+            SSLNineSlice slice = SSLNineSliceLayout(6, 1.5, scale);
+            uint8_t *pixels = render(slice, 6, 1.5, scale, colors[i]);
+            checkPremultiplied(pixels, slice.size, colors[i]);
+            checkSymmetric(pixels, slice.size);
+            free(pixels);
+        }
+    }
+
+    // Transparent is transparent everywhere
+    SSLNineSlice slice = SSLNineSliceLayout(4, 2, 2);
+    uint8_t *pixels = render(slice, 4, 2, 2, 0xFFFFFF00);
+    int opaque = 0;
+    for (uint32_t i = 0; i < slice.size * slice.size * 4; i++)
+        opaque += pixels[i] != 0;
+    CHECK_EQUAL(opaque, 0);
+    free(pixels);
+}
+
+/*
+
+ What the window shows: the layer stretches the middle row and column, everything else is drawn
+ as is. Rendering the whole window border directly has to give the same pixels.
+
+ */
+static uint32_t sliceCoordinate(uint32_t position, uint32_t length, SSLNineSlice slice) {
+    if (position < slice.inset)
+        return position;
+    if (position >= length - slice.inset)
+        return position - (length - slice.size);
+    return slice.inset;
+}
+
+static double clampUnit(double value) {
+    return value < 0 ? 0 : value > 1 ? 1 : value;
+}
+
+static uint8_t directAlpha(double x, double y, double width, double height, double radius, double stroke) {
+    double qx = fabs(x - width / 2) - (width / 2 - radius);
+    double qy = fabs(y - height / 2) - (height / 2 - radius);
+    double distance = hypot(fmax(qx, 0), fmax(qy, 0)) + fmin(fmax(qx, qy), 0) - radius;
+    double coverage = clampUnit(0.5 - distance) - clampUnit(0.5 - (distance + stroke));
+    return (uint8_t)lround(255 * coverage);
+}
+
+static void checkStretched(double radius, double width, double scale, uint32_t windowWidth, uint32_t windowHeight) {
+    SSLNineSlice slice = SSLNineSliceLayout(radius, width, scale);
+    uint8_t *pixels = render(slice, radius, width, scale, 0xFFFFFFFF);
+
+    int mismatches = 0;
+    for (uint32_t y = 0; y < windowHeight; y++) {
+        for (uint32_t x = 0; x < windowWidth; x++) {
+            uint8_t stretched = pixelAt(pixels, slice.size, sliceCoordinate(x, windowWidth, slice), sliceCoordinate(y, windowHeight, slice))[3];
+            uint8_t direct = directAlpha(x + 0.5, y + 0.5, windowWidth, windowHeight, radius * scale, width * scale / 2);
+            if (stretched != direct && mismatches++ < 5)
+                fprintf(stderr, "  %gx radius %g: alpha at %u,%u is %u, drawn directly %u\n", scale, radius, x, y, stretched, direct);
+        }
+    }
+    CHECK_EQUAL(mismatches, 0);
+    free(pixels);
+}
+
+static void testStretchedMatchesDirect(void) {
+    checkStretched(4, 2, 1, 40, 30);
+    checkStretched(4, 2, 2, 80, 60);
+    checkStretched(10, 1, 2, 301, 200);
+    checkStretched(0, 3, 1, 20, 20);
+    checkStretched(12, 2, 1.5, 150, 97);
+}
+
+// Benchmarks
+
+static void benchRender(void) {
+    const double scales[] = { 1, 2, 3 };
+    const char *names[] = { "nine_slice_render_r10_1x", "nine_slice_render_r10_2x", "nine_slice_render_r10_3x" };
+    for (int i = 0; i < 3; i++) {
+        SSLNineSlice slice = SSLNineSliceLayout(10, 2, scales[i]);
+        uint8_t *pixels = malloc((size_t)slice.size * slice.size * 4);
+        const uint64_t iterations = 2000;
+        uint64_t start = nowNanoseconds();
+        for (uint64_t n = 0; n < iterations; n++)
+            SSLNineSliceRender(slice, 10, 2, scales[i], 0x555555FF, pixels);
+        benchReport(names[i], iterations, nowNanoseconds() - start);
+        free(pixels);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchRender();
+        return 0;
+    }
+
+    RUN(testLayout);
+    RUN(testGolden1x);
+    RUN(testGolden2x);
+    RUN(testPremultipliedColor);
+    RUN(testStretchedMatchesDirect);
+    return checkResult();
+}
@@ -0,0 +1,182 @@
+//
+//  SSLPaletteTests.c
+//  StopStoplightLight tests
+//
+//  Every color is made once and keeps its handle, lookups race with adds without a lock.
+//
+
+#include "Check.h"
+#include "SSLPalette.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Stands in for a CGColor, counts how many were made
+typedef struct MockColor {
+    uint32_t rgba;
+} MockColor;
+
+static int colorsMade;
+
+// What the plugin does for every color it uses: look it up, make and add it the first time
+static MockColor *internColor(SSLPalette *palette, uint32_t rgba, MockColor **overflow) {
+    int index = SSLPaletteFind(palette, rgba);
+    if (index >= 0)
+        return SSLPaletteHandle(palette, index);
+
+    MockColor *color = malloc(sizeof(MockColor));
+    color->rgba = rgba;
+    colorsMade++;
+
+    index = SSLPaletteAdd(palette, rgba, color);
+    if (index < 0) {
+        // The plugin hands these out autoreleased, the caller frees them here
+        *overflow = color;
+        return color;
+    }
+    return SSLPaletteHandle(palette, index);
+}
+
+static void freePalette(SSLPalette *palette) {
+    for (uint32_t i = 0; i < palette->count; i++)
+        free(palette->handles[i]);
+}
+
+static void testInterningIdentity(void) {
+    SSLPalette palette = { 0 };
+    colorsMade = 0;
+    MockColor *overflow = NULL;
+
+    MockColor *white = internColor(&palette, 0xFFFFFFFF, &overflow);
+    MockColor *gray  = internColor(&palette, 0x555555FF, &overflow);
+    CHECK(white != gray);
+    CHECK(internColor(&palette, 0xFFFFFFFF, &overflow) == white);
+    CHECK(internColor(&palette, 0x555555FF, &overflow) == gray);
+    CHECK_EQUAL(colorsMade, 2);
+    CHECK_EQUAL(palette.count, 2);
+
+    // Same color with another alpha is another color
+    CHECK(internColor(&palette, 0xFFFFFF80, &overflow) != white);
+    CHECK_EQUAL(colorsMade, 3);
+    CHECK(overflow == NULL);
+    freePalette(&palette);
+}
+
+static void testFindOnEmpty(void) {
+    SSLPalette palette = { 0 };
+    CHECK_EQUAL(SSLPaletteFind(&palette, 0), -1);
+    CHECK_EQUAL(SSLPaletteFind(&palette, 0xFFFFFFFF), -1);
+}
+
+static void testOverflow(void) {
+    SSLPalette palette = { 0 };
+    colorsMade = 0;
+    MockColor *first[SSL_PALETTE_CAPACITY];
+    MockColor *overflow = NULL;
+    for (uint32_t i = 0; i < SSL_PALETTE_CAPACITY; i++) {
+        first[i] = internColor(&palette, i << 8 | 0xFF, &overflow);
+        CHECK_EQUAL(SSLPaletteFind(&palette, i << 8 | 0xFF), i);
+    }
+    CHECK(overflow == NULL);
+    CHECK_EQUAL(palette.count, SSL_PALETTE_CAPACITY);
+
+    // Full, a new color still works but isn't kept
+    int before = colorsMade;
+    MockColor *extra = internColor(&palette, 0xABCDEFFF, &overflow);
+    CHECK(extra != NULL && extra->rgba == 0xABCDEFFF);
+    CHECK(overflow == extra);
+    CHECK_EQUAL(SSLPaletteAdd(&palette, 0xABCDEFFF, NULL), -1);
+    CHECK_EQUAL(SSLPaletteFind(&palette, 0xABCDEFFF), -1);
+    CHECK_EQUAL(palette.count, SSL_PALETTE_CAPACITY);
+    free(overflow);
+
+    // ...and made every time it is used
+    overflow = NULL;
+    internColor(&palette, 0xABCDEFFF, &overflow);
+    CHECK_EQUAL(colorsMade, before + 2);
+    free(overflow);
+
+    // Earlier colors keep their handles
+    for (uint32_t i = 0; i < SSL_PALETTE_CAPACITY; i++)
+        CHECK(internColor(&palette, i << 8 | 0xFF, &overflow) == first[i]);
+    CHECK_EQUAL(colorsMade, before + 2);
+    freePalette(&palette);
+}
+
+// Readers never see a color without its handle while the only writer keeps adding
+typedef struct RaceState {
+    SSLPalette palette;
+    int done;
+    int torn;
+} RaceState;
+
+static void *raceReader(void *context) {
+    RaceState *state = context;
+    while (!__atomic_load_n(&state->done, __ATOMIC_ACQUIRE)) {
+        for (uint32_t i = 0; i < SSL_PALETTE_CAPACITY; i++) {
+            int index = SSLPaletteFind(&state->palette, i + 1);
+            if (index < 0)
+                continue;
+            MockColor *color = SSLPaletteHandle(&state->palette, index);
+            if (color == NULL || color->rgba != i + 1)
+                __atomic_add_fetch(&state->torn, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static void testConcurrentLookups(void) {
+    static MockColor colors[SSL_PALETTE_CAPACITY];
+    for (int round = 0; round < 50; round++) {
+        RaceState state = { .palette = { 0 } };
+        pthread_t readers[4];
+        for (int i = 0; i < 4; i++)
+            pthread_create(&readers[i], NULL, raceReader, &state);
+
+        for (uint32_t i = 0; i < SSL_PALETTE_CAPACITY; i++) {
+            colors[i].rgba = i + 1;
+            SSLPaletteAdd(&state.palette, i + 1, &colors[i]);
+        }
+
+        __atomic_store_n(&state.done, 1, __ATOMIC_RELEASE);
+        for (int i = 0; i < 4; i++)
+            pthread_join(readers[i], NULL);
+        CHECK_EQUAL(state.torn, 0);
+    }
+}
+
+// Benchmarks
+
+static void benchLookups(void) {
+    SSLPalette palette = { 0 };
+    static MockColor colors[SSL_PALETTE_CAPACITY];
+    for (uint32_t i = 0; i < SSL_PALETTE_CAPACITY; i++)
+        SSLPaletteAdd(&palette, i << 8 | 0xFF, &colors[i]);
+
+    // The two border colors are the first ones added, the worst case is a full palette
+    uint32_t positions[] = { 0, 1, 15, SSL_PALETTE_CAPACITY - 1 };
+    for (size_t p = 0; p < sizeof(positions) / sizeof(positions[0]); p++) {
+        const uint64_t iterations = 10000000;
+        uint32_t rgba = positions[p] << 8 | 0xFF;
+        volatile int sink = 0;
+        uint64_t start = nowNanoseconds();
+        for (uint64_t i = 0; i < iterations; i++)
+            sink += SSLPaletteFind(&palette, rgba);
+        char name[64];
+        snprintf(name, sizeof(name), "palette_find_entry_%u", positions[p]);
+        benchReport(name, iterations, nowNanoseconds() - start);
+        (void)sink;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchLookups();
+        return 0;
+    }
+
+    RUN(testInterningIdentity);
+    RUN(testFindOnEmpty);
+    RUN(testOverflow);
+    RUN(testConcurrentLookups);
+    return checkResult();
+}
@@ -0,0 +1,293 @@
+//
+//  SSLPathCacheTests.c
+//  StopStoplightLight tests
+//
+//  Resize traces through the rounded path cache: how often it hits and what it evicts.
+//
+
+#include "Check.h"
+#include "SSLPathCache.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Stands in for a CGPath, remembers the key it was made for
+typedef struct MockPath {
+    SSLPathKey key;
+} MockPath;
+
+static int pathsMade;
+static int pathsReleased;
+
+static void releasePath(void *path) {
+    pathsReleased++;
+    free(path);
+}
+
+static void resetCache(SSLPathCache *cache) {
+    for (uint32_t i = 0; i < cache->count; i++)
+        releasePath(cache->entries[i].path);
+    memset(cache, 0, sizeof(SSLPathCache));
+    cache->release = releasePath;
+    pathsMade = pathsReleased = 0;
+}
+
+static bool sameKey(SSLPathKey a, SSLPathKey b) {
+    return a.width == b.width && a.height == b.height && a.radius == b.radius && a.scale == b.scale;
+}
+
+// What the plugin does for every border it draws: look the path up, make and insert it on a miss
+static MockPath *roundedPath(SSLPathCache *cache, double width, double height, double radius, double scale) {
+    SSLPathKey key = SSLPathKeyMake(width, height, radius, scale);
+    MockPath *path = SSLPathCacheLookup(cache, key);
+    if (!path) {
+        path = malloc(sizeof(MockPath));
+        path->key = key;
+        pathsMade++;
+        SSLPathCacheInsert(cache, key, path);
+    }
+    return path;
+}
+
+static double hitRate(const SSLPathCache *cache) {
+    uint64_t lookups = cache->hits + cache->misses;
+    return lookups ? (double)cache->hits / (double)lookups : 0;
+}
+
+static void report(const char *trace, const SSLPathCache *cache) {
+    printf("  %-30s %5" PRIu64 " lookups, hit rate %5.1f%%, %d evicted\n", trace, cache->hits + cache->misses,
+           hitRate(cache) * 100, pathsReleased);
+}
+
+static void testKeys(void) {
+    SSLPathKey key = SSLPathKeyMake(800, 600, 10, 2);
+    CHECK_EQUAL(key.width, 1600);
+    CHECK_EQUAL(key.height, 1200);
+    CHECK_EQUAL(key.radius, 20);
+    CHECK_EQUAL(key.scale, 128);
+
+    double width, height, radius;
+    SSLPathKeyGetSize(key, &width, &height, &radius);
+    CHECK(width == 800 && height == 600 && radius == 10);
+
+    // 1.5x keeps half points that land on a device pixel
+    key = SSLPathKeyMake(800.5, 600, 10, 1.5);
+    CHECK_EQUAL(key.width, 1201);
+    CHECK_EQUAL(key.scale, 96);
+
+    // Sizes that round to the same device pixels share a path, at 2x they don't
+    CHECK(sameKey(SSLPathKeyMake(800.2, 600, 10, 1), SSLPathKeyMake(800.4, 600, 10, 1)));
+    CHECK(!sameKey(SSLPathKeyMake(800.2, 600, 10, 2), SSLPathKeyMake(800.4, 600, 10, 2)));
+    CHECK(!sameKey(SSLPathKeyMake(800, 600, 10, 1), SSLPathKeyMake(800, 600, 10, 2)));
+
+    // No scale is 1x
+    CHECK(sameKey(SSLPathKeyMake(800, 600, 10, 0), SSLPathKeyMake(800, 600, 10, 1)));
+}
+
+static void testRoundedRectElements(void) {
+    SSLPathElement elements[SSL_ROUNDED_RECT_ELEMENTS];
+    CHECK_EQUAL(SSLRoundedRectElements(100, 50, 8, elements), SSL_ROUNDED_RECT_ELEMENTS);
+    CHECK_EQUAL(elements[0].type, SSLPathElementMove);
+    CHECK(elements[0].x1 == 8 && elements[0].y1 == 0);
+    CHECK_EQUAL(elements[2].type, SSLPathElementArc);
+    CHECK(elements[2].x1 == 100 && elements[2].y1 == 0 && elements[2].x2 == 100 && elements[2].y2 == 8);
+    CHECK(elements[4].x1 == 100 && elements[4].y1 == 50 && elements[4].x2 == 92 && elements[4].y2 == 50);
+    CHECK(elements[8].x1 == 0 && elements[8].y1 == 0 && elements[8].x2 == 8 && elements[8].radius == 8);
+    CHECK_EQUAL(elements[9].type, SSLPathElementClose);
+
+    // A negative radius is a square corner
+    SSLRoundedRectElements(100, 50, -3, elements);
+    CHECK(elements[0].x1 == 0 && elements[2].radius == 0);
+}
+
+static void testLeastRecentlyUsedIsEvicted(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+
+    MockPath *first = roundedPath(&cache, 100, 100, 10, 1);
+    MockPath *second = roundedPath(&cache, 101, 100, 10, 1);
+    for (int i = 2; i < SSL_PATH_CACHE_CAPACITY; i++)
+        roundedPath(&cache, 100 + i, 100, 10, 1);
+    CHECK_EQUAL(cache.count, SSL_PATH_CACHE_CAPACITY);
+    CHECK_EQUAL(pathsReleased, 0);
+
+    // Using the oldest makes the second one the next to go
+    CHECK(roundedPath(&cache, 100, 100, 10, 1) == first);
+    roundedPath(&cache, 500, 100, 10, 1);
+    CHECK_EQUAL(pathsReleased, 1);
+    CHECK_EQUAL(cache.count, SSL_PATH_CACHE_CAPACITY);
+    CHECK(SSLPathCacheLookup(&cache, SSLPathKeyMake(100, 100, 10, 1)) == first);
+    CHECK(SSLPathCacheLookup(&cache, SSLPathKeyMake(101, 100, 10, 1)) == NULL);
+    (void)second;
+
+    // Every path made is either still cached or was handed to release
+    CHECK_EQUAL(pathsMade - pathsReleased, (int)cache.count);
+    resetCache(&cache);
+}
+
+/*
+
+ The traces below are what windows do: open at a size, redraw when they gain or lose focus, get
+ zoomed and resized live. Each resize step is a new size and so a miss, the cost is what it pushes
+ out for the windows that didn't change.
+
+ */
+
+#define IDLE_WINDOWS 8
+
+static void redrawIdleWindows(SSLPathCache *cache, double scale) {
+    for (int i = 0; i < IDLE_WINDOWS; i++)
+        roundedPath(cache, 600 + 40 * i, 400 + 30 * i, 10, scale);
+}
+
+static void testFocusChangesHit(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+
+    for (int round = 0; round < 50; round++)
+        redrawIdleWindows(&cache, 2);
+
+    CHECK_EQUAL(cache.misses, IDLE_WINDOWS);
+    CHECK_EQUAL(cache.hits, 49 * IDLE_WINDOWS);
+    CHECK_EQUAL(pathsReleased, 0);
+    report("focus changes", &cache);
+    resetCache(&cache);
+}
+
+static void testZoomToggleHits(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+
+    for (int round = 0; round < 50; round++) {
+        roundedPath(&cache, 800, 600, 10, 2);
+        roundedPath(&cache, 1440, 875, 10, 2);
+    }
+
+    CHECK_EQUAL(cache.misses, 2);
+    CHECK_EQUAL(cache.hits, 98);
+    report("zoom toggle", &cache);
+    resetCache(&cache);
+}
+
+static void testLiveResizeEvictsIdleWindows(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+    redrawIdleWindows(&cache, 2);
+
+    // A live resize draws every frame at a new size
+    const int frames = 100;
+    for (int frame = 0; frame < frames; frame++)
+        roundedPath(&cache, 800 + 2 * frame, 600 + frame, 10, 2);
+
+    CHECK_EQUAL(cache.hits, 0);
+    CHECK_EQUAL(cache.misses, IDLE_WINDOWS + frames);
+    CHECK_EQUAL(pathsReleased, IDLE_WINDOWS + frames - SSL_PATH_CACHE_CAPACITY);
+
+    // The idle windows were least recently used and are all gone
+    uint64_t misses = cache.misses;
+    redrawIdleWindows(&cache, 2);
+    CHECK_EQUAL(cache.misses - misses, IDLE_WINDOWS);
+
+    // Once settled everything hits again
+    uint64_t hits = cache.hits;
+    for (int round = 0; round < 10; round++) {
+        redrawIdleWindows(&cache, 2);
+        roundedPath(&cache, 800 + 2 * (frames - 1), 600 + frames - 1, 10, 2);
+    }
+    CHECK_EQUAL(cache.hits - hits, 10 * (IDLE_WINDOWS + 1));
+    CHECK_EQUAL(pathsMade - pathsReleased, (int)cache.count);
+    report("live resize with idle windows", &cache);
+    resetCache(&cache);
+}
+
+static void testResizeBackAndForthHits(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+
+    // Dragging out and back over the same sizes, fewer steps than the cache holds
+    const int steps = 20;
+    for (int step = 0; step <= steps; step++)
+        roundedPath(&cache, 800 + step, 600, 10, 2);
+    for (int step = steps - 1; step >= 0; step--)
+        roundedPath(&cache, 800 + step, 600, 10, 2);
+
+    CHECK_EQUAL(cache.misses, steps + 1);
+    CHECK_EQUAL(cache.hits, steps);
+    CHECK_EQUAL(pathsReleased, 0);
+    report("resize out and back", &cache);
+
+    // Further than the cache holds, the way back finds nothing
+    resetCache(&cache);
+    const int far = 2 * SSL_PATH_CACHE_CAPACITY;
+    for (int step = 0; step <= far; step++)
+        roundedPath(&cache, 800 + step, 600, 10, 2);
+    for (int step = far - 1; step >= 0; step--)
+        roundedPath(&cache, 800 + step, 600, 10, 2);
+
+    // Only the last capacity - 1 sizes before the turn are still there
+    CHECK_EQUAL(cache.hits, SSL_PATH_CACHE_CAPACITY - 1);
+    report("resize out and back, far", &cache);
+    resetCache(&cache);
+}
+
+static void testFractionalResizeAt1x(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+
+    // Quarter point steps share device pixels at 1x
+    for (int step = 0; step < 400; step++)
+        roundedPath(&cache, 800 + step * 0.25, 600, 10, 1);
+
+    CHECK_EQUAL(cache.misses, 101);
+    CHECK_EQUAL(cache.hits, 299);
+    report("quarter point resize at 1x", &cache);
+    resetCache(&cache);
+}
+
+// Benchmarks
+
+static void benchLookups(void) {
+    SSLPathCache cache = { 0 };
+    resetCache(&cache);
+    for (int i = 0; i < SSL_PATH_CACHE_CAPACITY; i++)
+        roundedPath(&cache, 600 + i, 400, 10, 2);
+
+    const uint64_t iterations = 10000000;
+    volatile uintptr_t sink = 0;
+    SSLPathKey newest = SSLPathKeyMake(600 + SSL_PATH_CACHE_CAPACITY - 1, 400, 10, 2);
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++)
+        sink = (uintptr_t)SSLPathCacheLookup(&cache, newest);
+    benchReport("path_cache_hit_full", iterations, nowNanoseconds() - start);
+
+    SSLPathKey missing = SSLPathKeyMake(5000, 400, 10, 2);
+    start = nowNanoseconds();
+    for (uint64_t i = 0; i < iterations; i++)
+        sink = (uintptr_t)SSLPathCacheLookup(&cache, missing);
+    benchReport("path_cache_miss_full", iterations, nowNanoseconds() - start);
+
+    const uint64_t frames = 1000000;
+    start = nowNanoseconds();
+    for (uint64_t frame = 0; frame < frames; frame++)
+        sink = (uintptr_t)roundedPath(&cache, 800 + (double)frame, 600, 10, 2);
+    benchReport("path_cache_live_resize_frame", frames, nowNanoseconds() - start);
+    (void)sink;
+
+    resetCache(&cache);
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchLookups();
+        return 0;
+    }
+
+    RUN(testKeys);
+    RUN(testRoundedRectElements);
+    RUN(testLeastRecentlyUsedIsEvicted);
+    RUN(testFocusChangesHit);
+    RUN(testZoomToggleHits);
+    RUN(testLiveResizeEvictsIdleWindows);
+    RUN(testResizeBackAndForthHits);
+    RUN(testFractionalResizeAt1x);
+    return checkResult();
+}
@@ -0,0 +1,347 @@
+//
+//  SSLUpdateQueueTests.c
+//  StopStoplightLight tests
+//
+//  Marks coalesce until the run loop is about to sleep, the key window is updated first.
+//
+
+#include "Check.h"
+#include "SSLUpdateQueue.h"
+#include <stdlib.h>
+
+#define MAX_APPLIED 4096
+
+// What a flush did, in order
+typedef struct Applied {
+    SSLUpdate *updates[MAX_APPLIED];
+    uint32_t reasons[MAX_APPLIED];
+    int count;
+} Applied;
+
+static void record(SSLUpdate *update, uint32_t reasons, void *context) {
+    Applied *applied = context;
+    if (applied->count < MAX_APPLIED) {
+        applied->updates[applied->count] = update;
+        applied->reasons[applied->count] = reasons;
+    }
+    applied->count++;
+}
+
+static void freeQueue(SSLUpdateQueue *queue) {
+    free(queue->pending);
+    free(queue->flushing);
+    memset(queue, 0, sizeof(SSLUpdateQueue));
+}
+
+static void testMarksCoalesce(void) {
+    SSLUpdateQueue queue = { 0 };
+    SSLUpdate window = { 0 };
+    Applied applied = { 0 };
+
+    CHECK(SSLUpdateQueueIsEmpty(&queue));
+    for (int i = 0; i < 100; i++)
+        CHECK(SSLUpdateQueueMark(&queue, &window, SSLUpdateGeometry));
+    CHECK(SSLUpdateQueueMark(&queue, &window, SSLUpdateColor));
+    CHECK(SSLUpdateQueueMark(&queue, &window, 0));
+    CHECK_EQUAL(queue.count, 1);
+
+    SSLUpdateQueueFlush(&queue, record, &applied);
+    CHECK_EQUAL(applied.count, 1);
+    CHECK(applied.updates[0] == &window);
+    CHECK_EQUAL(applied.reasons[0], SSLUpdateGeometry | SSLUpdateColor);
+    CHECK_EQUAL(window.reasons, 0);
+    CHECK(SSLUpdateQueueIsEmpty(&queue));
+
+    // Nothing marked since, nothing to do
+    SSLUpdateQueueFlush(&queue, record, &applied);
+    CHECK_EQUAL(applied.count, 1);
+
+    // A mark of no reasons doesn't queue anything
+    CHECK(SSLUpdateQueueMark(&queue, &window, 0));
+    CHECK(SSLUpdateQueueIsEmpty(&queue));
+    freeQueue(&queue);
+}
+
+static void testUrgentFirst(void) {
+    SSLUpdateQueue queue = { 0 };
+    SSLUpdate windows[6] = { { 0 } };
+    Applied applied = { 0 };
+
+    // The key window changes in the middle of a burst, and another one is marked urgent last
+    windows[2].urgent = true;
+    windows[5].urgent = true;
+    for (int i = 0; i < 6; i++)
+        SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, record, &applied);
+
+    const int expected[] = { 2, 5, 0, 1, 3, 4 };
+    CHECK_EQUAL(applied.count, 6);
+    for (int i = 0; i < 6; i++)
+        CHECK(applied.updates[i] == &windows[expected[i]]);
+    freeQueue(&queue);
+}
+
+/*
+
+ The controller marks from notifications and flushes from a run loop observer, once per turn
+ before the run loop sleeps. Every flush that has work is one Core Animation transaction.
+
+ */
+typedef struct RunLoop {
+    SSLUpdateQueue queue;
+    Applied applied;
+    int transactions;
+} RunLoop;
+
+static void beforeWaiting(RunLoop *runLoop) {
+    if (SSLUpdateQueueIsEmpty(&runLoop->queue))
+        return;
+
+    runLoop->transactions++;
+    SSLUpdateQueueFlush(&runLoop->queue, record, &runLoop->applied);
+}
+
+static void testOneFlushPerTurn(void) {
+    RunLoop runLoop = { 0 };
+    SSLUpdate windows[3] = { { 0 } };
+    windows[0].urgent = true;
+
+    // Three windows live resizing, each sends several resize notifications a turn
+    const int turns = 120;
+    for (int turn = 0; turn < turns; turn++) {
+        for (int event = 0; event < 4; event++) {
+            for (int i = 0; i < 3; i++)
+                SSLUpdateQueueMark(&runLoop.queue, &windows[i], SSLUpdateGeometry);
+        }
+        SSLUpdateQueueMark(&runLoop.queue, &windows[1], SSLUpdateColor);
+        beforeWaiting(&runLoop);
+
+        // Idle turns in between don't open a transaction
+        beforeWaiting(&runLoop);
+    }
+
+    CHECK_EQUAL(runLoop.transactions, turns);
+    CHECK_EQUAL(runLoop.applied.count, turns * 3);
+    for (int i = 0; i < turns * 3; i += 3) {
+        CHECK(runLoop.applied.updates[i] == &windows[0]);
+        CHECK_EQUAL(runLoop.applied.reasons[i + 1], SSLUpdateGeometry | SSLUpdateColor);
+    }
+    printf("  %d marks in %d turns, %d transactions, %d updates applied\n", turns * 13, turns * 2, runLoop.transactions,
+           runLoop.applied.count);
+    freeQueue(&runLoop.queue);
+}
+
+// Marks one update from inside apply, the way a border update can change a frame
+typedef struct Remarking {
+    SSLUpdateQueue *queue;
+    Applied applied;
+    SSLUpdate *trigger;
+    SSLUpdate *marked;
+    uint32_t reasons;
+    bool remove;
+    bool nestedFlush;
+} Remarking;
+
+static void applyRemarking(SSLUpdate *update, uint32_t reasons, void *context) {
+    Remarking *remarking = context;
+    record(update, reasons, &remarking->applied);
+    if (update != remarking->trigger)
+        return;
+
+    if (remarking->remove)
+        SSLUpdateQueueRemove(remarking->queue, remarking->marked);
+    else
+        SSLUpdateQueueMark(remarking->queue, remarking->marked, remarking->reasons);
+
+    if (remarking->nestedFlush)
+        SSLUpdateQueueFlush(remarking->queue, applyRemarking, context);
+}
+
+static void testMarksDuringFlushWait(void) {
+    SSLUpdateQueue queue = { 0 };
+    SSLUpdate windows[3] = { { 0 } };
+
+    // Marking itself from apply is for the next flush, a nested flush does nothing
+    Remarking remarking = { .queue = &queue, .trigger = &windows[0], .marked = &windows[0], .reasons = SSLUpdateColor, .nestedFlush = true };
+    SSLUpdateQueueMark(&queue, &windows[0], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, applyRemarking, &remarking);
+    CHECK_EQUAL(remarking.applied.count, 1);
+    CHECK_EQUAL(queue.count, 1);
+    CHECK_EQUAL(windows[0].reasons, SSLUpdateColor);
+
+    remarking.trigger = NULL;
+    SSLUpdateQueueFlush(&queue, applyRemarking, &remarking);
+    CHECK_EQUAL(remarking.applied.count, 2);
+    CHECK_EQUAL(remarking.applied.reasons[1], SSLUpdateColor);
+    CHECK(SSLUpdateQueueIsEmpty(&queue));
+
+    // One already applied in this flush waits, one still to come gets the reasons now
+    memset(&remarking.applied, 0, sizeof(Applied));
+    remarking.trigger = &windows[1];
+    remarking.marked  = &windows[0];
+    SSLUpdateQueueMark(&queue, &windows[0], SSLUpdateGeometry);
+    SSLUpdateQueueMark(&queue, &windows[1], SSLUpdateGeometry);
+    SSLUpdateQueueMark(&queue, &windows[2], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, applyRemarking, &remarking);
+    CHECK_EQUAL(remarking.applied.count, 3);
+    CHECK_EQUAL(queue.count, 1);
+    CHECK(queue.pending[0] == &windows[0]);
+
+    memset(&remarking.applied, 0, sizeof(Applied));
+    remarking.marked = &windows[2];
+    SSLUpdateQueueMark(&queue, &windows[1], SSLUpdateGeometry);
+    SSLUpdateQueueMark(&queue, &windows[2], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, applyRemarking, &remarking);
+    CHECK_EQUAL(remarking.applied.count, 3);
+    CHECK(remarking.applied.updates[2] == &windows[2]);
+    CHECK_EQUAL(remarking.applied.reasons[2], SSLUpdateGeometry | SSLUpdateColor);
+    CHECK(SSLUpdateQueueIsEmpty(&queue));
+    freeQueue(&queue);
+}
+
+// The key window changes while the urgent ones are applied, the one losing urgency still has to go
+static void applyMovingKey(SSLUpdate *update, uint32_t reasons, void *context) {
+    Remarking *remarking = context;
+    record(update, reasons, &remarking->applied);
+    if (update == remarking->trigger) {
+        update->urgent = false;
+        remarking->marked->urgent = true;
+    }
+}
+
+static void testUrgencyChangesDuringFlush(void) {
+    SSLUpdateQueue queue = { 0 };
+    SSLUpdate windows[3] = { { 0 } };
+    Remarking remarking = { .queue = &queue, .trigger = &windows[1], .marked = &windows[2] };
+
+    windows[1].urgent = true;
+    for (int i = 0; i < 3; i++)
+        SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, applyMovingKey, &remarking);
+
+    CHECK_EQUAL(remarking.applied.count, 3);
+    CHECK(remarking.applied.updates[0] == &windows[1]);
+    for (int i = 0; i < 3; i++)
+        CHECK_EQUAL(windows[i].reasons, 0);
+
+    // Nothing is left behind looking queued
+    SSLUpdateQueueMark(&queue, &windows[2], SSLUpdateColor);
+    CHECK_EQUAL(queue.count, 1);
+    freeQueue(&queue);
+}
+
+static void testRemove(void) {
+    SSLUpdateQueue queue = { 0 };
+    SSLUpdate windows[4] = { { 0 } };
+    Applied applied = { 0 };
+
+    // A window closing before the flush
+    for (int i = 0; i < 4; i++)
+        SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateGeometry);
+    SSLUpdateQueueRemove(&queue, &windows[1]);
+    CHECK_EQUAL(queue.count, 3);
+    CHECK_EQUAL(windows[1].reasons, 0);
+
+    // Removing one that isn't queued is fine
+    SSLUpdateQueueRemove(&queue, &windows[1]);
+    CHECK_EQUAL(queue.count, 3);
+
+    SSLUpdateQueueFlush(&queue, record, &applied);
+    CHECK_EQUAL(applied.count, 3);
+    for (int i = 0; i < applied.count; i++)
+        CHECK(applied.updates[i] != &windows[1]);
+
+    // A window closed by an earlier update in the same flush is skipped
+    Remarking remarking = { .queue = &queue, .trigger = &windows[0], .marked = &windows[2], .remove = true };
+    for (int i = 0; i < 4; i++)
+        SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, applyRemarking, &remarking);
+    CHECK_EQUAL(remarking.applied.count, 3);
+    for (int i = 0; i < remarking.applied.count; i++)
+        CHECK(remarking.applied.updates[i] != &windows[2]);
+
+    // Removing itself from apply, and one already applied, changes nothing
+    memset(&remarking.applied, 0, sizeof(Applied));
+    remarking.trigger = &windows[1];
+    remarking.marked  = &windows[1];
+    for (int i = 0; i < 4; i++)
+        SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateGeometry);
+    SSLUpdateQueueFlush(&queue, applyRemarking, &remarking);
+    CHECK_EQUAL(remarking.applied.count, 4);
+    CHECK(SSLUpdateQueueIsEmpty(&queue));
+    freeQueue(&queue);
+}
+
+static void testManyWindows(void) {
+    SSLUpdateQueue queue = { 0 };
+    const int count = 1000;
+    SSLUpdate *windows = calloc(count, sizeof(SSLUpdate));
+    Applied *applied = calloc(1, sizeof(Applied));
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < count; i++) {
+            windows[i].urgent = i % 100 == 0;
+            CHECK(SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateTitlebar));
+        }
+    }
+    CHECK_EQUAL(queue.count, count);
+
+    SSLUpdateQueueFlush(&queue, record, applied);
+    CHECK_EQUAL(applied->count, count);
+    for (int i = 0; i < 10; i++)
+        CHECK(applied->updates[i]->urgent);
+    CHECK(!applied->updates[10]->urgent);
+
+    free(applied);
+    free(windows);
+    freeQueue(&queue);
+}
+
+// Benchmarks
+
+static void ignore(SSLUpdate *update, uint32_t reasons, void *context) {
+    (void)update;
+    (void)reasons;
+    (void)context;
+}
+
+static void benchTurns(void) {
+    SSLUpdateQueue queue = { 0 };
+    SSLUpdate windows[64] = { { 0 } };
+    windows[0].urgent = true;
+
+    const uint64_t turns = 200000;
+    uint64_t start = nowNanoseconds();
+    for (uint64_t turn = 0; turn < turns; turn++) {
+        for (int event = 0; event < 10; event++) {
+            for (int i = 0; i < 64; i++)
+                SSLUpdateQueueMark(&queue, &windows[i], SSLUpdateGeometry);
+        }
+        SSLUpdateQueueFlush(&queue, ignore, NULL);
+    }
+    benchReport("update_queue_turn_64_windows_10_marks", turns, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (uint64_t turn = 0; turn < turns * 64; turn++) {
+        SSLUpdateQueueMark(&queue, &windows[turn % 64], SSLUpdateColor);
+        SSLUpdateQueueFlush(&queue, ignore, NULL);
+    }
+    benchReport("update_queue_mark_flush_single", turns * 64, nowNanoseconds() - start);
+    freeQueue(&queue);
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchTurns();
+        return 0;
+    }
+
+    RUN(testMarksCoalesce);
+    RUN(testUrgentFirst);
+    RUN(testOneFlushPerTurn);
+    RUN(testMarksDuringFlushWait);
+    RUN(testUrgencyChangesDuringFlush);
+    RUN(testRemove);
+    RUN(testManyWindows);
+    return checkResult();
+}
@@ -0,0 +1,317 @@
+//
+//  SSLWindowRouterTests.c
+//  StopStoplightLight tests
+//
+//  One observer for the app: every notification reaches a window's border once, however often it was focused.
+//
+
+#include "Check.h"
+#include "SSLWindowRouter.h"
+#include <stdlib.h>
+
+#define MAX_OBSERVERS 16
+#define MAX_WINDOWS 64
+
+typedef struct MockWindow {
+    bool key;
+    // updates applied to its border
+    int applied;
+    uint32_t reasons;
+} MockWindow;
+
+/*
+
+ Stands in for NSNotificationCenter with the controller as the observer: one entry per
+ addObserver:selector:name:object:, posting calls every entry observing the event.
+
+ */
+typedef struct MockCenter {
+    SSLWindowEvent observed[MAX_OBSERVERS];
+    int observerCount;
+    int handlerCalls;
+} MockCenter;
+
+typedef struct MockApp {
+    MockCenter center;
+    SSLUpdateQueue queue;
+    SSLWindowRouter router;
+    MockWindow windows[MAX_WINDOWS];
+    int transactions;
+    // what setFrame:display: did for windows without borders
+    int decorations;
+} MockApp;
+
+static void makeApp(MockApp *app) {
+    memset(app, 0, sizeof(MockApp));
+    app->router.queue = &app->queue;
+
+    // What BordersController's init observes, once for the whole app
+    const SSLWindowEvent observed[] = { SSLWindowEventResignKey, SSLWindowEventBecomeKey, SSLWindowEventResize,
+                                        SSLWindowEventWillStartLiveResize, SSLWindowEventEndLiveResize };
+    for (size_t i = 0; i < sizeof(observed) / sizeof(observed[0]); i++)
+        app->center.observed[app->center.observerCount++] = observed[i];
+}
+
+static void freeApp(MockApp *app) {
+    for (int i = 0; i < MAX_WINDOWS; i++)
+        SSLWindowRouterRemove(&app->router, &app->windows[i]);
+    free(app->router.slots);
+    free(app->queue.pending);
+    free(app->queue.flushing);
+}
+
+// registerWindow:, called from every addWindowBorders
+static void addWindowBorders(MockApp *app, MockWindow *window) {
+    CHECK(SSLWindowRouterAdd(&app->router, window) != NULL);
+}
+
+static void post(MockApp *app, SSLWindowEvent event, MockWindow *window) {
+    for (int i = 0; i < app->center.observerCount; i++) {
+        if (app->center.observed[i] != event)
+            continue;
+
+        app->center.handlerCalls++;
+        uint32_t unqueued;
+        SSLWindowRouterDispatch(&app->router, window, event, window->key, &unqueued);
+        CHECK_EQUAL(unqueued, 0);
+    }
+}
+
+static void setFrame(MockApp *app, MockWindow *window) {
+    uint32_t unqueued;
+    if (!SSLWindowRouterDispatch(&app->router, window, SSLWindowEventSetFrame, window->key, &unqueued))
+        app->decorations++;
+}
+
+static void applyUpdate(SSLUpdate *update, uint32_t reasons, void *context) {
+    (void)context;
+    MockWindow *window = update->target;
+    window->applied++;
+    window->reasons |= reasons;
+}
+
+static void flush(MockApp *app) {
+    if (SSLUpdateQueueIsEmpty(&app->queue))
+        return;
+    app->transactions++;
+    SSLUpdateQueueFlush(&app->queue, applyUpdate, NULL);
+}
+
+static void resetCounts(MockApp *app) {
+    app->center.handlerCalls = 0;
+    app->transactions = 0;
+    for (int i = 0; i < MAX_WINDOWS; i++) {
+        app->windows[i].applied = 0;
+        app->windows[i].reasons = 0;
+    }
+}
+
+// makeKeyAndOrderFront: decorates again, the other window resigns key
+static void focus(MockApp *app, MockWindow *window, MockWindow *previous) {
+    addWindowBorders(app, window);
+    previous->key = false;
+    post(app, SSLWindowEventResignKey, previous);
+    window->key = true;
+    post(app, SSLWindowEventBecomeKey, window);
+    flush(app);
+}
+
+static void testOneHandlerCallAfterManyFocuses(void) {
+    MockApp app;
+    makeApp(&app);
+    MockWindow *first = &app.windows[0], *second = &app.windows[1];
+    addWindowBorders(&app, first);
+    addWindowBorders(&app, second);
+
+    for (int i = 0; i < 1000; i++) {
+        focus(&app, first, second);
+        focus(&app, second, first);
+    }
+    CHECK_EQUAL(app.router.count, 2);
+    CHECK_EQUAL(app.center.observerCount, 5);
+
+    // One resize is one handler call and one update of that window's border
+    resetCounts(&app);
+    post(&app, SSLWindowEventResize, first);
+    flush(&app);
+    CHECK_EQUAL(app.center.handlerCalls, 1);
+    CHECK_EQUAL(app.transactions, 1);
+    CHECK_EQUAL(first->applied, 1);
+    CHECK_EQUAL(first->reasons, SSLUpdateGeometry);
+    CHECK_EQUAL(second->applied, 0);
+
+    // A burst of notifications in one run loop turn is still one update
+    resetCounts(&app);
+    for (int i = 0; i < 50; i++)
+        post(&app, SSLWindowEventResize, second);
+    flush(&app);
+    CHECK_EQUAL(app.center.handlerCalls, 50);
+    CHECK_EQUAL(second->applied, 1);
+    freeApp(&app);
+}
+
+static void testWindowsWithoutBordersAreIgnored(void) {
+    MockApp app;
+    makeApp(&app);
+    MockWindow *plain = &app.windows[0];
+
+    post(&app, SSLWindowEventResize, plain);
+    post(&app, SSLWindowEventBecomeKey, plain);
+    flush(&app);
+    CHECK_EQUAL(app.transactions, 0);
+    CHECK_EQUAL(plain->applied, 0);
+
+    // setFrame:display: decorates a window it finds without borders
+    setFrame(&app, plain);
+    CHECK_EQUAL(app.decorations, 1);
+    addWindowBorders(&app, plain);
+    setFrame(&app, plain);
+    CHECK_EQUAL(app.decorations, 1);
+    freeApp(&app);
+}
+
+static void testLiveResize(void) {
+    MockApp app;
+    makeApp(&app);
+    MockWindow *window = &app.windows[0];
+    addWindowBorders(&app, window);
+
+    post(&app, SSLWindowEventWillStartLiveResize, window);
+    flush(&app);
+    CHECK(SSLWindowRouterFind(&app.router, window)->liveResizing);
+
+    // During the resize only the geometry is kept up, setFrame:display: waits for the end
+    resetCounts(&app);
+    for (int frame = 0; frame < 10; frame++) {
+        setFrame(&app, window);
+        flush(&app);
+    }
+    CHECK_EQUAL(window->applied, 0);
+    post(&app, SSLWindowEventResize, window);
+    flush(&app);
+    CHECK_EQUAL(window->reasons, SSLUpdateGeometry);
+
+    resetCounts(&app);
+    post(&app, SSLWindowEventEndLiveResize, window);
+    flush(&app);
+    CHECK(!SSLWindowRouterFind(&app.router, window)->liveResizing);
+    CHECK_EQUAL(window->reasons, SSLUpdateGeometry | SSLUpdateColor | SSLUpdateTitlebar);
+
+    resetCounts(&app);
+    setFrame(&app, window);
+    flush(&app);
+    CHECK_EQUAL(window->applied, 1);
+    freeApp(&app);
+}
+
+static void testKeyWindowFirst(void) {
+    MockApp app;
+    makeApp(&app);
+    for (int i = 0; i < 8; i++)
+        addWindowBorders(&app, &app.windows[i]);
+    app.windows[5].key = true;
+
+    for (int i = 0; i < 8; i++)
+        post(&app, SSLWindowEventResize, &app.windows[i]);
+    for (int i = 0; i < 8; i++)
+        CHECK_EQUAL(app.queue.pending[i]->urgent, i == 5);
+    flush(&app);
+    freeApp(&app);
+}
+
+static void testRemoveTakesTheUpdateOffTheQueue(void) {
+    MockApp app;
+    makeApp(&app);
+    MockWindow *closing = &app.windows[0], *other = &app.windows[1];
+    addWindowBorders(&app, closing);
+    addWindowBorders(&app, other);
+
+    post(&app, SSLWindowEventResize, closing);
+    post(&app, SSLWindowEventResize, other);
+    SSLWindowRouterRemove(&app.router, closing);
+    flush(&app);
+    CHECK_EQUAL(closing->applied, 0);
+    CHECK_EQUAL(other->applied, 1);
+    CHECK(SSLWindowRouterFind(&app.router, closing) == NULL);
+    CHECK_EQUAL(app.router.count, 1);
+
+    // Removing twice, or a window that never had borders, does nothing
+    SSLWindowRouterRemove(&app.router, closing);
+    SSLWindowRouterRemove(&app.router, &app.windows[2]);
+    CHECK_EQUAL(app.router.count, 1);
+
+    // A new window at the same address starts fresh
+    addWindowBorders(&app, closing);
+    CHECK(!SSLWindowRouterFind(&app.router, closing)->liveResizing);
+    CHECK_EQUAL(app.router.count, 2);
+    freeApp(&app);
+}
+
+static void testManyWindowsOpeningAndClosing(void) {
+    MockApp app;
+    makeApp(&app);
+
+    // Windows come and go, the removed slots must not lose anybody nor fill the table
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < MAX_WINDOWS; i++) {
+            if ((i + round) % 3 == 0)
+                SSLWindowRouterRemove(&app.router, &app.windows[i]);
+            else
+                addWindowBorders(&app, &app.windows[i]);
+        }
+        for (int i = 0; i < MAX_WINDOWS; i++)
+            CHECK_EQUAL(SSLWindowRouterFind(&app.router, &app.windows[i]) != NULL, (i + round) % 3 != 0);
+    }
+    CHECK(app.router.capacity <= 4 * MAX_WINDOWS);
+
+    size_t cursor = 0, routes = 0;
+    while (SSLWindowRouterNext(&app.router, &cursor))
+        routes++;
+    CHECK_EQUAL(routes, app.router.count);
+    freeApp(&app);
+}
+
+// Benchmarks
+
+static void benchDispatch(void) {
+    static MockApp app;
+    makeApp(&app);
+    for (int i = 0; i < MAX_WINDOWS; i++)
+        addWindowBorders(&app, &app.windows[i]);
+
+    // The same window focused over and over, handler calls don't grow with it
+    const uint64_t focuses = 100000;
+    for (uint64_t i = 0; i < focuses; i++)
+        focus(&app, &app.windows[i & 1], &app.windows[(i + 1) & 1]);
+
+    const uint64_t events = 10000000;
+    uint64_t start = nowNanoseconds();
+    for (uint64_t i = 0; i < events; i++) {
+        uint32_t unqueued;
+        SSLWindowRouterDispatch(&app.router, &app.windows[i % MAX_WINDOWS], SSLWindowEventResize, false, &unqueued);
+    }
+    benchReport("window_router_dispatch_64_windows", events, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    volatile uintptr_t sink = 0;
+    for (uint64_t i = 0; i < events; i++)
+        sink = (uintptr_t)SSLWindowRouterFind(&app.router, &app.windows[i % MAX_WINDOWS]);
+    benchReport("window_router_find_64_windows", events, nowNanoseconds() - start);
+    (void)sink;
+    freeApp(&app);
+}
+
+int main(int argc, char **argv) {
+    if (benchRequested(argc, argv)) {
+        benchDispatch();
+        return 0;
+    }
+
+    RUN(testOneHandlerCallAfterManyFocuses);
+    RUN(testWindowsWithoutBordersAreIgnored);
+    RUN(testLiveResize);
+    RUN(testKeyWindowFirst);
+    RUN(testRemoveTakesTheUpdateOffTheQueue);
+    RUN(testManyWindowsOpeningAndClosing);
+    return checkResult();
+}
@@ -0,0 +1,197 @@
+//
+//  ZKHookStatsTests.m
+//  StopStoplightLight tests
+//
+//  Tests of the ZKOrig call counts and ZKHookTimed() latencies, built with ZKSWIZZLE_STATS=1.
+//
+
+#import "ZKSwizzle.h"
+#import <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "Check.h"
+
+#if !ZKSWIZZLE_STATS
+#error ZKHookStatsTests has to be built with ZKSWIZZLE_STATS=1
+#endif
+
+@interface ZKStatsTarget : NSObject
+- (long)value;
+- (long)other;
+- (long)slow;
+@end
+
+@implementation ZKStatsTarget
+- (long)value { return 1; }
+- (long)other { return 2; }
+- (long)slow { return 3; }
+@end
+
+// Inherits the hooked methods
+@interface ZKStatsChild : ZKStatsTarget
+@end
+
+@implementation ZKStatsChild
+@end
+
+@interface ZKStatsHook : ZKStatsTarget
+@end
+
+@implementation ZKStatsHook
+- (long)value {
+    ZKHookTimed();
+    return ZKOrig(long) + 10;
+}
+
+// Counted but not timed
+- (long)other {
+    return ZKOrig(long) + 10;
+}
+
+- (long)slow {
+    ZKHookTimed();
+    usleep(1000);
+    return ZKOrig(long) + 10;
+}
+@end
+
+// The counters of the hooks on sel of ZKStatsTarget in a fresh snapshot, all zero if they never recorded anything
+static ZKHookStats statsFor(SEL sel) {
+    ZKHookStats found = { [ZKStatsTarget class], sel, 0, 0, { 0 } };
+    unsigned int count;
+    ZKHookStats *snapshot = ZKHookStatsSnapshot(&count);
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (snapshot[i].cls == [ZKStatsTarget class] && sel_isEqual(snapshot[i].sel, sel))
+            found = snapshot[i];
+    }
+
+    free(snapshot);
+    return found;
+}
+
+static uint64_t latencyTotal(ZKHookStats stats, unsigned int fromBucket) {
+    uint64_t total = 0;
+    for (unsigned int bucket = fromBucket; bucket < ZK_STATS_BUCKETS; bucket++)
+        total += stats.latency[bucket];
+    return total;
+}
+
+static void testCountsCalls(void) {
+    ZKStatsTarget *object = [ZKStatsTarget new];
+    ZKHookStatsReset();
+
+    for (int i = 0; i < 1000; i++)
+        CHECK_EQUAL([object value], 11);
+    for (int i = 0; i < 10; i++)
+        CHECK_EQUAL([object other], 12);
+
+    ZKHookStats value = statsFor(@selector(value));
+    CHECK_EQUAL(value.calls, 1000);
+    CHECK_EQUAL(value.timedCalls, 1000);
+    CHECK_EQUAL(latencyTotal(value, 0), 1000);
+
+    ZKHookStats other = statsFor(@selector(other));
+    CHECK_EQUAL(other.calls, 10);
+    CHECK_EQUAL(other.timedCalls, 0);
+    CHECK_EQUAL(latencyTotal(other, 0), 0);
+
+    // Counted for the class the hook went into, not the receiver's
+    ZKStatsChild *child = [ZKStatsChild new];
+    for (int i = 0; i < 5; i++)
+        CHECK_EQUAL([child other], 12);
+    CHECK_EQUAL(statsFor(@selector(other)).calls, 15);
+}
+
+// Sleeping for a millisecond takes at least 2^19 nanoseconds, so nothing may land in the buckets below
+static void testLatencyBuckets(void) {
+    ZKStatsTarget *object = [ZKStatsTarget new];
+    ZKHookStatsReset();
+
+    for (int i = 0; i < 20; i++)
+        CHECK_EQUAL([object slow], 13);
+
+    ZKHookStats slow = statsFor(@selector(slow));
+    CHECK_EQUAL(slow.calls, 20);
+    CHECK_EQUAL(slow.timedCalls, 20);
+    CHECK_EQUAL(latencyTotal(slow, 19), 20);
+    CHECK_EQUAL(latencyTotal(slow, 0), 20);
+}
+
+#define THREADS 8
+#define THREAD_CALLS 5000
+
+static void *callValue(void *argument) {
+    ZKStatsTarget *object = (__bridge ZKStatsTarget *)argument;
+    for (int i = 0; i < THREAD_CALLS; i++)
+        [object value];
+    return NULL;
+}
+
+// Every thread counts into a block of its own, the snapshot has to add up all of them even after the threads exited
+static void testThreadsAddUp(void) {
+    ZKStatsTarget *object = [ZKStatsTarget new];
+    ZKHookStatsReset();
+
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, callValue, (__bridge void *)object);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    [object value];
+
+    ZKHookStats value = statsFor(@selector(value));
+    CHECK_EQUAL(value.calls, THREADS * THREAD_CALLS + 1);
+    CHECK_EQUAL(value.timedCalls, THREADS * THREAD_CALLS + 1);
+    CHECK_EQUAL(latencyTotal(value, 0), THREADS * THREAD_CALLS + 1);
+
+    // Threads started after the first ones are gone reuse their blocks without counting twice
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, callValue, (__bridge void *)object);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CHECK_EQUAL(statsFor(@selector(value)).calls, 2 * THREADS * THREAD_CALLS + 1);
+}
+
+static void testReset(void) {
+    ZKStatsTarget *object = [ZKStatsTarget new];
+    for (int i = 0; i < 100; i++) {
+        [object value];
+        [object other];
+    }
+
+    ZKHookStatsReset();
+    ZKHookStats value = statsFor(@selector(value));
+    CHECK_EQUAL(value.calls, 0);
+    CHECK_EQUAL(value.timedCalls, 0);
+    CHECK_EQUAL(latencyTotal(value, 0), 0);
+    CHECK_EQUAL(statsFor(@selector(other)).calls, 0);
+
+    for (int i = 0; i < 5; i++)
+        [object value];
+    CHECK_EQUAL(statsFor(@selector(value)).calls, 5);
+    CHECK_EQUAL(statsFor(@selector(other)).calls, 0);
+
+    // A second reset starts over from where the counters are now, not from the first one
+    ZKHookStatsReset();
+    [object other];
+    CHECK_EQUAL(statsFor(@selector(value)).calls, 0);
+    CHECK_EQUAL(statsFor(@selector(other)).calls, 1);
+}
+
+int main(void) {
+    @autoreleasepool {
+        if (!ZKSwizzleBound(ZKStatsHook, ZKStatsTarget)) {
+            fprintf(stderr, "couldn't install ZKStatsHook\n");
+            return 1;
+        }
+
+        RUN(testCountsCalls);
+        RUN(testLatencyBuckets);
+        RUN(testThreadsAddUp);
+        RUN(testReset);
+    }
+    return checkResult();
+}
@@ -0,0 +1,58 @@
+//
+//  ZKLoadOrderTests.m
+//  StopStoplightLight tests
+//
+//  Immediate hooks get installed whichever runs first, ZKSwizzle's constructor or the runtime loading the
+//  classes. This file is linked after ZKSwizzle, and a hook whose target is made at run time stands in for
+//  classes the runtime loads after the constructor ran.
+//
+
+#import "ZKSwizzle.h"
+#include "Check.h"
+
+@interface ZKLoadTarget : NSObject
+- (long)value;
+@end
+
+@implementation ZKLoadTarget
+- (long)value { return 1; }
+@end
+
+ZKSwizzleInterface(ZKLoadHook, ZKLoadTarget, NSObject)
+
+@implementation ZKLoadHook
+- (long)value { return ZKOrig(long) + 10; }
+@end
+
+// ZKLateTarget only exists once the test makes it
+ZKSwizzleInterface(ZKLateHook, ZKLateTarget, NSObject)
+
+@implementation ZKLateHook
+- (long)value { return ZKOrig(long) + 20; }
+@end
+
+static long lateValue(id self, SEL _cmd) {
+    return 2;
+}
+
+static void testHookInSameImage(void) {
+    CHECK_EQUAL([[ZKLoadTarget new] value], 11);
+}
+
+static void testHookOnClassMadeLater(void) {
+    Class late = objc_allocateClassPair([NSObject class], "ZKLateTarget", 0);
+    CHECK(late != Nil);
+    Method value = class_getInstanceMethod([ZKLoadTarget class], @selector(value));
+    class_addMethod(late, @selector(value), (IMP)lateValue, method_getTypeEncoding(value));
+    objc_registerClassPair(late);
+
+    CHECK_EQUAL([[late new] value], 22);
+}
+
+int main(void) {
+    @autoreleasepool {
+        RUN(testHookInSameImage);
+        RUN(testHookOnClassMadeLater);
+    }
+    return checkResult();
+}
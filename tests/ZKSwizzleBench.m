@@ -0,0 +1,753 @@
+//
+//  ZKSwizzleBench.m
+//  StopStoplightLight tests
+//
+//  Benchmarks of ZKSwizzle dispatch, ivar access and installation on the GNUstep runtime.
+//
+
+#import "ZKSwizzle.h"
+#import <pthread.h>
+#include "Check.h"
+
+#define CALLS 10000000
+// For the paths that look something up on every call
+#define SLOW_CALLS (CALLS / 100)
+
+// Keeps the compiler from dropping the loops
+static volatile long sink;
+
+#pragma mark - Dispatch
+
+@interface ZKBenchPlain : NSObject
+- (long)direct:(long)a;
+- (long)hooked:(long)a;
+- (long)args1:(long)a;
+- (long)args2:(long)a :(long)b;
+- (long)args4:(long)a :(long)b :(long)c :(long)d;
+- (long)args8:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h;
+- (long)args16:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h
+              :(long)i :(long)j :(long)k :(long)l :(long)m :(long)n :(long)o :(long)p;
+- (long)args20:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h
+              :(long)i :(long)j :(long)k :(long)l :(long)m :(long)n :(long)o :(long)p
+              :(long)q :(long)r :(long)s :(long)t;
+@end
+
+@implementation ZKBenchPlain
+- (long)direct:(long)a { return a; }
+- (long)hooked:(long)a { return a; }
+- (long)args1:(long)a { return a; }
+- (long)args2:(long)a :(long)b { return a + b; }
+- (long)args4:(long)a :(long)b :(long)c :(long)d { return a + b + c + d; }
+- (long)args8:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h {
+    return a + b + c + d + e + f + g + h;
+}
+- (long)args16:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h
+              :(long)i :(long)j :(long)k :(long)l :(long)m :(long)n :(long)o :(long)p {
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p;
+}
+- (long)args20:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h
+              :(long)i :(long)j :(long)k :(long)l :(long)m :(long)n :(long)o :(long)p
+              :(long)q :(long)r :(long)s :(long)t {
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p + q + r + s + t;
+}
+@end
+
+// Inherits everything so the hooks below leave ZKBenchPlain untouched as the baseline
+@interface ZKBenchTarget : ZKBenchPlain
+@end
+
+@implementation ZKBenchTarget
+@end
+
+ZKSwizzleInterfaceGroup(ZKBenchHook, ZKBenchTarget, ZKBenchPlain, ZKBench)
+@implementation ZKBenchHook
+- (long)hooked:(long)a { return ZKOrig(long, a); }
+- (long)args1:(long)a { return ZKOrig(long, a); }
+- (long)args2:(long)a :(long)b { return ZKOrig(long, a, b); }
+- (long)args4:(long)a :(long)b :(long)c :(long)d { return ZKOrig(long, a, b, c, d); }
+- (long)args8:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h {
+    return ZKOrig(long, a, b, c, d, e, f, g, h);
+}
+- (long)args16:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h
+              :(long)i :(long)j :(long)k :(long)l :(long)m :(long)n :(long)o :(long)p {
+    return ZKOrig(long, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p);
+}
+- (long)args20:(long)a :(long)b :(long)c :(long)d :(long)e :(long)f :(long)g :(long)h
+              :(long)i :(long)j :(long)k :(long)l :(long)m :(long)n :(long)o :(long)p
+              :(long)q :(long)r :(long)s :(long)t {
+    return ZKOrig(long, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q, r, s, t);
+}
+@end
+
+static void benchDispatch(void) {
+    ZKBenchPlain *plain   = [ZKBenchPlain new];
+    ZKBenchTarget *target = [ZKBenchTarget new];
+
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [plain direct:i];
+    benchReport("zkswizzle_direct_send", CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [target hooked:i];
+    benchReport("zkswizzle_zkorig_dispatch", CALLS, nowNanoseconds() - start);
+}
+
+// Every arity once straight and once through a hook, the difference is what ZKOrig costs
+#define BENCH_ARGS(COUNT, RECEIVER, CALL)                                                         \
+    do {                                                                                          \
+        uint64_t _start = nowNanoseconds();                                                       \
+        for (long i = 0; i < CALLS; i++)                                                          \
+            sink = [RECEIVER CALL];                                                               \
+        benchReport("zkswizzle_" #RECEIVER "_args_" #COUNT, CALLS, nowNanoseconds() - _start);    \
+    } while (0)
+
+static void benchArguments(void) {
+    ZKBenchPlain *direct = [ZKBenchPlain new];
+    ZKBenchTarget *hooked = [ZKBenchTarget new];
+
+    BENCH_ARGS(1, direct, args1:i);
+    BENCH_ARGS(1, hooked, args1:i);
+    BENCH_ARGS(2, direct, args2:i :i);
+    BENCH_ARGS(2, hooked, args2:i :i);
+    BENCH_ARGS(4, direct, args4:i :i :i :i);
+    BENCH_ARGS(4, hooked, args4:i :i :i :i);
+    BENCH_ARGS(8, direct, args8:i :i :i :i :i :i :i :i);
+    BENCH_ARGS(8, hooked, args8:i :i :i :i :i :i :i :i);
+    BENCH_ARGS(16, direct, args16:i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i);
+    BENCH_ARGS(16, hooked, args16:i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i);
+    BENCH_ARGS(20, direct, args20:i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i);
+    BENCH_ARGS(20, hooked, args20:i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i :i);
+}
+
+#pragma mark - Call site caches
+
+// Hooked with _ZKSwizzle, so both methods have to find the _ZK_old_ selector the engine added
+@interface ZKBenchResolve : NSObject
+- (long)uncached:(long)a;
+- (long)cached:(long)a;
+@end
+
+@implementation ZKBenchResolve
+- (long)uncached:(long)a { return a; }
+- (long)cached:(long)a { return a; }
+@end
+
+@interface ZKBenchResolveHook : NSObject
+@end
+
+@implementation ZKBenchResolveHook
+// What ZKOrig expanded to before call sites had a cache
+- (long)uncached:(long)a {
+    return ((long (*)(id, SEL, long))ZKOriginalImplementation(self, _cmd, __PRETTY_FUNCTION__))(self, _cmd, a);
+}
+- (long)cached:(long)a { return ZKOrig(long, a); }
+@end
+
+static void benchCallSiteCache(void) {
+    if (!ZKSwizzle(ZKBenchResolveHook, ZKBenchResolve)) {
+        fprintf(stderr, "couldn't install ZKBenchResolveHook\n");
+        return;
+    }
+    ZKBenchResolve *object = [ZKBenchResolve new];
+
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < SLOW_CALLS; i++)
+        sink = [object uncached:i];
+    benchReport("zkswizzle_zkorig_uncached_lookup", SLOW_CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [object cached:i];
+    benchReport("zkswizzle_zkorig_cached_call_site", CALLS, nowNanoseconds() - start);
+    ZKUnswizzle(ZKBenchResolveHook);
+}
+
+#pragma mark - Engines
+
+// The same hook installed by each engine into a class of its own
+@interface ZKBenchEngine : NSObject
+- (long)engine:(long)a;
+@end
+
+@implementation ZKBenchEngine
+- (long)engine:(long)a { return a; }
+@end
+
+@interface ZKBenchOldEngine : ZKBenchEngine
+@end
+
+@implementation ZKBenchOldEngine
+@end
+
+@interface ZKBenchBoundEngine : ZKBenchEngine
+@end
+
+@implementation ZKBenchBoundEngine
+@end
+
+@interface ZKBenchOldEngineHook : NSObject
+@end
+
+@implementation ZKBenchOldEngineHook
+- (long)engine:(long)a { return ZKOrig(long, a); }
+@end
+
+@interface ZKBenchBoundEngineHook : NSObject
+@end
+
+@implementation ZKBenchBoundEngineHook
+- (long)engine:(long)a { return ZKOrig(long, a); }
+@end
+
+static void benchEngines(void) {
+    if (!ZKSwizzle(ZKBenchOldEngineHook, ZKBenchOldEngine) || !ZKSwizzleBound(ZKBenchBoundEngineHook, ZKBenchBoundEngine)) {
+        fprintf(stderr, "couldn't install the engine hooks\n");
+        return;
+    }
+    ZKBenchOldEngine *old     = [ZKBenchOldEngine new];
+    ZKBenchBoundEngine *bound = [ZKBenchBoundEngine new];
+
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [old engine:i];
+    benchReport("zkswizzle_engine_zk_old", CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [bound engine:i];
+    benchReport("zkswizzle_engine_bound", CALLS, nowNanoseconds() - start);
+
+    ZKUnswizzle(ZKBenchOldEngineHook);
+    ZKUnswizzle(ZKBenchBoundEngineHook);
+}
+
+#pragma mark - Unswizzling
+
+// Implements the method itself, so taking the hook out leaves the class as it was
+@interface ZKBenchToggled : NSObject
+- (long)toggled:(long)a;
+@end
+
+@implementation ZKBenchToggled
+- (long)toggled:(long)a { return a; }
+@end
+
+ZKSwizzleInterfaceGroup(ZKBenchToggleHook, ZKBenchToggled, NSObject, ZKBenchToggle)
+@implementation ZKBenchToggleHook
+- (long)toggled:(long)a { return ZKOrig(long, a); }
+@end
+
+// What a feature turned off at runtime leaves behind: a dispatch should cost what it did before the hook
+static void benchUnswizzledDispatch(void) {
+    ZKBenchToggled *object = [ZKBenchToggled new];
+    static const char *const phases[] = {
+        "zkswizzle_toggle_before_hook", "zkswizzle_toggle_hooked",
+        "zkswizzle_toggle_unswizzled", "zkswizzle_toggle_hooked_again",
+    };
+
+    for (size_t phase = 0; phase < sizeof(phases) / sizeof(phases[0]); phase++) {
+        if (phase == 1 || phase == 3)
+            ZKSwizzleGroup(ZKBenchToggle);
+        else if (phase == 2)
+            ZKUnswizzleGroup(ZKBenchToggle);
+
+        uint64_t start = nowNanoseconds();
+        for (long i = 0; i < CALLS; i++)
+            sink = [object toggled:i];
+        benchReport(phases[phase], CALLS, nowNanoseconds() - start);
+    }
+    ZKUnswizzleGroup(ZKBenchToggle);
+}
+
+#pragma mark - Stats
+
+// In ZKSwizzleBenchStats.m, which counts what its hooks do
+uint64_t ZKBenchStatsDispatch(long calls, BOOL timed);
+
+static void benchStats(void) {
+    ZKBenchTarget *target = [ZKBenchTarget new];
+
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [target hooked:i];
+    benchReport("zkswizzle_stats_off", CALLS, nowNanoseconds() - start);
+
+    benchReport("zkswizzle_stats_counted", CALLS, ZKBenchStatsDispatch(CALLS, NO));
+    benchReport("zkswizzle_stats_timed", CALLS, ZKBenchStatsDispatch(CALLS, YES));
+}
+
+#pragma mark - Hook chains
+
+// As if every plugin in the process hooked the same method
+@interface ZKBenchChained : NSObject
+- (long)chained:(long)a;
+@end
+
+@implementation ZKBenchChained
+- (long)chained:(long)a { return a; }
+@end
+
+#define BENCH_CHAIN_HOOK(INDEX) \
+    @interface ZKBenchChainHook ## INDEX : NSObject @end \
+    @implementation ZKBenchChainHook ## INDEX \
+    - (long)chained:(long)a { return ZKOrig(long, a); } \
+    @end
+
+BENCH_CHAIN_HOOK(0)  BENCH_CHAIN_HOOK(1)  BENCH_CHAIN_HOOK(2)  BENCH_CHAIN_HOOK(3)
+BENCH_CHAIN_HOOK(4)  BENCH_CHAIN_HOOK(5)  BENCH_CHAIN_HOOK(6)  BENCH_CHAIN_HOOK(7)
+BENCH_CHAIN_HOOK(8)  BENCH_CHAIN_HOOK(9)  BENCH_CHAIN_HOOK(10) BENCH_CHAIN_HOOK(11)
+BENCH_CHAIN_HOOK(12) BENCH_CHAIN_HOOK(13) BENCH_CHAIN_HOOK(14) BENCH_CHAIN_HOOK(15)
+
+static void benchChains(void) {
+    static const unsigned int lengths[] = { 1, 4, 16 };
+    ZKBenchChained *object = [ZKBenchChained new];
+    unsigned int installed = 0;
+
+    for (size_t length = 0; length < sizeof(lengths) / sizeof(lengths[0]); length++) {
+        for (; installed < lengths[length]; installed++) {
+            char name[32];
+            snprintf(name, sizeof(name), "ZKBenchChainHook%u", installed);
+            if (!_ZKSwizzleBound(objc_getClass(name), [ZKBenchChained class])) {
+                fprintf(stderr, "couldn't chain %s\n", name);
+                return;
+            }
+        }
+
+        uint64_t start = nowNanoseconds();
+        for (long i = 0; i < CALLS; i++)
+            sink = [object chained:i];
+        char name[64];
+        snprintf(name, sizeof(name), "zkswizzle_chain_%u_hooks", installed);
+        benchReport(name, CALLS, nowNanoseconds() - start);
+    }
+
+    for (unsigned int i = 0; i < installed; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "ZKBenchChainHook%u", i);
+        _ZKUnswizzle(objc_getClass(name));
+    }
+}
+
+#pragma mark - Single objects
+
+// Like windows of which only a few get borders
+@interface ZKBenchWindow : NSObject
+- (long)frame:(long)a;
+@end
+
+@implementation ZKBenchWindow
+- (long)frame:(long)a { return a; }
+@end
+
+@interface ZKBenchWindowInstanceHook : NSObject
+@end
+
+@implementation ZKBenchWindowInstanceHook
+- (long)frame:(long)a { return ZKOrig(long, a); }
+@end
+
+@interface ZKBenchWindowClassHook : NSObject
+@end
+
+@implementation ZKBenchWindowClassHook
+- (long)frame:(long)a { return ZKOrig(long, a); }
+@end
+
+#define BENCH_WINDOWS 100
+
+static void benchWindowCalls(const char *name, ZKBenchWindow *__strong *windows) {
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [windows[i % BENCH_WINDOWS] frame:i];
+    benchReport(name, CALLS, nowNanoseconds() - start);
+}
+
+// Calls spread over all the objects, every hundredth of them hooked alone or all of them through the class
+static void benchInstances(void) {
+    ZKBenchWindow *windows[BENCH_WINDOWS];
+    for (int i = 0; i < BENCH_WINDOWS; i++)
+        windows[i] = [ZKBenchWindow new];
+
+    benchWindowCalls("zkswizzle_instances_none_hooked", windows);
+
+    if (!ZKSwizzleInstance(windows[0], ZKBenchWindowInstanceHook)) {
+        fprintf(stderr, "couldn't hook a single window\n");
+        return;
+    }
+    benchWindowCalls("zkswizzle_instances_1_percent_hooked", windows);
+    ZKUnswizzleInstance(windows[0], ZKBenchWindowInstanceHook);
+
+    if (!ZKSwizzleBound(ZKBenchWindowClassHook, ZKBenchWindow)) {
+        fprintf(stderr, "couldn't hook ZKBenchWindow\n");
+        return;
+    }
+    benchWindowCalls("zkswizzle_instances_class_hooked", windows);
+    ZKUnswizzle(ZKBenchWindowClassHook);
+}
+
+#pragma mark - ZKSuper
+
+// Only the root implements -depth, every lookup below it has to walk up the whole hierarchy
+@interface ZKBenchLevel0 : NSObject
+- (long)depth;
++ (long)classDepth;
+@end
+
+@implementation ZKBenchLevel0
+- (long)depth { return 0; }
++ (long)classDepth { return 0; }
+@end
+
+#define BENCH_LEVEL(LEVEL, SUPER) \
+    @interface ZKBenchLevel ## LEVEL : ZKBenchLevel ## SUPER @end \
+    @implementation ZKBenchLevel ## LEVEL @end
+
+BENCH_LEVEL(1, 0)   BENCH_LEVEL(2, 1)   BENCH_LEVEL(3, 2)   BENCH_LEVEL(4, 3)
+BENCH_LEVEL(5, 4)   BENCH_LEVEL(6, 5)   BENCH_LEVEL(7, 6)   BENCH_LEVEL(8, 7)
+BENCH_LEVEL(9, 8)   BENCH_LEVEL(10, 9)  BENCH_LEVEL(11, 10) BENCH_LEVEL(12, 11)
+BENCH_LEVEL(13, 12) BENCH_LEVEL(14, 13) BENCH_LEVEL(15, 14) BENCH_LEVEL(16, 15)
+
+ZKSwizzleInterfaceGroup(ZKBenchDeepHook, ZKBenchLevel16, ZKBenchLevel16, ZKBench)
+@implementation ZKBenchDeepHook
+- (long)depth { return ZKSuper(long) + 1; }
++ (long)classDepth { return ZKSuper(long) + 1; }
+@end
+
+static void benchSuper(void) {
+    ZKBenchLevel15 *unhooked = [ZKBenchLevel15 new];
+    ZKBenchLevel16 *hooked   = [ZKBenchLevel16 new];
+
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [unhooked depth];
+    benchReport("zkswizzle_direct_send_depth_15", CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [hooked depth];
+    benchReport("zkswizzle_zksuper_depth_16", CALLS, nowNanoseconds() - start);
+
+    // The same through the metaclasses
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [ZKBenchLevel15 classDepth];
+    benchReport("zkswizzle_direct_class_send_depth_15", CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = [ZKBenchLevel16 classDepth];
+    benchReport("zkswizzle_zksuper_metaclass_depth_16", CALLS, nowNanoseconds() - start);
+}
+
+#pragma mark - Instance variables
+
+// The ivar looked up is the last of many, which is the slow case for the uncached ZKIvarPointer
+@interface ZKBenchIvars : NSObject {
+@public
+    long _pad0, _pad1, _pad2, _pad3, _pad4, _pad5, _pad6, _pad7;
+    long _pad8, _pad9, _pad10, _pad11, _pad12, _pad13, _pad14, _pad15;
+    long _value;
+}
+@end
+
+@implementation ZKBenchIvars
+@end
+
+static void benchIvars(void) {
+    ZKBenchIvars *object = [ZKBenchIvars new];
+    object->_value = 1;
+
+    uint64_t start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = object->_value;
+    benchReport("zkswizzle_ivar_direct", CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = *(long *)ZKIvarPointer(object, "_value");
+    benchReport("zkswizzle_ivar_zkivarpointer", CALLS, nowNanoseconds() - start);
+
+    start = nowNanoseconds();
+    for (long i = 0; i < CALLS; i++)
+        sink = ZKHookIvar(object, long, "_value");
+    benchReport("zkswizzle_ivar_zkhookivar", CALLS, nowNanoseconds() - start);
+}
+
+#pragma mark - Installation
+
+static long largeOriginal(id self, SEL _cmd) {
+    (void)self;
+    (void)_cmd;
+    return 0;
+}
+
+static long largeHook(id self, SEL _cmd) {
+    (void)self;
+    (void)_cmd;
+    return 1;
+}
+
+// A class answering methods selectors that all run implementation, once as the target and once as the hook
+static Class largeClass(const char *prefix, unsigned int methods, IMP implementation) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%u", prefix, methods);
+    Class cls = objc_allocateClassPair([NSObject class], name, 0);
+
+    for (unsigned int i = 0; i < methods; i++) {
+        char selector[32];
+        snprintf(selector, sizeof(selector), "method%u", i);
+        class_addMethod(cls, sel_registerName(selector), implementation, "l@:");
+    }
+
+    objc_registerClassPair(cls);
+    return cls;
+}
+
+static void benchInstall(void) {
+    static const unsigned int sizes[] = { 10, 100, 1000, 5000 };
+
+    for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+        unsigned int methods = sizes[size];
+        Class target = largeClass("ZKBenchLarge", methods, (IMP)largeOriginal);
+        Class hook   = largeClass("ZKBenchLargeHook", methods, (IMP)largeHook);
+        char name[64];
+
+        // The first install also reads the hook class into its manifest
+        uint64_t start = nowNanoseconds();
+        _ZKSwizzleBound(hook, target);
+        snprintf(name, sizeof(name), "zkswizzle_install_first_%u_methods", methods);
+        benchReport(name, methods, nowNanoseconds() - start);
+
+        start = nowNanoseconds();
+        _ZKUnswizzle(hook);
+        snprintf(name, sizeof(name), "zkswizzle_unswizzle_%u_methods", methods);
+        benchReport(name, methods, nowNanoseconds() - start);
+
+        start = nowNanoseconds();
+        _ZKSwizzleBound(hook, target);
+        snprintf(name, sizeof(name), "zkswizzle_install_again_%u_methods", methods);
+        benchReport(name, methods, nowNanoseconds() - start);
+        _ZKUnswizzle(hook);
+
+        start = nowNanoseconds();
+        ZKSwizzleBegin();
+        _ZKSwizzleBound(hook, target);
+        ZKSwizzleCommit();
+        snprintf(name, sizeof(name), "zkswizzle_install_transaction_%u_methods", methods);
+        benchReport(name, methods, nowNanoseconds() - start);
+        _ZKUnswizzle(hook);
+    }
+}
+
+#pragma mark - Startup
+
+// A plugin's worth of hooks, each on a class of its own
+#define BENCH_STARTUP_HOOK(INDEX) \
+    @interface ZKBenchStartupTarget ## INDEX : NSObject @end \
+    @implementation ZKBenchStartupTarget ## INDEX \
+    - (long)start:(long)a { return a; } \
+    @end \
+    ZKSwizzleInterfaceGroup(ZKBenchStartupHook ## INDEX, ZKBenchStartupTarget ## INDEX, NSObject, ZKBenchStartup) \
+    @implementation ZKBenchStartupHook ## INDEX \
+    - (long)start:(long)a { return ZKOrig(long, a); } \
+    @end
+
+BENCH_STARTUP_HOOK(0)  BENCH_STARTUP_HOOK(1)  BENCH_STARTUP_HOOK(2)  BENCH_STARTUP_HOOK(3)
+BENCH_STARTUP_HOOK(4)  BENCH_STARTUP_HOOK(5)  BENCH_STARTUP_HOOK(6)  BENCH_STARTUP_HOOK(7)
+BENCH_STARTUP_HOOK(8)  BENCH_STARTUP_HOOK(9)  BENCH_STARTUP_HOOK(10) BENCH_STARTUP_HOOK(11)
+BENCH_STARTUP_HOOK(12) BENCH_STARTUP_HOOK(13) BENCH_STARTUP_HOOK(14) BENCH_STARTUP_HOOK(15)
+
+#define BENCH_STARTUP_HOOKS 16
+#define STARTUP_ROUNDS 100
+
+// Swizzles the group again and again, only the installs are timed
+static void benchGroupInstall(const char *name, const char *group) {
+    uint64_t elapsed = 0;
+    for (int round = 0; round < STARTUP_ROUNDS; round++) {
+        uint64_t start = nowNanoseconds();
+        _ZKSwizzleGroup(group);
+        elapsed += nowNanoseconds() - start;
+        _ZKUnswizzleGroup(group);
+    }
+    benchReport(name, BENCH_STARTUP_HOOKS * STARTUP_ROUNDS, elapsed);
+}
+
+// The group as the linker section describes it, against the same hooks registered one by one the
+// way their +load used to. Both install through _ZKSwizzleBound, the difference is finding them
+static void benchStartup(void) {
+    // Reads the hook classes into their manifests, which happens once per launch either way. Every
+    // install after it and every unswizzle work from the manifests instead of the method lists
+    uint64_t first = nowNanoseconds();
+    ZKSwizzleGroup(ZKBenchStartup);
+    benchReport("zkswizzle_startup_first_16_hooks", BENCH_STARTUP_HOOKS, nowNanoseconds() - first);
+    ZKUnswizzleGroup(ZKBenchStartup);
+
+    benchGroupInstall("zkswizzle_startup_descriptors_16_hooks", "ZKBenchStartup");
+
+    // Registered names have to outlive the registration
+    static char targets[BENCH_STARTUP_HOOKS][32];
+    uint64_t start = nowNanoseconds();
+    for (int i = 0; i < BENCH_STARTUP_HOOKS; i++) {
+        char hook[32];
+        snprintf(hook, sizeof(hook), "ZKBenchStartupHook%d", i);
+        snprintf(targets[i], sizeof(targets[i]), "ZKBenchStartupTarget%d", i);
+        _$ZKRegisterInterface(objc_getClass(hook), targets[i], "ZKBenchStartupByHand");
+    }
+    benchReport("zkswizzle_startup_register_16_hooks", BENCH_STARTUP_HOOKS, nowNanoseconds() - start);
+
+    benchGroupInstall("zkswizzle_startup_registered_16_hooks", "ZKBenchStartupByHand");
+}
+
+#pragma mark - Contention
+
+// Every thread goes through the same ZKOrig call site and hook slot
+typedef struct ContendedThread {
+    pthread_barrier_t *barrier;
+    __unsafe_unretained ZKBenchTarget *target;
+    long calls;
+} ContendedThread;
+
+static void *contendedCalls(void *argument) {
+    ContendedThread *thread = argument;
+    ZKBenchTarget *target = thread->target;
+    long sum = 0;
+
+    pthread_barrier_wait(thread->barrier);
+    for (long i = 0; i < thread->calls; i++)
+        sum += [target hooked:i];
+
+    sink = sum;
+    return NULL;
+}
+
+static void benchContended(void) {
+    static const unsigned int threadCounts[] = { 1, 2, 4, 8, 16 };
+    ZKBenchTarget *target = [ZKBenchTarget new];
+
+    for (size_t count = 0; count < sizeof(threadCounts) / sizeof(threadCounts[0]); count++) {
+        unsigned int threads = threadCounts[count];
+        pthread_t handles[16];
+        ContendedThread contended[16];
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, NULL, threads + 1);
+
+        for (unsigned int i = 0; i < threads; i++) {
+            contended[i] = (ContendedThread){ &barrier, target, CALLS / threads };
+            pthread_create(&handles[i], NULL, contendedCalls, &contended[i]);
+        }
+
+        // Wall time for all of them, so ns_per_op drops as long as the threads scale
+        pthread_barrier_wait(&barrier);
+        uint64_t start = nowNanoseconds();
+        for (unsigned int i = 0; i < threads; i++)
+            pthread_join(handles[i], NULL);
+        uint64_t elapsed = nowNanoseconds() - start;
+        pthread_barrier_destroy(&barrier);
+
+        char name[64];
+        snprintf(name, sizeof(name), "zkswizzle_zkorig_contended_%u_threads", threads);
+        benchReport(name, (uint64_t)(CALLS / threads) * threads, elapsed);
+    }
+}
+
+// Installs and unswizzles a hook over and over while other threads call through it
+@interface ZKBenchChurn : NSObject
+- (long)churn:(long)a;
+@end
+
+@implementation ZKBenchChurn
+- (long)churn:(long)a { return a; }
+@end
+
+@interface ZKBenchChurnHook : NSObject
+@end
+
+@implementation ZKBenchChurnHook
+- (long)churn:(long)a { return ZKOrig(long, a); }
+@end
+
+typedef struct ChurnThread {
+    pthread_barrier_t *barrier;
+    __unsafe_unretained ZKBenchChurn *object;
+    long calls;
+    volatile int *running;
+} ChurnThread;
+
+static void *churnCalls(void *argument) {
+    ChurnThread *thread = argument;
+    ZKBenchChurn *object = thread->object;
+    long sum = 0;
+
+    pthread_barrier_wait(thread->barrier);
+    for (long i = 0; i < thread->calls; i++)
+        sum += [object churn:i];
+
+    __atomic_sub_fetch(thread->running, 1, __ATOMIC_RELEASE);
+    sink = sum;
+    return NULL;
+}
+
+static void benchChurn(void) {
+    enum { THREADS = 4 };
+    ZKBenchChurn *object = [ZKBenchChurn new];
+    pthread_t handles[THREADS];
+    ChurnThread churn[THREADS];
+    pthread_barrier_t barrier;
+    volatile int running = THREADS;
+    pthread_barrier_init(&barrier, NULL, THREADS + 1);
+
+    for (unsigned int i = 0; i < THREADS; i++) {
+        churn[i] = (ChurnThread){ &barrier, object, CALLS / THREADS, &running };
+        pthread_create(&handles[i], NULL, churnCalls, &churn[i]);
+    }
+
+    pthread_barrier_wait(&barrier);
+    uint64_t start = nowNanoseconds();
+    uint64_t installs = 0;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE) > 0) {
+        ZKSwizzleBound(ZKBenchChurnHook, ZKBenchChurn);
+        ZKUnswizzle(ZKBenchChurnHook);
+        installs++;
+    }
+    for (unsigned int i = 0; i < THREADS; i++)
+        pthread_join(handles[i], NULL);
+    uint64_t elapsed = nowNanoseconds() - start;
+    pthread_barrier_destroy(&barrier);
+
+    benchReport("zkswizzle_dispatch_during_reinstall_4_threads", (uint64_t)(CALLS / THREADS) * THREADS, elapsed);
+    // One install and one unswizzle each
+    benchReport("zkswizzle_reinstall_during_dispatch_4_threads", installs, elapsed);
+}
+
+int main(int argc, char **argv) {
+    if (!benchRequested(argc, argv)) {
+        fprintf(stderr, "usage: %s --bench [--csv]\n", argv[0]);
+        return 1;
+    }
+
+    @autoreleasepool {
+        if (!ZKSwizzleGroup(ZKBench)) {
+            fprintf(stderr, "couldn't install the ZKBench hooks\n");
+            return 1;
+        }
+
+        benchDispatch();
+        benchArguments();
+        benchCallSiteCache();
+        benchEngines();
+        benchUnswizzledDispatch();
+        benchStats();
+        benchChains();
+        benchInstances();
+        benchSuper();
+        benchIvars();
+        // Before benchInstall, which leaves thousands of hook chains behind
+        benchStartup();
+        benchInstall();
+        benchContended();
+        benchChurn();
+    }
+    return 0;
+}
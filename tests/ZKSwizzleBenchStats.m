@@ -0,0 +1,47 @@
+//
+//  ZKSwizzleBenchStats.m
+//  StopStoplightLight tests
+//
+//  The hooks of ZKSwizzleBench's stats benchmark, built with ZKSWIZZLE_STATS=1 while the rest of it isn't.
+//
+
+#define ZKSWIZZLE_STATS 1
+#import "ZKSwizzle.h"
+#include "Check.h"
+
+static volatile long statsSink;
+
+@interface ZKBenchCounted : NSObject
+- (long)counted:(long)a;
+- (long)timed:(long)a;
+@end
+
+@implementation ZKBenchCounted
+- (long)counted:(long)a { return a; }
+- (long)timed:(long)a { return a; }
+@end
+
+ZKSwizzleInterface(ZKBenchCountedHook, ZKBenchCounted, NSObject)
+@implementation ZKBenchCountedHook
+- (long)counted:(long)a { return ZKOrig(long, a); }
+
+- (long)timed:(long)a {
+    ZKHookTimed();
+    return ZKOrig(long, a);
+}
+@end
+
+// Returns how long calls went through the counted hook, or the timed one
+uint64_t ZKBenchStatsDispatch(long calls, BOOL timed) {
+    ZKBenchCounted *object = [ZKBenchCounted new];
+
+    uint64_t start = nowNanoseconds();
+    if (timed) {
+        for (long i = 0; i < calls; i++)
+            statsSink = [object timed:i];
+    } else {
+        for (long i = 0; i < calls; i++)
+            statsSink = [object counted:i];
+    }
+    return nowNanoseconds() - start;
+}
@@ -0,0 +1,458 @@
+//
+//  ZKSwizzleTests.m
+//  StopStoplightLight tests
+//
+//  Tests of unswizzling, hook chains, groups, transactions, single object hooks and lock-free readers on the GNUstep runtime.
+//
+
+#import "ZKSwizzle.h"
+#include "Check.h"
+#include <pthread.h>
+
+// Every target inherits these, so each test hooks a class of its own and leaves the others alone
+@interface ZKTestBase : NSObject
+- (long)value;
+- (long)other;
++ (long)classValue;
+@end
+
+@implementation ZKTestBase
+- (long)value { return 1; }
+- (long)other { return 2; }
++ (long)classValue { return 3; }
+@end
+
+static BOOL raises(void (^block)(void)) {
+    @try {
+        block();
+    } @catch (NSException *exception) {
+        return YES;
+    }
+    return NO;
+}
+
+// Unswizzle
+
+@interface ZKUnswizzleTarget : ZKTestBase
+@end
+
+@implementation ZKUnswizzleTarget
+@end
+
+@interface ZKUnswizzleOther : ZKTestBase
+@end
+
+@implementation ZKUnswizzleOther
+@end
+
+@interface ZKUnswizzleHook : ZKTestBase
+@end
+
+@implementation ZKUnswizzleHook
+- (long)value { return ZKOrig(long) + 10; }
++ (long)classValue { return ZKOrig(long) + 10; }
+@end
+
+static void testUnswizzleRestores(void) {
+    ZKUnswizzleTarget *object = [ZKUnswizzleTarget new];
+
+    for (int round = 0; round < 3; round++) {
+        CHECK(ZKSwizzle(ZKUnswizzleHook, ZKUnswizzleTarget));
+        CHECK_EQUAL([object value], 11);
+        CHECK_EQUAL([object other], 2);
+        CHECK_EQUAL([ZKUnswizzleTarget classValue], 13);
+        CHECK(raises(^{ ZKSwizzle(ZKUnswizzleHook, ZKUnswizzleOther); }));
+
+        CHECK(ZKUnswizzle(ZKUnswizzleHook));
+        CHECK_EQUAL([object value], 1);
+        CHECK_EQUAL([ZKUnswizzleTarget classValue], 3);
+        CHECK_EQUAL([[ZKUnswizzleOther new] value], 1);
+    }
+
+    // Nothing is installed anymore
+    CHECK(!ZKUnswizzle(ZKUnswizzleHook));
+}
+
+// Hook chains
+
+@interface ZKChainTarget : ZKTestBase
+@end
+
+@implementation ZKChainTarget
+@end
+
+@interface ZKChainInnerHook : ZKTestBase
+@end
+
+@implementation ZKChainInnerHook
+- (long)value { return ZKOrig(long) + 100; }
+@end
+
+@interface ZKChainOuterHook : ZKTestBase
+@end
+
+@implementation ZKChainOuterHook
+- (long)value { return ZKOrig(long) + 1000; }
+@end
+
+// The ZKOrig call sites bind to their slot on the first call, every change below has to reach them
+static void testChainRebinds(void) {
+    ZKChainTarget *object = [ZKChainTarget new];
+
+    CHECK(ZKSwizzleBound(ZKChainInnerHook, ZKChainTarget));
+    CHECK_EQUAL([object value], 101);
+
+    CHECK(ZKUnswizzle(ZKChainInnerHook));
+    CHECK_EQUAL([object value], 1);
+
+    CHECK(ZKSwizzleBound(ZKChainInnerHook, ZKChainTarget));
+    CHECK_EQUAL([object value], 101);
+
+    CHECK(ZKSwizzleBoundWithPriority(ZKChainOuterHook, ZKChainTarget, 10));
+    CHECK_EQUAL([object value], 1101);
+
+    // The outer hook has to skip the one taken out from under it
+    CHECK(ZKUnswizzle(ZKChainInnerHook));
+    CHECK_EQUAL([object value], 1001);
+
+    CHECK(ZKSwizzleBound(ZKChainInnerHook, ZKChainTarget));
+    CHECK_EQUAL([object value], 1101);
+
+    CHECK(ZKUnswizzle(ZKChainOuterHook));
+    CHECK_EQUAL([object value], 101);
+    CHECK(ZKUnswizzle(ZKChainInnerHook));
+    CHECK_EQUAL([object value], 1);
+}
+
+@interface ZKInheritBase : ZKTestBase
+@end
+
+@implementation ZKInheritBase
+- (long)value { return 4; }
+@end
+
+// Only inherits -value, the first hook adds a method of its own
+@interface ZKInheritTarget : ZKInheritBase
+@end
+
+@implementation ZKInheritTarget
+@end
+
+@interface ZKInheritHook : ZKTestBase
+@end
+
+@implementation ZKInheritHook
+- (long)value { return ZKOrig(long) + 10; }
+@end
+
+@interface ZKInheritBaseHook : ZKTestBase
+@end
+
+@implementation ZKInheritBaseHook
+- (long)value { return ZKOrig(long) + 100; }
+@end
+
+// The method added to the subclass has to follow the superclass, before and after its chain empties
+static void testChainFollowsSuperclass(void) {
+    ZKInheritTarget *object = [ZKInheritTarget new];
+
+    CHECK(ZKSwizzleBound(ZKInheritHook, ZKInheritTarget));
+    CHECK_EQUAL([object value], 14);
+
+    CHECK(ZKSwizzleBound(ZKInheritBaseHook, ZKInheritBase));
+    CHECK_EQUAL([object value], 114);
+
+    CHECK(ZKUnswizzle(ZKInheritHook));
+    CHECK_EQUAL([object value], 104);
+
+    CHECK(ZKUnswizzle(ZKInheritBaseHook));
+    CHECK_EQUAL([object value], 4);
+    CHECK_EQUAL([[ZKInheritBase new] value], 4);
+
+    CHECK(ZKSwizzleBound(ZKInheritHook, ZKInheritTarget));
+    CHECK_EQUAL([object value], 14);
+    CHECK(ZKUnswizzle(ZKInheritHook));
+    CHECK_EQUAL([object value], 4);
+}
+
+// Groups
+
+@interface ZKGroupTargetA : ZKTestBase
+@end
+
+@implementation ZKGroupTargetA
+@end
+
+@interface ZKGroupTargetB : ZKTestBase
+@end
+
+@implementation ZKGroupTargetB
+@end
+
+ZKSwizzleInterfaceGroup(ZKGroupHookA, ZKGroupTargetA, ZKTestBase, ZKTestGroup)
+@implementation ZKGroupHookA
+- (long)value { return ZKOrig(long) + 10; }
+@end
+
+ZKSwizzleInterfaceGroup(ZKGroupHookB, ZKGroupTargetB, ZKTestBase, ZKTestGroup)
+@implementation ZKGroupHookB
+- (long)other { return ZKOrig(long) + 20; }
+@end
+
+static void testGroupSwizzleAndUnswizzle(void) {
+    ZKGroupTargetA *a = [ZKGroupTargetA new];
+    ZKGroupTargetB *b = [ZKGroupTargetB new];
+
+    // Groups wait to be asked
+    CHECK_EQUAL([a value], 1);
+    CHECK_EQUAL([b other], 2);
+
+    for (int round = 0; round < 2; round++) {
+        CHECK(ZKSwizzleGroup(ZKTestGroup));
+        CHECK_EQUAL([a value], 11);
+        CHECK_EQUAL([b other], 22);
+        CHECK_EQUAL([b value], 1);
+
+        CHECK(ZKUnswizzleGroup(ZKTestGroup));
+        CHECK_EQUAL([a value], 1);
+        CHECK_EQUAL([b other], 2);
+    }
+
+    CHECK(raises(^{ ZKSwizzleGroup(ZKNoSuchGroup); }));
+    CHECK(raises(^{ ZKUnswizzleGroup(ZKNoSuchGroup); }));
+}
+
+@interface ZKHandTarget : ZKTestBase
+@end
+
+@implementation ZKHandTarget
+@end
+
+// Registered by hand below instead of through the interface macros
+@interface ZKHandHook : ZKTestBase
+@end
+
+@implementation ZKHandHook
+- (long)value { return ZKOrig(long) + 30; }
+@end
+
+static void testGroupRegisteredByHand(void) {
+    ZKHandTarget *object = [ZKHandTarget new];
+    _$ZKRegisterInterface([ZKHandHook class], "ZKHandTarget", "ZKHandGroup");
+
+    for (int round = 0; round < 2; round++) {
+        CHECK(ZKSwizzleGroup(ZKHandGroup));
+        CHECK_EQUAL([object value], 31);
+
+        CHECK(ZKUnswizzleGroup(ZKHandGroup));
+        CHECK_EQUAL([object value], 1);
+    }
+
+    // A target that doesn't exist fails the group instead of raising
+    _$ZKRegisterInterface([ZKHandHook class], "ZKNoSuchTarget", "ZKHandMissingGroup");
+    CHECK(!ZKSwizzleGroup(ZKHandMissingGroup));
+}
+
+// Transactions
+
+@interface ZKRollbackTarget : ZKTestBase
+@end
+
+@implementation ZKRollbackTarget
+@end
+
+ZKSwizzleInterfaceGroup(ZKRollbackGood, ZKRollbackTarget, ZKTestBase, ZKRollbackGroup)
+@implementation ZKRollbackGood
+- (long)value { return ZKOrig(long) + 10; }
+@end
+
+// -other returns a long on the target, the type encodings don't match
+ZKSwizzleInterfaceGroup(ZKRollbackBad, ZKRollbackTarget, NSObject, ZKRollbackGroup)
+@implementation ZKRollbackBad
+- (double)other { return 0.5; }
+@end
+
+static void testGroupRollback(void) {
+    ZKRollbackTarget *object = [ZKRollbackTarget new];
+
+    ZKSwizzleBegin();
+    CHECK(ZKSwizzleGroup(ZKRollbackGroup));
+    CHECK_EQUAL([object value], 1);
+    CHECK(!ZKSwizzleCommit());
+
+    // The good half of the group was checked and dropped with the rest
+    CHECK_EQUAL([object value], 1);
+    CHECK_EQUAL([object other], 2);
+    CHECK(!ZKUnswizzle(ZKRollbackGood));
+
+    // and is free to be installed on its own
+    ZKSwizzleBegin();
+    CHECK(ZKSwizzleBound(ZKRollbackGood, ZKRollbackTarget));
+    CHECK(ZKSwizzleCommit());
+    CHECK_EQUAL([object value], 11);
+    CHECK(ZKUnswizzle(ZKRollbackGood));
+    CHECK_EQUAL([object value], 1);
+}
+
+static void testNestedTransaction(void) {
+    ZKRollbackTarget *object = [ZKRollbackTarget new];
+
+    ZKSwizzleBegin();
+    ZKSwizzleBegin();
+    CHECK(ZKSwizzleBound(ZKRollbackGood, ZKRollbackTarget));
+    CHECK(ZKSwizzleCommit());
+    // Only the outermost commit installs
+    CHECK_EQUAL([object value], 1);
+    CHECK(ZKSwizzleCommit());
+    CHECK_EQUAL([object value], 11);
+    CHECK(ZKUnswizzle(ZKRollbackGood));
+}
+
+// Single objects
+
+@interface ZKInstanceTarget : ZKTestBase
+@end
+
+@implementation ZKInstanceTarget
+@end
+
+@interface ZKInstanceHook : ZKTestBase
+@end
+
+@implementation ZKInstanceHook
+- (long)value { return ZKOrig(long) + 50; }
+@end
+
+static void testInstanceSwizzle(void) {
+    ZKInstanceTarget *hooked = [ZKInstanceTarget new];
+    ZKInstanceTarget *other  = [ZKInstanceTarget new];
+
+    for (int round = 0; round < 2; round++) {
+        CHECK(ZKSwizzleInstance(hooked, ZKInstanceHook));
+        CHECK_EQUAL([hooked value], 51);
+        CHECK_EQUAL([other value], 1);
+        CHECK([hooked class] == [ZKInstanceTarget class]);
+        CHECK(object_getClass(hooked) != [ZKInstanceTarget class]);
+        CHECK(raises(^{ ZKSwizzleBound(ZKInstanceHook, ZKInstanceTarget); }));
+
+        CHECK(ZKUnswizzleInstance(hooked, ZKInstanceHook));
+        CHECK_EQUAL([hooked value], 1);
+        CHECK(object_getClass(hooked) == [ZKInstanceTarget class]);
+    }
+
+    CHECK(!ZKUnswizzleInstance(other, ZKInstanceHook));
+}
+
+// Stands in for KVO, which moves every observed object of a class to one class of its own
+static void testInstanceSwizzleRefusesObservedObject(void) {
+    Class observing = objc_allocateClassPair([ZKInstanceTarget class], "ZKInstanceTarget_Observed", 0);
+    Method classMethod = class_getInstanceMethod([ZKInstanceTarget class], @selector(class));
+    class_addMethod(observing, @selector(class), imp_implementationWithBlock(^Class(id self) {
+        return [ZKInstanceTarget class];
+    }), method_getTypeEncoding(classMethod));
+    objc_registerClassPair(observing);
+
+    ZKInstanceTarget *observed = [ZKInstanceTarget new];
+    ZKInstanceTarget *alsoObserved = [ZKInstanceTarget new];
+    object_setClass(observed, observing);
+    object_setClass(alsoObserved, observing);
+
+    CHECK(!ZKSwizzleInstance(observed, ZKInstanceHook));
+    CHECK_EQUAL([observed value], 1);
+    CHECK_EQUAL([alsoObserved value], 1);
+    CHECK(object_getClass(observed) == observing);
+
+    // Once it isn't observed anymore it can be hooked
+    object_setClass(observed, [ZKInstanceTarget class]);
+    CHECK(ZKSwizzleInstance(observed, ZKInstanceHook));
+    CHECK_EQUAL([observed value], 51);
+    CHECK(ZKUnswizzleInstance(observed, ZKInstanceHook));
+}
+
+// Lock-free readers
+
+@interface ZKReaderTarget : ZKTestBase
+@end
+
+@implementation ZKReaderTarget
+- (long)value { return 5; }
+@end
+
+ZKSwizzleInterface(ZKReaderHook, ZKReaderTarget, ZKTestBase)
+@implementation ZKReaderHook
+- (long)value { return ZKOrig(long) * 10 + ZKSuper(long); }
+@end
+
+@interface ZKReaderChurnTarget : ZKTestBase
+@end
+
+@implementation ZKReaderChurnTarget
+@end
+
+@interface ZKReaderChurnHook : ZKTestBase
+@end
+
+@implementation ZKReaderChurnHook
+- (long)value { return ZKOrig(long) + 1; }
+@end
+
+typedef struct ReaderThread {
+    __unsafe_unretained ZKReaderTarget *object;
+    volatile int *running;
+    long wrong;
+} ReaderThread;
+
+static void *readerCalls(void *argument) {
+    ReaderThread *thread = argument;
+    for (long i = 0; i < 200000; i++) {
+        if ([thread->object value] != 51)
+            thread->wrong++;
+    }
+    __atomic_sub_fetch(thread->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Every install replaces the class table ZKSuper searches and makes the ZKOrig call sites resolve again
+static void testReadersDuringInstalls(void) {
+    enum { THREADS = 4 };
+    ZKReaderTarget *object = [ZKReaderTarget new];
+    pthread_t handles[THREADS];
+    ReaderThread readers[THREADS];
+    volatile int running = THREADS;
+
+    for (unsigned int i = 0; i < THREADS; i++) {
+        readers[i] = (ReaderThread){ object, &running, 0 };
+        pthread_create(&handles[i], NULL, readerCalls, &readers[i]);
+    }
+
+    long installs = 0;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE) > 0) {
+        CHECK(ZKSwizzle(ZKReaderChurnHook, ZKReaderChurnTarget));
+        CHECK(ZKUnswizzle(ZKReaderChurnHook));
+        installs++;
+    }
+    for (unsigned int i = 0; i < THREADS; i++) {
+        pthread_join(handles[i], NULL);
+        CHECK_EQUAL(readers[i].wrong, 0);
+    }
+
+    CHECK(installs > 0);
+    CHECK_EQUAL([object value], 51);
+    CHECK_EQUAL([[ZKReaderChurnTarget new] value], 1);
+}
+
+int main(void) {
+    @autoreleasepool {
+        RUN(testUnswizzleRestores);
+        RUN(testChainRebinds);
+        RUN(testChainFollowsSuperclass);
+        RUN(testGroupSwizzleAndUnswizzle);
+        RUN(testGroupRegisteredByHand);
+        RUN(testGroupRollback);
+        RUN(testNestedTransaction);
+        RUN(testInstanceSwizzle);
+        RUN(testInstanceSwizzleRefusesObservedObject);
+        RUN(testReadersDuringInstalls);
+    }
+    return checkResult();
+}